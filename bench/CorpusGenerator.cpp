@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <array>
+#include <fmt/format.h>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "CorpusGenerator.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+enum Type : std::uint16_t {
+    Byte = 1,
+    Ascii = 2,
+    Short = 3,
+    Long = 4,
+    Rational = 5,
+    Undefined = 7,
+};
+
+using Bytes = std::vector<std::uint8_t>;
+
+void put16(Bytes& out, std::size_t at, std::uint16_t value)
+{
+    out[at] = static_cast<std::uint8_t>(value);
+    out[at + 1] = static_cast<std::uint8_t>(value >> 8);
+}
+
+void put32(Bytes& out, std::size_t at, std::uint32_t value)
+{
+    for (std::size_t i = 0; i < 4; ++i)
+        out[at + i] = static_cast<std::uint8_t>(value >> (8 * i));
+}
+
+struct Entry {
+    std::uint16_t tag {};
+    std::uint16_t type {};
+    std::uint32_t count {};
+    Bytes data {};
+    // When set, the value is the absolute offset of that block instead of `data`
+    std::optional<std::size_t> block {};
+    // Embeds the block as the entry's data (e.g. MakerNote): count becomes the block size
+    bool blockAsData { false };
+};
+
+Entry ascii(std::uint16_t tag, std::string_view value)
+{
+    Bytes data { value.begin(), value.end() };
+    data.push_back(0);
+    return { tag, Ascii, static_cast<std::uint32_t>(data.size()), std::move(data) };
+}
+
+Entry shorts(std::uint16_t tag, std::initializer_list<std::uint16_t> values)
+{
+    Bytes data(values.size() * 2);
+    std::size_t at = 0;
+    for (auto value : values) {
+        put16(data, at, value);
+        at += 2;
+    }
+    return { tag, Short, static_cast<std::uint32_t>(values.size()), std::move(data) };
+}
+
+Entry shortArray(std::uint16_t tag, const std::vector<std::uint16_t>& values)
+{
+    Bytes data(values.size() * 2);
+    for (std::size_t i = 0; i < values.size(); ++i)
+        put16(data, i * 2, values[i]);
+    return { tag, Short, static_cast<std::uint32_t>(values.size()), std::move(data) };
+}
+
+Entry longValue(std::uint16_t tag, std::uint32_t value)
+{
+    Bytes data(4);
+    put32(data, 0, value);
+    return { tag, Long, 1, std::move(data) };
+}
+
+Entry bytes(std::uint16_t tag, std::initializer_list<std::uint8_t> values)
+{
+    return { tag, Byte, static_cast<std::uint32_t>(values.size()), Bytes { values } };
+}
+
+Entry rational(std::uint16_t tag, std::uint32_t numerator, std::uint32_t denominator)
+{
+    Bytes data(8);
+    put32(data, 0, numerator);
+    put32(data, 4, denominator);
+    return { tag, Rational, 1, std::move(data) };
+}
+
+Entry pointer(std::uint16_t tag, std::size_t block)
+{
+    return { tag, Long, 1, {}, block };
+}
+
+Entry embedded(std::uint16_t tag, std::size_t block)
+{
+    return { tag, Undefined, 0, {}, block, true };
+}
+
+/// Lays out IFDs and blobs after the TIFF header and resolves offsets between them
+class TiffBuilder {
+public:
+    std::size_t addIfd(std::vector<Entry> entries, Bytes prefix = {})
+    {
+        std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.tag < b.tag; });
+        m_blocks.push_back({ true, std::move(entries), std::move(prefix), {}, {} });
+        return m_blocks.size() - 1;
+    }
+
+    std::size_t addBlob(Bytes blob)
+    {
+        m_blocks.push_back({ false, {}, {}, std::move(blob), {} });
+        return m_blocks.size() - 1;
+    }
+
+    void setNext(std::size_t ifd, std::size_t next) { m_blocks[ifd].next = next; }
+
+    Bytes build(std::size_t firstIfd, std::optional<std::size_t> cr2RawIfd = {})
+    {
+        auto headerSize = cr2RawIfd.has_value() ? 16u : 8u;
+        std::vector<std::size_t> offsets(m_blocks.size());
+        auto offset = std::size_t { headerSize };
+        for (std::size_t i = 0; i < m_blocks.size(); ++i) {
+            offsets[i] = offset;
+            offset = (offset + size(m_blocks[i]) + 3) / 4 * 4;
+        }
+
+        Bytes out(offset);
+        out[0] = 'I';
+        out[1] = 'I';
+        put16(out, 2, 42);
+        put32(out, 4, static_cast<std::uint32_t>(offsets[firstIfd]));
+        if (cr2RawIfd.has_value()) {
+            out[8] = 'C';
+            out[9] = 'R';
+            out[10] = 2;
+            put32(out, 12, static_cast<std::uint32_t>(offsets[*cr2RawIfd]));
+        }
+
+        for (std::size_t i = 0; i < m_blocks.size(); ++i) {
+            auto& block = m_blocks[i];
+            if (!block.isIfd) {
+                std::copy(block.blob.begin(), block.blob.end(), out.begin() + static_cast<std::ptrdiff_t>(offsets[i]));
+                continue;
+            }
+
+            std::copy(block.prefix.begin(), block.prefix.end(), out.begin() + static_cast<std::ptrdiff_t>(offsets[i]));
+            auto ifd = offsets[i] + block.prefix.size();
+            auto data = ifd + 2 + block.entries.size() * 12 + 4;
+            put16(out, ifd, static_cast<std::uint16_t>(block.entries.size()));
+            for (std::size_t e = 0; e < block.entries.size(); ++e) {
+                auto& entry = block.entries[e];
+                auto at = ifd + 2 + e * 12;
+                put16(out, at, entry.tag);
+                put16(out, at + 2, entry.type);
+                if (entry.block.has_value()) {
+                    auto count = entry.blockAsData ? size(m_blocks[*entry.block]) : entry.count;
+                    put32(out, at + 4, static_cast<std::uint32_t>(count));
+                    put32(out, at + 8, static_cast<std::uint32_t>(offsets[*entry.block]));
+                    continue;
+                }
+                put32(out, at + 4, entry.count);
+                if (entry.data.size() <= 4) {
+                    std::copy(entry.data.begin(), entry.data.end(), out.begin() + static_cast<std::ptrdiff_t>(at + 8));
+                } else {
+                    put32(out, at + 8, static_cast<std::uint32_t>(data));
+                    std::copy(entry.data.begin(), entry.data.end(), out.begin() + static_cast<std::ptrdiff_t>(data));
+                    data += (entry.data.size() + 1) / 2 * 2;
+                }
+            }
+            put32(out, ifd + 2 + block.entries.size() * 12, block.next.has_value() ? static_cast<std::uint32_t>(offsets[*block.next]) : 0);
+        }
+        return out;
+    }
+
+private:
+    struct Block {
+        bool isIfd;
+        std::vector<Entry> entries;
+        Bytes prefix;
+        Bytes blob;
+        std::optional<std::size_t> next;
+    };
+
+    static std::size_t size(const Block& block)
+    {
+        if (!block.isIfd)
+            return block.blob.size();
+        auto total = block.prefix.size() + 2 + block.entries.size() * 12 + 4;
+        for (auto& entry : block.entries) {
+            if (!entry.block.has_value() && entry.data.size() > 4)
+                total += (entry.data.size() + 1) / 2 * 2;
+        }
+        return total;
+    }
+
+    std::vector<Block> m_blocks {};
+};
+
+template <typename T, std::size_t N>
+const T& pick(std::mt19937& random, const std::array<T, N>& values)
+{
+    return values[std::uniform_int_distribution<std::size_t> { 0, N - 1 }(random)];
+}
+
+std::string randomDate(std::mt19937& random)
+{
+    auto between = [&](int low, int high) { return std::uniform_int_distribution { low, high }(random); };
+    return fmt::format("{:04}:{:02}:{:02} {:02}:{:02}:{:02}", between(2016, 2024), between(1, 12), between(1, 28), between(0, 23), between(0, 59), between(0, 59));
+}
+
+struct Exposure {
+    std::uint16_t iso;
+    std::uint32_t shutterDenominator;
+    std::uint32_t apertureTenths;
+    std::uint32_t focalLength;
+};
+
+Exposure randomExposure(std::mt19937& random)
+{
+    static constexpr std::array<std::uint16_t, 10> isos { 50, 100, 200, 400, 800, 1600, 3200, 6400, 12800, 25600 };
+    static constexpr std::array<std::uint32_t, 10> shutters { 1, 4, 30, 60, 125, 250, 500, 1000, 4000, 8000 };
+    static constexpr std::array<std::uint32_t, 9> apertures { 14, 18, 20, 28, 40, 56, 80, 110, 160 };
+    return {
+        pick(random, isos),
+        pick(random, shutters),
+        pick(random, apertures),
+        std::uniform_int_distribution<std::uint32_t> { 12, 600 }(random),
+    };
+}
+
+std::vector<Entry> exifEntries(std::mt19937& random, const Exposure& exposure, const std::string& date)
+{
+    return {
+        rational(0x829A, 1, exposure.shutterDenominator),
+        rational(0x829D, exposure.apertureTenths, 10),
+        shorts(0x8827, { exposure.iso }),
+        ascii(0x9003, date),
+        rational(0x920A, exposure.focalLength, 1),
+        ascii(0xA435, fmt::format("{:010}", std::uniform_int_distribution<std::uint32_t> {}(random))),
+    };
+}
+
+Bytes blankRaw(const CorpusOptions& options)
+{
+    return Bytes(static_cast<std::size_t>(options.rawWidth) * options.rawHeight * 2);
+}
+
+}
+
+std::vector<std::uint8_t> CorpusGenerator::makeArw(std::mt19937& random, const CorpusOptions& options)
+{
+    static constexpr std::array<std::string_view, 5> models { "ILCE-7M3", "ILCE-7RM4", "ILCE-6400", "ILCE-1", "ILCA-99M2" };
+    static constexpr std::array<std::pair<std::uint32_t, std::string_view>, 4> lenses { {
+        { 32870, "FE 24-70mm F2.8 GM" },
+        { 32828, "FE 85mm F1.8" },
+        { 32851, "FE 70-200mm F2.8 GM OSS" },
+        { 32789, "FE 35mm F1.8" },
+    } };
+
+    auto model = pick(random, models);
+    auto [lensId, lensName] = pick(random, lenses);
+    auto exposure = randomExposure(random);
+    auto date = randomDate(random);
+
+    TiffBuilder tiff {};
+    auto strip = tiff.addBlob(blankRaw(options));
+    auto makerNote = tiff.addIfd(
+        {
+            longValue(0x0102, std::uniform_int_distribution { 0, 1 }(random) == 0 ? 0 : 7),
+            longValue(0xB027, lensId),
+        },
+        { 'S', 'O', 'N', 'Y', ' ', 'D', 'S', 'C', ' ', 0, 0, 0 });
+
+    auto exif = exifEntries(random, exposure, date);
+    exif.push_back(embedded(0x927C, makerNote));
+    exif.push_back(ascii(0xA434, lensName));
+    auto exifIfd = tiff.addIfd(std::move(exif));
+
+    auto rawIfd = tiff.addIfd({
+        longValue(0x00FE, 0),
+        longValue(0x0100, options.rawWidth),
+        longValue(0x0101, options.rawHeight),
+        shorts(0x0102, { 16 }),
+        shorts(0x0103, { 1 }),
+        shorts(0x0106, { 32803 }),
+        pointer(0x0111, strip),
+        shorts(0x0115, { 1 }),
+        longValue(0x0116, options.rawHeight),
+        longValue(0x0117, static_cast<std::uint32_t>(options.rawWidth) * options.rawHeight * 2),
+        shorts(0x828D, { 2, 2 }),
+        bytes(0x828E, { 0, 1, 1, 2 }),
+        shorts(0xC620, { static_cast<std::uint16_t>(options.rawWidth - 8), static_cast<std::uint16_t>(options.rawHeight - 8) }),
+    });
+
+    auto ifd0 = tiff.addIfd({
+        longValue(0x00FE, 1),
+        ascii(0x010F, "SONY"),
+        ascii(0x0110, model),
+        ascii(0x0131, fmt::format("{} v1.00", model)),
+        ascii(0x0132, date),
+        pointer(0x014A, rawIfd),
+        pointer(0x8769, exifIfd),
+    });
+
+    return tiff.build(ifd0);
+}
+
+std::vector<std::uint8_t> CorpusGenerator::makeCr2(std::mt19937& random, const CorpusOptions& options)
+{
+    static constexpr std::array<std::string_view, 4> models { "Canon EOS 5D Mark IV", "Canon EOS 6D", "Canon EOS 80D", "Canon EOS 7D Mark II" };
+    static constexpr std::array<std::pair<std::uint16_t, std::string_view>, 4> lenses { {
+        { 137, "EF24-70mm f/2.8L II USM" },
+        { 160, "EF50mm f/1.8 STM" },
+        { 254, "EF100mm f/2.8L Macro IS USM" },
+        { 495, "EF70-200mm f/2.8L IS III USM" },
+    } };
+
+    auto model = pick(random, models);
+    auto [lensType, lensName] = pick(random, lenses);
+    auto exposure = randomExposure(random);
+    auto date = randomDate(random);
+
+    std::vector<std::uint16_t> cameraSettings(46);
+    cameraSettings[0] = static_cast<std::uint16_t>(cameraSettings.size() * 2);
+    cameraSettings[3] = std::uniform_int_distribution { 0, 1 }(random) == 0 ? 4 : 7;
+    cameraSettings[22] = lensType;
+
+    std::vector<std::uint16_t> sensorInfo(17);
+    sensorInfo[0] = static_cast<std::uint16_t>(sensorInfo.size() * 2);
+    sensorInfo[1] = options.rawWidth;
+    sensorInfo[2] = options.rawHeight;
+    sensorInfo[5] = 8;
+    sensorInfo[6] = 4;
+    sensorInfo[7] = static_cast<std::uint16_t>(options.rawWidth - 1);
+    sensorInfo[8] = static_cast<std::uint16_t>(options.rawHeight - 1);
+
+    TiffBuilder tiff {};
+    auto strip = tiff.addBlob(blankRaw(options));
+    auto makerNote = tiff.addIfd({
+        shortArray(0x0001, cameraSettings),
+        longValue(0x000C, std::uniform_int_distribution<std::uint32_t> { 1, 999999999 }(random)),
+        ascii(0x0095, lensName),
+        shortArray(0x00E0, sensorInfo),
+    });
+
+    auto exif = exifEntries(random, exposure, date);
+    exif.push_back(embedded(0x927C, makerNote));
+    exif.push_back(ascii(0xA434, lensName));
+    auto exifIfd = tiff.addIfd(std::move(exif));
+
+    auto rawIfd = tiff.addIfd({
+        longValue(0x0100, options.rawWidth),
+        longValue(0x0101, options.rawHeight),
+        shorts(0x0102, { 16 }),
+        shorts(0x0103, { 1 }),
+        pointer(0x0111, strip),
+        longValue(0x0117, static_cast<std::uint32_t>(options.rawWidth) * options.rawHeight * 2),
+    });
+
+    auto ifd0 = tiff.addIfd({
+        longValue(0x0100, options.rawWidth),
+        longValue(0x0101, options.rawHeight),
+        ascii(0x010F, "Canon"),
+        ascii(0x0110, model),
+        ascii(0x0132, date),
+        pointer(0x8769, exifIfd),
+    });
+    tiff.setNext(ifd0, rawIfd);
+
+    return tiff.build(ifd0, rawIfd);
+}
+
+std::vector<fs::path> CorpusGenerator::generate(const fs::path& root, const CorpusOptions& options)
+{
+    std::mt19937 random { options.seed };
+    std::uniform_int_distribution<std::size_t> branch { 0, options.fanout == 0 ? 0 : options.fanout - 1 };
+
+    std::vector<fs::path> files {};
+    files.reserve(options.files);
+    for (std::size_t i = 0; i < options.files; ++i) {
+        auto directory = root;
+        for (std::size_t level = 0; level < options.depth; ++level)
+            directory /= fmt::format("dir{}", branch(random));
+        fs::create_directories(directory);
+
+        auto sony = std::uniform_int_distribution { 0, 1 }(random) == 0;
+        auto path = directory / (sony ? fmt::format("DSC{:05}.ARW", i) : fmt::format("IMG_{:05}.CR2", i));
+        auto contents = sony ? makeArw(random, options) : makeCr2(random, options);
+
+        std::ofstream file { path, std::ios::binary };
+        file.write(reinterpret_cast<const char*>(contents.data()), static_cast<std::streamsize>(contents.size()));
+        files.push_back(std::move(path));
+    }
+    return files;
+}
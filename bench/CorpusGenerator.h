@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+struct CorpusOptions {
+    std::size_t files { 1000 };
+    /// @brief Directory levels below the corpus root
+    std::size_t depth { 3 };
+    /// @brief Subdirectories per directory
+    std::size_t fanout { 4 };
+    std::uint32_t seed { 1 };
+    /// @brief Dimensions of the (blank, uncompressed 16-bit) raw image in every file
+    std::uint16_t rawWidth { 256 };
+    std::uint16_t rawHeight { 192 };
+};
+
+/// @brief Writes synthetic, minimal Sony ARW and Canon CR2 files: valid TIFF containers with randomized EXIF
+/// and makernote values and a blank raw strip, so benchmarks can run without shipping real photos.
+/// TiffParser reads them completely; whether LibRaw accepts them depends on its version, so callers should
+/// probe before benchmarking LibRaw-backed paths.
+class CorpusGenerator final {
+public:
+    /// @brief Creates `options.files` files spread over a directory tree below `root`, returns their paths
+    static std::vector<std::filesystem::path> generate(const std::filesystem::path& root, const CorpusOptions& options);
+
+    [[nodiscard]] static std::vector<std::uint8_t> makeArw(std::mt19937& random, const CorpusOptions& options);
+    [[nodiscard]] static std::vector<std::uint8_t> makeCr2(std::mt19937& random, const CorpusOptions& options);
+};
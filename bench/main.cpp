@@ -0,0 +1,320 @@
+#include <cxxopts.hpp>
+#include <fmt/format.h>
+#include <libraw/libraw.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <new>
+#include <random>
+#include <thread>
+
+#include "CorpusGenerator.h"
+#include "Discovery.h"
+#include "Extractor.h"
+#include "FormatUtils.h"
+#include "RawSource.h"
+#include "Statistics.h"
+#include "Summary.h"
+#include "TiffParser.h"
+#include "TimeUtils.h"
+
+namespace fs = std::filesystem;
+namespace chrono = std::chrono;
+
+using fmt::print;
+using Clock = chrono::steady_clock;
+
+// Every heap allocation of the process, so benchmarks can report allocations per operation
+static std::atomic<std::size_t> allocationCount { 0 };
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (auto* pointer = std::malloc(size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+namespace {
+
+/// @brief Keeps the compiler from discarding a computed value
+template <typename T>
+void doNotOptimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// @brief Runs `body` (which handles `items` items per call) `iterations` times and reports the best run
+/// and the allocations of the last one
+void bench(std::string_view name, std::size_t iterations, std::size_t items, const std::function<void()>& body)
+{
+    auto best = chrono::nanoseconds::max();
+    std::size_t allocations = 0;
+    for (std::size_t i = 0; i < iterations; ++i) {
+        auto allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        auto start = Clock::now();
+        body();
+        best = std::min(best, chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start));
+        allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+    }
+    auto seconds = chrono::duration<double>(best).count();
+    print("{:<40} {:>12.1f} ns/op {:>14.0f} ops/s {:>10.1f} allocs/op\n", name, static_cast<double>(best.count()) / static_cast<double>(items),
+        static_cast<double>(items) / seconds, static_cast<double>(allocations) / static_cast<double>(items));
+}
+
+/// @brief Peak resident set size of the process so far, in MiB
+double peakRssMiB()
+{
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    // Linux reports kilobytes
+    return static_cast<double>(usage.ru_maxrss) / 1024.0;
+}
+
+std::size_t scanDirectory(const fs::path& root, std::size_t jobs)
+{
+    BoundedQueue<RawFile> queue { discoveryQueueCapacity };
+    ThreadPool pool { jobs };
+    std::thread discovery { [&] { findRawFiles(pool, queue, { root.string() }, { "" }); } };
+    std::size_t found = 0;
+    while (queue.pop())
+        ++found;
+    discovery.join();
+    return found;
+}
+
+void scanFiles(const std::vector<fs::path>& files, const CommandlineOptions& options, std::FILE* sink)
+{
+    Data data { options.exactStats };
+    OrderedOutput output { sink };
+    ColumnarWriter columns {};
+    FastPathStats fastPathStats {};
+    auto context = ScanContext {
+        .cache = nullptr,
+        .output = &output,
+        .columns = &columns,
+        .fastPath = &fastPathStats,
+    };
+    auto raw = std::make_unique<LibRaw>();
+    for (std::size_t i = 0; i < files.size(); ++i)
+        populateArrays(&data, RawFile { i, files[i] }, options, context, *raw);
+    doNotOptimize(data.photoCount());
+}
+
+bool libRawAccepts(const fs::path& file)
+{
+    LibRaw raw {};
+    return raw.open_file(file.c_str()) == LIBRAW_SUCCESS;
+}
+
+std::vector<float> randomSamples(std::size_t count, std::uint32_t seed)
+{
+    std::mt19937 random { seed };
+    std::lognormal_distribution<float> distribution { 6.0f, 1.0f };
+    std::vector<float> samples(count);
+    for (auto& sample : samples)
+        sample = distribution(random);
+    return samples;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    auto options = cxxopts::Options {
+        "rawinfo_bench",
+        "Benchmarks rawinfo's hot paths on a generated corpus of synthetic ARW/CR2 files"
+    };
+    // clang-format off
+    options.add_options()
+        ("h,help", "Show this help")
+        ("files", "Number of files to generate", cxxopts::value<std::size_t>()->default_value("1000"))
+        ("depth", "Directory levels of the generated tree", cxxopts::value<std::size_t>()->default_value("3"))
+        ("fanout", "Subdirectories per directory", cxxopts::value<std::size_t>()->default_value("4"))
+        ("seed", "Random seed for the corpus and samples", cxxopts::value<std::uint32_t>()->default_value("1"))
+        ("iterations", "Repetitions per benchmark, the fastest is reported", cxxopts::value<std::size_t>()->default_value("5"))
+        ("j,jobs", "Worker threads for discovery (0 = one per hardware thread)", cxxopts::value<std::size_t>()->default_value("0"))
+        ("dir", "Where to generate the corpus (default: a new temporary directory)", cxxopts::value<std::string>())
+        ("keep", "Don't delete the corpus afterwards");
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    if (result.count("help")) {
+        print("{}\n", options.help());
+        return 0;
+    }
+
+    auto iterations = std::max<std::size_t>(1, result["iterations"].as<std::size_t>());
+    auto jobs = ThreadPool::resolveWorkerCount(result["jobs"].as<std::size_t>());
+    auto corpusOptions = CorpusOptions {
+        .files = result["files"].as<std::size_t>(),
+        .depth = result["depth"].as<std::size_t>(),
+        .fanout = result["fanout"].as<std::size_t>(),
+        .seed = result["seed"].as<std::uint32_t>(),
+    };
+    if (corpusOptions.files == 0) {
+        print(stderr, "--files must be at least 1\n");
+        return 1;
+    }
+
+    auto root = result.count("dir") ? fs::path { result["dir"].as<std::string>() }
+                                    : fs::temp_directory_path() / fmt::format("rawinfo_bench_{}", corpusOptions.seed);
+    auto generationStart = Clock::now();
+    auto files = CorpusGenerator::generate(root, corpusOptions);
+    print("Generated {} files in {} ({} ms)\n\n", files.size(), root.string(),
+        chrono::duration_cast<chrono::milliseconds>(Clock::now() - generationStart).count());
+
+    auto* sink = std::fopen("/dev/null", "w");
+    if (sink == nullptr) {
+        print(stderr, "Could not open /dev/null\n");
+        return 1;
+    }
+
+    bench(fmt::format("findRawFiles ({} threads)", jobs), iterations, files.size(), [&] {
+        doNotOptimize(scanDirectory(root, jobs));
+    });
+
+    // Parse from memory so the numbers don't include the page cache
+    std::vector<std::unique_ptr<MappedFile>> mapped {};
+    for (auto& file : files)
+        mapped.push_back(std::make_unique<MappedFile>(file));
+    bench("TiffParser::parse", iterations, mapped.size(), [&] {
+        for (auto& file : mapped)
+            doNotOptimize(TiffParser::parse(file->data(), file->size()));
+    });
+
+    auto scanOptions = CommandlineOptions { .silent = true };
+    bench("populateArrays (fastpath)", iterations, files.size(), [&] {
+        auto fastPath = scanOptions;
+        fastPath.fastPath = true;
+        scanFiles(files, fastPath, sink);
+    });
+    bench("populateArrays (fastpath, text output)", iterations, files.size(), [&] {
+        auto fastPath = scanOptions;
+        fastPath.silent = false;
+        fastPath.fastPath = true;
+        scanFiles(files, fastPath, sink);
+    });
+    // What reusing one LibRaw per worker saves on every file
+    bench("LibRaw construction", iterations, 100, [&] {
+        for (std::size_t i = 0; i < 100; ++i)
+            doNotOptimize(std::make_unique<LibRaw>());
+    });
+    if (libRawAccepts(files.front())) {
+        for (auto [name, mode] : { std::pair { "libraw", IoMode::LibRaw }, { "mmap", IoMode::Mmap }, { "pread", IoMode::Pread } }) {
+            bench(fmt::format("populateArrays (--io={})", name), iterations, files.size(), [&] {
+                auto libRaw = scanOptions;
+                libRaw.ioMode = mode;
+                scanFiles(files, libRaw, sink);
+            });
+        }
+    } else {
+        print("{:<40} skipped, this LibRaw build rejects the synthetic files\n", "populateArrays (libraw)");
+    }
+
+    auto samples = randomSamples(100'000, corpusOptions.seed);
+    for (auto exact : { false, true }) {
+        auto suffix = exact ? "exact" : "sketch";
+        bench(fmt::format("StreamingStats::add ({})", suffix), iterations, samples.size(), [&] {
+            StreamingStats stats { exact };
+            for (auto sample : samples)
+                stats.add(sample);
+            doNotOptimize(stats.count());
+        });
+
+        StreamingStats stats { exact };
+        for (auto sample : samples)
+            stats.add(sample);
+        bench(fmt::format("StreamingStats::quantile ({})", suffix), iterations, 3, [&] {
+            doNotOptimize(stats.quantile(0.5));
+            doNotOptimize(stats.quantile(0.9));
+            doNotOptimize(stats.quantile(0.99));
+        });
+
+        std::vector<StreamingStats> shards(16, StreamingStats { exact });
+        for (std::size_t i = 0; i < samples.size(); ++i)
+            shards[i % shards.size()].add(samples[i]);
+        bench(fmt::format("StreamingStats::merge ({})", suffix), iterations, shards.size(), [&] {
+            StreamingStats merged { exact };
+            for (auto& shard : shards)
+                merged.merge(shard);
+            doNotOptimize(merged.count());
+        });
+    }
+
+    {
+        Data data { false };
+        OrderedOutput output { sink };
+        ColumnarWriter columns {};
+        FastPathStats fastPathStats {};
+        auto context = ScanContext { .output = &output, .columns = &columns, .fastPath = &fastPathStats };
+        auto fastPath = scanOptions;
+        fastPath.fastPath = true;
+        auto raw = std::make_unique<LibRaw>();
+        for (std::size_t i = 0; i < files.size(); ++i)
+            populateArrays(&data, RawFile { i, files[i] }, fastPath, context, *raw);
+        bench("printSummary", iterations, 1, [&] {
+            OutputBuffer out { false };
+            printSummary(out, data, chrono::milliseconds { 0 });
+            doNotOptimize(out.empty());
+        });
+    }
+
+    constexpr std::size_t formatCalls = 100'000;
+    auto formatBench = [&](std::string_view name, const std::function<std::string(std::size_t)>& format) {
+        bench(name, iterations, formatCalls, [&] {
+            for (std::size_t i = 0; i < formatCalls; ++i)
+                doNotOptimize(format(i));
+        });
+    };
+    formatBench("FormatUtils::formatShutterSpeed", [&](auto i) { return FormatUtils::formatShutterSpeed(samples[i % samples.size()] / 10000.0f); });
+    formatBench("FormatUtils::formatAperture", [&](auto i) { return FormatUtils::formatAperture(samples[i % samples.size()] / 100.0f); });
+    formatBench("FormatUtils::formatISO", [&](auto i) { return FormatUtils::formatISO(samples[i % samples.size()]); });
+    formatBench("FormatUtils::formatFocalLength", [&](auto i) { return FormatUtils::formatFocalLength(samples[i % samples.size()]); });
+    formatBench("FormatUtils::formatResolution", [&](auto i) { return FormatUtils::formatResolution(static_cast<unsigned>(samples[i % samples.size()] * 10000)); });
+    std::string lensMake { "Sony" }, lens { "FE 24-70mm F2.8 GM" };
+    formatBench("FormatUtils::formatLens", [&](auto) { return FormatUtils::formatLens(lensMake, lens); });
+    auto now = std::time(nullptr);
+    formatBench("TimeUtils::formatISO8601", [&](auto i) { return TimeUtils::formatISO8601(now - static_cast<std::time_t>(i) * 3600); });
+    formatBench("TimeUtils::formatTimeSpan", [&](auto i) { return TimeUtils::formatTimeSpan(now - static_cast<std::time_t>(i) * 86400, now); });
+    formatBench("TimeUtils::formatTimeSince", [&](auto i) { return TimeUtils::formatTimeSince(now - static_cast<std::time_t>(i) * 60); });
+
+    print("\nPeak RSS: {:.1f} MiB\n", peakRssMiB());
+
+    // The append variants the per-file output uses, into a reused buffer
+    fmt::memory_buffer buffer {};
+    auto appendBench = [&](std::string_view name, const std::function<void(std::size_t)>& append) {
+        bench(name, iterations, formatCalls, [&] {
+            for (std::size_t i = 0; i < formatCalls; ++i) {
+                buffer.clear();
+                append(i);
+                doNotOptimize(buffer.size());
+            }
+        });
+    };
+    appendBench("FormatUtils::appendShutterSpeed", [&](auto i) { FormatUtils::appendShutterSpeed(fmt::appender(buffer), samples[i % samples.size()] / 10000.0f); });
+    appendBench("FormatUtils::appendLens", [&](auto) { FormatUtils::appendLens(fmt::appender(buffer), lensMake, lens); });
+    appendBench("TimeUtils::appendISO8601", [&](auto i) { TimeUtils::appendISO8601(fmt::appender(buffer), now - static_cast<std::time_t>(i) * 3600); });
+    appendBench("TimeUtils::appendTimeSince", [&](auto i) { TimeUtils::appendTimeSince(fmt::appender(buffer), now - static_cast<std::time_t>(i) * 60); });
+
+    std::fclose(sink);
+    if (!result.count("keep") && !result.count("dir"))
+        fs::remove_all(root);
+    return 0;
+}
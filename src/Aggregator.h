@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Data.h"
+#include "macros.h"
+
+/// @brief The aggregation side for a Scanner's callback: every worker adds to its own Data shard, so the hot
+/// path never contends, and the shards are merged once the scan is done
+class Aggregator final {
+public:
+    /// @param empty Every shard starts out as a copy, which carries the exactness, grouping and timeline settings
+    explicit Aggregator(std::size_t workers, const Data& empty = Data {})
+        : m_shards(workers, empty)
+    {
+    }
+
+    /// @brief Only ever called by `worker` itself
+    void add(std::size_t worker, const PhotoRecord& record) { m_shards[worker].add(record); }
+
+    [[nodiscard]] Data merge() const
+    {
+        ASSERT(!m_shards.empty());
+        auto data = m_shards.front();
+        for (std::size_t worker = 1; worker < m_shards.size(); ++worker)
+            data.merge(m_shards[worker]);
+        return data;
+    }
+
+private:
+    std::vector<Data> m_shards;
+};
@@ -0,0 +1,414 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <fmt/color.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Archive.h"
+#include "RawFormat.h"
+
+namespace fs = std::filesystem;
+
+using fmt::print, fmt::fg, fmt::color;
+
+namespace {
+
+/// @brief Read-only descriptor of an archive, closed on destruction
+class ArchiveFile final {
+public:
+    explicit ArchiveFile(const fs::path& path)
+        : m_fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC))
+    {
+        struct stat st { };
+        if (m_fd >= 0 && ::fstat(m_fd, &st) == 0)
+            m_size = static_cast<std::uint64_t>(st.st_size);
+    }
+
+    ~ArchiveFile()
+    {
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    ArchiveFile(const ArchiveFile&) = delete;
+    ArchiveFile& operator=(const ArchiveFile&) = delete;
+
+    [[nodiscard]] bool valid() const { return m_fd >= 0; }
+    [[nodiscard]] std::uint64_t size() const { return m_size; }
+
+    /// @brief Reads exactly `count` bytes at `offset`, false on errors and short reads
+    bool readAt(void* out, std::size_t count, std::uint64_t offset) const
+    {
+        auto* bytes = static_cast<unsigned char*>(out);
+        std::size_t total = 0;
+        while (total < count) {
+            auto got = ::pread(m_fd, bytes + total, count - total, static_cast<off_t>(offset + total));
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                return false;
+            total += static_cast<std::size_t>(got);
+        }
+        return true;
+    }
+
+private:
+    int m_fd;
+    std::uint64_t m_size { 0 };
+};
+
+std::uint64_t readLittleEndian(const unsigned char* data, std::size_t bytes)
+{
+    std::uint64_t value = 0;
+    for (std::size_t i = bytes; i-- > 0;)
+        value = value << 8 | data[i];
+    return value;
+}
+
+// Member names inside archives are relative, but some tools prefix them with ./ or /
+std::string_view memberName(std::string_view name)
+{
+    while (name.starts_with("./") || name.starts_with('/'))
+        name.remove_prefix(name.starts_with('/') ? 1 : 2);
+    return name;
+}
+
+bool warn(const fs::path& archive, std::string_view problem)
+{
+    print(stderr, fg(color::yellow), "Skipping rest of archive {}: {}\n", archive.string(), problem);
+    return false;
+}
+
+// tar
+
+constexpr std::size_t tarBlockSize = 512;
+// GNU long names and pax headers larger than this are not plausible for photos
+constexpr std::uint64_t maxTarExtensionSize = 1 << 20;
+
+struct TarHeader {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char type;
+    char linkName[100];
+    char magic[6];
+    char version[2];
+    char userName[32];
+    char groupName[32];
+    char deviceMajor[8];
+    char deviceMinor[8];
+    char prefix[155];
+    char padding[12];
+};
+static_assert(sizeof(TarHeader) == tarBlockSize);
+
+std::string_view field(const char* data, std::size_t size)
+{
+    return { data, static_cast<std::size_t>(std::find(data, data + size, '\0') - data) };
+}
+
+// Octal, or big-endian base-256 (GNU) when the high bit of the first byte is set
+std::uint64_t tarNumber(const char* data, std::size_t size)
+{
+    auto* bytes = reinterpret_cast<const unsigned char*>(data);
+    std::uint64_t value = 0;
+    if (bytes[0] & 0x80) {
+        value = bytes[0] & 0x7F;
+        for (std::size_t i = 1; i < size; ++i)
+            value = value << 8 | bytes[i];
+        return value;
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+        if (data[i] >= '0' && data[i] <= '7')
+            value = value * 8 + static_cast<std::uint64_t>(data[i] - '0');
+        else if (data[i] != ' ' || value != 0)
+            break;
+    }
+    return value;
+}
+
+bool tarChecksumMatches(const TarHeader& header)
+{
+    auto* bytes = reinterpret_cast<const unsigned char*>(&header);
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < tarBlockSize; ++i)
+        sum += bytes[i];
+    // The checksum field itself counts as spaces
+    for (auto c : header.checksum)
+        sum += static_cast<unsigned char>(' ') - static_cast<unsigned char>(c);
+    return sum == tarNumber(header.checksum, sizeof(header.checksum));
+}
+
+std::optional<std::uint64_t> decimal(std::string_view text)
+{
+    if (text.empty())
+        return std::nullopt;
+    std::uint64_t value = 0;
+    for (auto c : text) {
+        if (c < '0' || c > '9')
+            return std::nullopt;
+        value = value * 10 + static_cast<std::uint64_t>(c - '0');
+    }
+    return value;
+}
+
+// Applies the "path" and "size" records of a pax extended header ("<length> <key>=<value>\n" each)
+void parsePaxHeader(std::string_view records, std::string& path, std::optional<std::uint64_t>& size)
+{
+    while (!records.empty()) {
+        auto space = records.find(' ');
+        if (space == std::string_view::npos)
+            return;
+        auto length = decimal(records.substr(0, space));
+        if (!length.has_value() || *length <= space + 1 || *length > records.size())
+            return;
+
+        auto record = records.substr(space + 1, *length - space - 1);
+        if (record.ends_with('\n'))
+            record.remove_suffix(1);
+        auto equals = record.find('=');
+        if (equals != std::string_view::npos) {
+            auto key = record.substr(0, equals);
+            auto value = record.substr(equals + 1);
+            if (key == "path")
+                path = value;
+            else if (key == "size")
+                size = decimal(value);
+        }
+        records.remove_prefix(*length);
+    }
+}
+
+bool listTar(const fs::path& path, const ArchiveFile& file, const std::function<void(std::string_view, const ArchiveMember&)>& visit)
+{
+    // Set by GNU long name and pax headers for the entry that follows them
+    std::string longName {};
+    std::optional<std::uint64_t> paxSize {};
+    std::string extension {};
+
+    std::uint64_t offset = 0;
+    TarHeader header {};
+    while (offset + tarBlockSize <= file.size()) {
+        if (!file.readAt(&header, tarBlockSize, offset))
+            return warn(path, "read error");
+        // The archive ends with zero blocks
+        auto* bytes = reinterpret_cast<const unsigned char*>(&header);
+        if (std::all_of(bytes, bytes + tarBlockSize, [](auto byte) { return byte == 0; }))
+            return true;
+        if (!tarChecksumMatches(header))
+            return warn(path, fmt::format("bad header checksum at offset {}", offset));
+
+        auto extended = header.type == 'L' || header.type == 'x';
+        auto size = extended ? tarNumber(header.size, sizeof(header.size)) : paxSize.value_or(tarNumber(header.size, sizeof(header.size)));
+        auto dataOffset = offset + tarBlockSize;
+        // Sizes come from base-256 fields and pax records and can be anything up to 2^64, so no sums before this
+        if (size > file.size() - dataOffset)
+            return warn(path, "truncated");
+
+        switch (header.type) {
+        case 'L':
+        case 'x': {
+            if (size > maxTarExtensionSize)
+                return warn(path, "implausibly large extended header");
+            extension.resize(size);
+            if (!file.readAt(extension.data(), extension.size(), dataOffset))
+                return warn(path, "read error");
+            if (header.type == 'L')
+                longName = field(extension.data(), extension.size());
+            else
+                parsePaxHeader(extension, longName, paxSize);
+            break;
+        }
+        case '0':
+        case '7':
+        case '\0': {
+            std::string name {};
+            if (!longName.empty()) {
+                name = std::move(longName);
+            } else {
+                auto prefix = field(header.prefix, sizeof(header.prefix));
+                if (field(header.magic, sizeof(header.magic)) == "ustar" && !prefix.empty())
+                    name.append(prefix).append("/");
+                name.append(field(header.name, sizeof(header.name)));
+            }
+            visit(memberName(name), ArchiveMember { .archive = path, .offset = dataOffset, .storedSize = size, .size = size });
+            break;
+        }
+        default:
+            // Directories, links, devices and pax global headers carry nothing to read
+            break;
+        }
+        if (!extended) {
+            longName.clear();
+            paxSize.reset();
+        }
+
+        // Can't overflow now that the data is known to fit in the file, and always moves forward
+        auto next = dataOffset + (size + tarBlockSize - 1) / tarBlockSize * tarBlockSize;
+        if (next <= offset)
+            return warn(path, fmt::format("bad entry size at offset {}", offset));
+        offset = next;
+    }
+    return true;
+}
+
+// zip
+
+constexpr std::uint32_t zipEndSignature = 0x06054B50;
+constexpr std::uint32_t zip64EndSignature = 0x06064B50;
+constexpr std::uint32_t zip64LocatorSignature = 0x07064B50;
+constexpr std::uint32_t zipCentralSignature = 0x02014B50;
+constexpr std::uint32_t zipLocalSignature = 0x04034B50;
+constexpr std::size_t zipEndSize = 22;
+constexpr std::size_t zip64LocatorSize = 20;
+constexpr std::size_t zip64EndSize = 56;
+constexpr std::size_t zipCentralSize = 46;
+constexpr std::size_t zipLocalSize = 30;
+constexpr std::size_t zipMaxCommentSize = 0xFFFF;
+constexpr std::uint16_t zipStored = 0;
+constexpr std::uint16_t zipDeflated = 8;
+
+struct ZipDirectory {
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+// Finds the central directory through the end record at the back of the file, which may be followed by a comment
+std::optional<ZipDirectory> findZipDirectory(const ArchiveFile& file)
+{
+    if (file.size() < zipEndSize)
+        return std::nullopt;
+    auto tailSize = static_cast<std::size_t>(std::min<std::uint64_t>(file.size(), zipEndSize + zipMaxCommentSize));
+    std::vector<unsigned char> tail(tailSize);
+    auto tailOffset = file.size() - tailSize;
+    if (!file.readAt(tail.data(), tail.size(), tailOffset))
+        return std::nullopt;
+
+    for (auto end = tailSize - zipEndSize + 1; end-- > 0;) {
+        auto* record = tail.data() + end;
+        if (readLittleEndian(record, 4) != zipEndSignature)
+            continue;
+
+        ZipDirectory directory { readLittleEndian(record + 16, 4), readLittleEndian(record + 12, 4) };
+        if (directory.offset != 0xFFFFFFFF && directory.size != 0xFFFFFFFF)
+            return directory;
+
+        // ZIP64: a locator right before the end record points at the 64-bit end record
+        auto endOffset = tailOffset + end;
+        std::array<unsigned char, zip64EndSize> end64 {};
+        std::array<unsigned char, zip64LocatorSize> locator {};
+        if (endOffset < zip64LocatorSize || !file.readAt(locator.data(), locator.size(), endOffset - zip64LocatorSize)
+            || readLittleEndian(locator.data(), 4) != zip64LocatorSignature
+            || !file.readAt(end64.data(), end64.size(), readLittleEndian(locator.data() + 8, 8))
+            || readLittleEndian(end64.data(), 4) != zip64EndSignature)
+            return std::nullopt;
+        return ZipDirectory { readLittleEndian(end64.data() + 48, 8), readLittleEndian(end64.data() + 40, 8) };
+    }
+    return std::nullopt;
+}
+
+bool listZip(const fs::path& path, const ArchiveFile& file, const std::function<void(std::string_view, const ArchiveMember&)>& visit)
+{
+    auto directory = findZipDirectory(file);
+    if (!directory.has_value())
+        return warn(path, "no zip central directory found");
+    // Both can come from ZIP64 fields and be anything up to 2^64, so no sums before this, like in listTar
+    if (directory->offset > file.size() || directory->size > file.size() - directory->offset)
+        return warn(path, "truncated");
+
+    std::vector<unsigned char> entries(directory->size);
+    if (!file.readAt(entries.data(), entries.size(), directory->offset))
+        return warn(path, "read error");
+
+    std::size_t position = 0;
+    while (position + zipCentralSize <= entries.size()) {
+        auto* entry = entries.data() + position;
+        if (readLittleEndian(entry, 4) != zipCentralSignature)
+            return warn(path, "damaged central directory");
+
+        auto flags = readLittleEndian(entry + 8, 2);
+        auto method = readLittleEndian(entry + 10, 2);
+        auto storedSize = readLittleEndian(entry + 20, 4);
+        auto size = readLittleEndian(entry + 24, 4);
+        auto nameLength = readLittleEndian(entry + 28, 2);
+        auto extraLength = readLittleEndian(entry + 30, 2);
+        auto commentLength = readLittleEndian(entry + 32, 2);
+        auto localOffset = readLittleEndian(entry + 42, 4);
+        auto next = position + zipCentralSize + nameLength + extraLength + commentLength;
+        if (next > entries.size())
+            return warn(path, "damaged central directory");
+
+        // Sizes and offset that don't fit 32 bits are in the ZIP64 extra field, in this order
+        auto* extra = entry + zipCentralSize + nameLength;
+        for (std::size_t at = 0; at + 4 <= extraLength;) {
+            auto id = readLittleEndian(extra + at, 2);
+            auto length = readLittleEndian(extra + at + 2, 2);
+            if (at + 4 + length > extraLength)
+                break;
+            if (id == 0x0001) {
+                auto* value = extra + at + 4;
+                auto* valueEnd = value + length;
+                for (auto* field : { &size, &storedSize, &localOffset }) {
+                    if (*field == 0xFFFFFFFF && value + 8 <= valueEnd) {
+                        *field = readLittleEndian(value, 8);
+                        value += 8;
+                    }
+                }
+            }
+            at += 4 + length;
+        }
+
+        std::string_view name { reinterpret_cast<const char*>(entry + zipCentralSize), nameLength };
+        position = next;
+        // Directories, encrypted members and compression methods other than stored and deflated are skipped
+        if (name.ends_with('/') || (flags & 1) != 0 || (method != zipStored && method != zipDeflated))
+            continue;
+
+        // The data starts after the local header, whose name and extra field may differ from the central copy
+        std::array<unsigned char, zipLocalSize> local {};
+        if (file.size() < zipLocalSize || localOffset > file.size() - zipLocalSize || !file.readAt(local.data(), local.size(), localOffset)
+            || readLittleEndian(local.data(), 4) != zipLocalSignature)
+            return warn(path, fmt::format("damaged local header of {}", name));
+        // Can't overflow, the local header is known to lie within the file and its lengths are 16 bits
+        auto dataOffset = localOffset + zipLocalSize + readLittleEndian(local.data() + 26, 2) + readLittleEndian(local.data() + 28, 2);
+        if (dataOffset > file.size() || storedSize > file.size() - dataOffset)
+            return warn(path, "truncated");
+
+        visit(memberName(name), ArchiveMember {
+                                    .archive = path,
+                                    .offset = dataOffset,
+                                    .storedSize = storedSize,
+                                    .size = size,
+                                    .deflated = method == zipDeflated,
+                                });
+    }
+    return true;
+}
+
+}
+
+bool isArchive(const fs::path& path)
+{
+    auto key = extensionKey(path.native());
+    return key == packExtension("tar") || key == packExtension("zip");
+}
+
+bool listArchive(const fs::path& path, const std::function<void(std::string_view, const ArchiveMember&)>& visit)
+{
+    ArchiveFile file { path };
+    if (!file.valid())
+        return warn(path, "can't open");
+    if (extensionKey(path.native()) == packExtension("zip"))
+        return listZip(path, file, visit);
+    return listTar(path, file, visit);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+
+/// @brief Where a file stored in a tar or zip archive lives. Members are read in place, never extracted.
+struct ArchiveMember {
+    std::filesystem::path archive {};
+    /// @brief Offset of the member's (possibly compressed) data in the archive
+    std::uint64_t offset { 0 };
+    /// @brief Bytes of the member in the archive
+    std::uint64_t storedSize { 0 };
+    /// @brief Bytes of the member itself, equal to storedSize unless it is deflated
+    std::uint64_t size { 0 };
+    bool deflated { false };
+};
+
+/// @brief Separates the archive from the member in reported paths, e.g. `shoot.tar!/DCIM/IMG_0001.CR3`
+constexpr std::string_view archiveSeparator = "!/";
+
+/// @brief Whether the extension names an archive listArchive() can read: .tar or .zip, in any letter case.
+/// Compressed tarballs can't be read in place and are not supported.
+[[nodiscard]] bool isArchive(const std::filesystem::path&);
+
+/// @brief Calls `visit` with the name and location of every regular file in `archive`, in archive order.
+/// Tar headers are read one after another, skipping over the member data; zip archives are listed from their
+/// central directory. Returns false after printing a warning if the archive is damaged, members visited up to
+/// that point are still valid.
+bool listArchive(const std::filesystem::path& archive, const std::function<void(std::string_view name, const ArchiveMember&)>& visit);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+/// @brief Blocking multi-producer, multi-consumer FIFO with a fixed capacity.
+/// Producers block while it is full, which keeps memory flat when they outpace the consumers.
+template <typename T>
+class BoundedQueue final {
+public:
+    explicit BoundedQueue(std::size_t capacity)
+        : m_capacity(capacity == 0 ? 1 : capacity)
+    {
+    }
+
+    /// @brief Blocks while the queue is full. Returns false if the queue was closed.
+    bool push(T value)
+    {
+        std::unique_lock lock { m_mutex };
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+            return false;
+
+        m_items.push_back(std::move(value));
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /// @brief Blocks until an item is available. Returns nothing once the queue is closed and drained.
+    std::optional<T> pop()
+    {
+        std::unique_lock lock { m_mutex };
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+            return std::nullopt;
+
+        auto value = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return value;
+    }
+
+    /// @brief Wakes up all waiters. Items already queued can still be popped.
+    void close()
+    {
+        {
+            std::scoped_lock lock { m_mutex };
+            m_closed = true;
+        }
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+private:
+    std::size_t m_capacity;
+    bool m_closed { false };
+    std::deque<T> m_items {};
+    std::mutex m_mutex {};
+    std::condition_variable m_notEmpty {};
+    std::condition_variable m_notFull {};
+};
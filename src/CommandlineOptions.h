@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+#include "GroupStats.h"
+#include "RawSource.h"
+#include "RecordWriter.h"
+#include "Timeline.h"
+
+struct CommandlineOptions {
+    bool silent { false };
+    bool showCamera { true };
+    bool showLens { true };
+    bool showSize { true };
+    bool showTimestamp { true };
+    bool showSoftware { true };
+    bool showCameraType { true };
+    bool showQuality { true };
+    std::size_t jobs { 1 };
+    IoMode ioMode { IoMode::LibRaw };
+    bool sniff { false };
+    bool archives { false };
+    bool fastPath { false };
+    bool verifyFastPath { false };
+    bool exactStats { false };
+    bool keepGoing { false };
+    /// @brief Budget for reading one file, zero for none
+    std::chrono::milliseconds fileTimeout { 0 };
+    bool color { true };
+    OutputFormat outputFormat { OutputFormat::Text };
+    GroupBy groupBy { GroupBy::None };
+    TimelineBucket timeline { TimelineBucket::None };
+    /// @brief Longest gap between two photos of the same --timeline session
+    std::chrono::minutes sessionGap { defaultSessionGap };
+};
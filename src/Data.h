@@ -1,41 +1,249 @@
 #pragma once
 
-#include "macros.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <limits>
+#include <string_view>
 #include <vector>
 
+#include "GroupStats.h"
+#include "InternTable.h"
+#include "PhotoRecord.h"
+#include "Statistics.h"
+#include "Timeline.h"
+#include "macros.h"
+
+/// @brief Earliest and latest photo timestamp seen so far
+struct TimeRange {
+    std::time_t earliest { std::numeric_limits<std::time_t>::max() };
+    std::time_t latest { std::numeric_limits<std::time_t>::min() };
+
+    void add(std::time_t timestamp)
+    {
+        earliest = std::min(earliest, timestamp);
+        latest = std::max(latest, timestamp);
+    }
+
+    void merge(const TimeRange& other)
+    {
+        earliest = std::min(earliest, other.earliest);
+        latest = std::max(latest, other.latest);
+    }
+};
+
+/// @brief Photo counts per interned key, kept in a dense array indexed by the key's id
+struct KeyCounts {
+    InternTable keys {};
+    std::vector<std::size_t> counts {};
+
+    InternTable::Id add(std::string_view first, std::string_view second, std::uint64_t number = 0, std::size_t count = 1)
+    {
+        auto id = keys.intern(first, second, number);
+        if (id == counts.size())
+            counts.push_back(0);
+        counts[id] += count;
+        return id;
+    }
+
+    /// @brief Returns the id each of the other instance's keys has in this one
+    std::vector<InternTable::Id> merge(const KeyCounts& other)
+    {
+        std::vector<InternTable::Id> ids(other.keys.size());
+        for (InternTable::Id id = 0; id < other.keys.size(); ++id) {
+            auto& key = other.keys.key(id);
+            ids[id] = add(key.first, key.second, key.number, other.counts[id]);
+        }
+        return ids;
+    }
+
+    [[nodiscard]] bool empty() const { return keys.empty(); }
+
+    void save(ByteWriter& writer) const
+    {
+        writer.write(static_cast<std::uint64_t>(keys.size()));
+        for (InternTable::Id id = 0; id < keys.size(); ++id) {
+            auto& key = keys.key(id);
+            writer.writeString(key.first);
+            writer.writeString(key.second);
+            writer.write(key.number);
+            writer.write(static_cast<std::uint64_t>(counts[id]));
+        }
+    }
+
+    /// @brief Loads into an empty instance, keeping the saved ids
+    void load(ByteReader& reader)
+    {
+        auto size = reader.read<std::uint64_t>();
+        for (std::uint64_t id = 0; id < size && !reader.failed(); ++id) {
+            auto first = reader.readString();
+            auto second = reader.readString();
+            auto number = reader.read<std::uint64_t>();
+            auto count = reader.read<std::uint64_t>();
+            if (add(first, second, number, count) != keys.size() - 1)
+                reader.fail();
+        }
+    }
+};
+
+/// @brief What the statistics keep of a photo, with its camera and lens interned into (make, model) and
+/// (lens make, lens, LensID) tables kept alongside. A fraction of the size of a PhotoRecord, for callers that keep
+/// every photo around to rebuild statistics from.
+struct PhotoSample {
+    std::time_t timestamp;
+    float iso_speed;
+    float shutter;
+    float focal_len;
+    float aperture;
+    float resolution;
+    InternTable::Id camera;
+    InternTable::Id lens;
+
+    [[nodiscard]] static PhotoSample from(const PhotoRecord& record, InternTable::Id camera, InternTable::Id lens)
+    {
+        return PhotoSample {
+            .timestamp = record.timestamp,
+            .iso_speed = record.iso_speed,
+            .shutter = record.shutter,
+            .focal_len = record.focal_len,
+            .aperture = record.aperture,
+            .resolution = static_cast<float>(record.width * record.height),
+            .camera = camera,
+            .lens = lens,
+        };
+    }
+};
+
 struct Data {
-    std::vector<std::time_t> timestamps {};
-    std::vector<float> iso_speeds {};
-    std::vector<float> shutter_speeds {};
-    std::vector<float> focal_lengths {};
-    std::vector<float> aperture_values {};
-    std::vector<float> resolutions {};
-    std::map<std::string, std::size_t> lenses {};
-    std::map<std::string, std::size_t> cameras {};
-
-    /// @brief Reserves the capacity for all vectors (not for lens and camera maps)
-    void reserveCapacity(std::size_t capacity)
-    {
-        timestamps.reserve(capacity);
-        iso_speeds.reserve(capacity);
-        shutter_speeds.reserve(capacity);
-        focal_lengths.reserve(capacity);
-        aperture_values.reserve(capacity);
-        resolutions.reserve(capacity);
+    TimeRange timestamps {};
+    StreamingStats iso_speeds;
+    StreamingStats shutter_speeds;
+    StreamingStats focal_lengths;
+    StreamingStats aperture_values;
+    StreamingStats resolutions;
+    /// @brief Keyed by (lens make, lens, LensID), names are only formatted for the summary
+    KeyCounts lenses {};
+    /// @brief Keyed by (make, model)
+    KeyCounts cameras {};
+    /// @brief Per-camera and/or per-lens metrics for --group-by
+    GroupStats groups;
+    /// @brief Per-period statistics and shooting sessions for --timeline
+    Timeline timeline;
+
+    /// @param exactStats Keep every sample for exact quantiles instead of sketching them
+    explicit Data(bool exactStats = false, GroupBy groupBy = GroupBy::None, TimelineBucket timelineBucket = TimelineBucket::None,
+        std::chrono::minutes sessionGap = defaultSessionGap)
+        : iso_speeds(exactStats)
+        , shutter_speeds(exactStats)
+        , focal_lengths(exactStats)
+        , aperture_values(exactStats)
+        , resolutions(exactStats)
+        , groups(groupBy, exactStats)
+        , timeline(timelineBucket, sessionGap)
+    {
+    }
+
+    /// @brief Adds one photo to every statistic, count and group
+    void add(const PhotoRecord& record)
+    {
+        auto lens = lenses.add(record.lens_make, record.lens, record.lens_id);
+        auto camera = cameras.add(record.make, record.model);
+        addSample(PhotoSample::from(record, camera, lens));
+    }
+
+    /// @brief Adds one photo whose camera and lens ids refer to `cameraKeys` and `lensKeys`
+    void add(const PhotoSample& sample, const InternTable& cameraKeys, const InternTable& lensKeys)
+    {
+        const auto& lensKey = lensKeys.key(sample.lens);
+        const auto& cameraKey = cameraKeys.key(sample.camera);
+        auto local = sample;
+        local.lens = lenses.add(lensKey.first, lensKey.second, lensKey.number);
+        local.camera = cameras.add(cameraKey.first, cameraKey.second);
+        addSample(local);
+    }
+
+    /// @brief Adds a photo already counted in `cameras` and `lenses` to every statistic and group
+    void addSample(const PhotoSample& sample)
+    {
+        timestamps.add(sample.timestamp);
+        iso_speeds.add(sample.iso_speed);
+        shutter_speeds.add(sample.shutter);
+        focal_lengths.add(sample.focal_len);
+        aperture_values.add(sample.aperture);
+        resolutions.add(sample.resolution);
+        if (groups.enabled())
+            groups.group(sample.camera, sample.lens).add(sample.iso_speed, sample.shutter, sample.focal_len, sample.aperture, sample.resolution);
+        if (timeline.enabled())
+            timeline.add(sample.timestamp, sample.camera, sample.lens, sample.iso_speed);
+    }
+
+    /// @brief Adds all samples and all lens and camera counts of another (per-thread) instance
+    void merge(const Data& other)
+    {
+        timestamps.merge(other.timestamps);
+        iso_speeds.merge(other.iso_speeds);
+        shutter_speeds.merge(other.shutter_speeds);
+        focal_lengths.merge(other.focal_lengths);
+        aperture_values.merge(other.aperture_values);
+        resolutions.merge(other.resolutions);
+        auto lensIds = lenses.merge(other.lenses);
+        auto cameraIds = cameras.merge(other.cameras);
+        groups.merge(other.groups, cameraIds, lensIds);
+        timeline.merge(other.timeline, cameraIds, lensIds);
+    }
+
+    [[nodiscard]] std::size_t photoCount() const { return iso_speeds.count(); }
+
+    /// @brief Writes all statistics, counts and groups, see PartialSummary
+    void save(ByteWriter& writer) const
+    {
+        writer.write(static_cast<std::int64_t>(timestamps.earliest));
+        writer.write(static_cast<std::int64_t>(timestamps.latest));
+        iso_speeds.save(writer);
+        shutter_speeds.save(writer);
+        focal_lengths.save(writer);
+        aperture_values.save(writer);
+        resolutions.save(writer);
+        lenses.save(writer);
+        cameras.save(writer);
+        groups.save(writer);
+        timeline.save(writer);
+    }
+
+    /// @brief Loads into a freshly constructed instance with the saved exactness and grouping, the timeline
+    /// settings are part of the saved data
+    void load(ByteReader& reader)
+    {
+        timestamps.earliest = static_cast<std::time_t>(reader.read<std::int64_t>());
+        timestamps.latest = static_cast<std::time_t>(reader.read<std::int64_t>());
+        iso_speeds.load(reader);
+        shutter_speeds.load(reader);
+        focal_lengths.load(reader);
+        aperture_values.load(reader);
+        resolutions.load(reader);
+        lenses.load(reader);
+        cameras.load(reader);
+        // Group ids index the tables loaded just before
+        groups.load(reader, cameras.keys.size(), lenses.keys.size());
+        timeline.load(reader);
+
+        for (auto& [key, period] : timeline.periods()) {
+            if (std::ranges::any_of(period.cameras, [&](auto id) { return id >= cameras.keys.size(); })
+                || std::ranges::any_of(period.lenses, [&](auto id) { return id >= lenses.keys.size(); }))
+                reader.fail();
+        }
     }
 
     void assertEqualSizes() const
     {
-        ASSERT(iso_speeds.size() == timestamps.size());
-        ASSERT(iso_speeds.size() == shutter_speeds.size());
-        ASSERT(iso_speeds.size() == focal_lengths.size());
-        ASSERT(iso_speeds.size() == aperture_values.size());
-        ASSERT(iso_speeds.size() == resolutions.size());
+        ASSERT(iso_speeds.count() == shutter_speeds.count());
+        ASSERT(iso_speeds.count() == focal_lengths.count());
+        ASSERT(iso_speeds.count() == aperture_values.count());
+        ASSERT(iso_speeds.count() == resolutions.count());
     }
 
     void assertNotEmpty() const
     {
-        ASSERT(!timestamps.empty());
         ASSERT(!iso_speeds.empty());
         ASSERT(!shutter_speeds.empty());
         ASSERT(!focal_lengths.empty());
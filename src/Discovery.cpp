@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fmt/color.h>
+
+#include "Discovery.h"
+#include "RawFormat.h"
+#include "macros.h"
+
+namespace fs = std::filesystem;
+
+using fmt::print, fmt::fg, fmt::color;
+
+// Plain TIFF images share the header of most raw formats, sniffing alone can't tell them apart
+static constexpr std::array plainTiffExtensions { packExtension("tif"), packExtension("tiff") };
+
+bool isRawFile(const fs::path& path, bool sniff)
+{
+    if (rawFormatFromFilename(path.native()) != RawFormat::Unknown)
+        return true;
+    if (!sniff || std::ranges::find(plainTiffExtensions, extensionKey(path.native())) != plainTiffExtensions.end())
+        return false;
+    return sniffRawFormat(path) != RawFormat::Unknown;
+}
+
+namespace {
+
+/// @brief State shared by all directory tasks of one findRawFiles call
+struct Walk {
+    ThreadPool& pool;
+    BoundedQueue<RawFile>& queue;
+    std::atomic<std::size_t> nextIndex { 0 };
+    const DiscoveryOptions& options;
+    std::vector<Profiler>* profilers;
+
+    void push(fs::path path, std::optional<ArchiveMember> member = std::nullopt)
+    {
+        auto discovered = profilers != nullptr ? ProfileClock::now() : ProfileClock::time_point {};
+        queue.push({ nextIndex++, std::move(path), discovered, std::move(member) });
+    }
+};
+
+}
+
+static void walkArchive(Walk& walk, const fs::path& archive)
+{
+    listArchive(archive, [&](std::string_view name, const ArchiveMember& member) {
+        // Members are only recognized by name, sniffing them would cost a read per member
+        auto filename = name.substr(name.rfind('/') + 1);
+        if (filename.starts_with('.') || rawFormatFromFilename(filename) == RawFormat::Unknown)
+            return;
+        std::string path { archive.native() };
+        path.append(archiveSeparator).append(name);
+        walk.push(std::move(path), member);
+    });
+}
+
+static void walkDirectory(Walk& walk, std::size_t worker, const fs::path& directory)
+{
+    auto start = walk.profilers != nullptr ? ProfileClock::now() : ProfileClock::time_point {};
+    std::error_code error {};
+    fs::directory_iterator iterator { directory, error };
+    if (error) {
+        print(stderr, fg(color::yellow), "Skipping directory {}: {}\n", directory.string(), error.message());
+        return;
+    }
+
+    // The range-for would advance with the throwing operator++, and a throw here would end the process
+    for (fs::directory_iterator end; iterator != end; iterator.increment(error)) {
+        if (error) {
+            print(stderr, fg(color::yellow), "Skipping rest of directory {}: {}\n", directory.string(), error.message());
+            break;
+        }
+        const auto& entry = *iterator;
+        if (entry.is_directory(error) && !entry.is_symlink(error)) {
+            // One task per directory, idle discovery workers steal subtrees from busy ones
+            walk.pool.submit([&walk, subdirectory = entry.path()](std::size_t worker) {
+                walkDirectory(walk, worker, subdirectory);
+            });
+            continue;
+        }
+        if (!entry.is_regular_file(error))
+            continue;
+
+        const auto& path = entry.path();
+        // A view of the last component, filename() would build a new path for every entry
+        std::string_view filename { path.native() };
+        filename.remove_prefix(filename.rfind('/') + 1);
+        if (filename.starts_with('.'))
+            continue;
+        if (walk.options.archives && isArchive(path)) {
+            walk.pool.submit([&walk, archive = path](std::size_t) { walkArchive(walk, archive); });
+            continue;
+        }
+        if (isRawFile(path, walk.options.sniff))
+            walk.push(path);
+    }
+
+    // Includes time blocked on a full queue, which is what a slow consumer looks like from here
+    if (walk.profilers != nullptr)
+        (*walk.profilers)[worker].addDirectory(ProfileClock::now() - start);
+}
+
+void findRawFiles(ThreadPool& pool, BoundedQueue<RawFile>& queue, const std::vector<std::string>& directories, const std::vector<std::string>& files,
+    const DiscoveryOptions& options, std::vector<Profiler>* profilers)
+{
+    ASSERT(profilers == nullptr || profilers->size() == pool.size());
+    Walk walk { .pool = pool, .queue = queue, .options = options, .profilers = profilers };
+    for (auto& file : files) {
+        if (file.empty())
+            continue;
+        if (options.archives && isArchive(file))
+            pool.submit([&walk, archive = fs::path { file }](std::size_t) { walkArchive(walk, archive); });
+        else
+            walk.push(file);
+    }
+    for (auto& directory : directories) {
+        pool.submit([&walk, directory = fs::path { directory }](std::size_t worker) {
+            walkDirectory(walk, worker, directory);
+        });
+    }
+    pool.wait();
+    queue.close();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Archive.h"
+#include "BoundedQueue.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+/// @brief A discovered raw file, numbered in the order it was found
+struct RawFile {
+    std::size_t index {};
+    std::filesystem::path path {};
+    /// @brief When the file was queued, left empty by callers that don't profile
+    ProfileClock::time_point discovered {};
+    /// @brief Set for files inside an archive, `path` is then `archive!/member` and only used for reporting
+    std::optional<ArchiveMember> member {};
+};
+
+struct DiscoveryOptions {
+    /// @brief Also pick up raw files with unknown extensions by their contents, see isRawFile
+    bool sniff { false };
+    /// @brief Descend into .tar and .zip archives and queue the raw files inside them
+    bool archives { false };
+};
+
+// Upper bound on discovered files waiting for extraction
+constexpr std::size_t discoveryQueueCapacity = 4096;
+
+/// @brief Whether the extension names a raw format (case-insensitive). With `sniff`, files with any other name
+/// are classified by their first bytes instead, which costs one small read each.
+[[nodiscard]] bool isRawFile(const std::filesystem::path&, bool sniff = false);
+
+/// @brief Streams raw files from `directories` (recursively) and `files` into `queue`, then closes it.
+/// Directories are walked in parallel on `pool` while consumers already work on the first files.
+/// @param profilers If set, one per pool worker, receives the time spent listing each directory
+void findRawFiles(ThreadPool& pool, BoundedQueue<RawFile>& queue, const std::vector<std::string>& directories, const std::vector<std::string>& files,
+    const DiscoveryOptions& options = {}, std::vector<Profiler>* profilers = nullptr);
@@ -0,0 +1,449 @@
+#include <cstring>
+#include <mutex>
+
+#include "Extractor.h"
+#include "FormatUtils.h"
+#include "RawSource.h"
+#include "TiffParser.h"
+#include "TimeUtils.h"
+
+namespace fs = std::filesystem;
+
+using fmt::print, fmt::fg, fmt::bg, fmt::color;
+
+// Serializes diagnostics on stderr when multiple workers are running
+static std::mutex outputMutex {};
+
+void printFileHeader(OutputBuffer& out, const fs::path& path)
+{
+    out.print(bg(color::dark_slate_gray) | fg(color::white), "Metadata for image ");
+    // A view of the last component, filename() would build a new path
+    std::string_view name { path.native() };
+    name.remove_prefix(name.rfind('/') + 1);
+    out.print(bg(color::dark_slate_gray) | fg(color::light_green), "{}", name);
+    out.print(bg(color::dark_slate_gray) | fg(color::white), ":");
+    out.print("\n");
+}
+
+void printMetadata(OutputBuffer& out, const PhotoRecord& record, const CommandlineOptions& options)
+{
+    if (options.showCamera) {
+        out.print(fg(color::cyan), "\tCamera: ");
+        out.print("{} {} ", record.make, record.model);
+        out.print(fg(color::gray), "@");
+        out.print(" ISO {} {}\n", record.iso_speed, Formatted { FormatUtils::appendShutterSpeed, record.shutter });
+
+        if (!record.body_serial.empty()) {
+            out.print(fg(color::cyan), "\t\tBody serial: ");
+            out.print("{}\n", record.body_serial);
+        }
+    }
+
+    if (options.showLens) {
+        out.print(fg(color::cyan), "\tLens: ");
+        FormatUtils::appendLens(out.appender(), record.lens_make, record.lens);
+        out.print(" (id={}) ", record.lens_id);
+        out.print(fg(color::gray), "@");
+        out.print(" {}mm {}\n", record.focal_len, Formatted { FormatUtils::appendAperture, record.aperture });
+
+        if (!record.lens_serial.empty()) {
+            out.print(fg(color::cyan), "\t\tLens serial: ");
+            out.print("{}\n", record.lens_serial);
+        }
+    }
+
+    if (options.showSize) {
+        out.print(fg(color::cyan), "\tSize: ");
+        out.print("{} {}x{} ", Formatted { FormatUtils::appendResolution, static_cast<unsigned int>(record.width * record.height) }, record.width, record.height);
+        out.print(fg(color::gray), "(raw: {}x{})\n", record.raw_width, record.raw_height);
+    }
+
+    if (options.showTimestamp) {
+        out.print(fg(color::cyan), "\tTimestamp: ");
+        TimeUtils::appendISO8601(out.appender(), record.timestamp);
+        out.print(fg(color::gray), " ({})\n", Formatted { TimeUtils::appendTimeSince, record.timestamp });
+    }
+
+    if (options.showSoftware && !record.software.empty()) {
+        out.print(fg(color::cyan), "\tSoftware: ");
+        out.print("{}\n", record.software);
+    }
+
+    switch (record.maker_index) {
+    case LIBRAW_CAMERAMAKER_Sony: {
+        if (options.showCameraType) {
+            out.print(fg(color::cyan), "\tCamera type: ");
+            switch (record.camera_type) {
+            case LIBRAW_SONY_DSC:
+                out.print("Sony DSC point-and-shoot\n");
+                break;
+            case LIBRAW_SONY_DSLR:
+                out.print("Sony DSLR\n");
+                break;
+            case LIBRAW_SONY_NEX:
+                out.print("Sony NEX mirrorless\n");
+                break;
+            case LIBRAW_SONY_SLT:
+                out.print("Sony SLT DSLT\n");
+                break;
+            case LIBRAW_SONY_ILCE:
+                out.print("Sony ILCE E-mount mirrorless\n");
+                break;
+            case LIBRAW_SONY_ILCA:
+                out.print("Sony ILCA A-mount DSLT\n");
+                break;
+            default:
+                out.print("Unknown type ({})\n", record.camera_type);
+                break;
+            }
+        }
+
+        if (options.showQuality) {
+            out.print(fg(color::cyan), "\tQuality: ");
+            switch (record.quality) {
+            case 0:
+            case 6:
+                out.print("(Uncompressed) RAW\n");
+                break;
+            case 7:
+            case 8:
+                out.print("Compressed RAW\n");
+                break;
+            default:
+                out.print("Unknown quality ({})\n", record.quality);
+                break;
+            }
+        }
+
+        break;
+    }
+    case LIBRAW_CAMERAMAKER_Canon: {
+        if (options.showQuality) {
+            out.print(fg(color::cyan), "\tQuality: ");
+            switch (record.quality) {
+            case 1:
+                out.print("Economy\n");
+                break;
+            case 2:
+                out.print("Normal\n");
+                break;
+            case 3:
+                out.print("Fine\n");
+                break;
+            case 4:
+                out.print("RAW\n");
+                break;
+            case 5:
+                out.print("Superfine\n");
+                break;
+            case 7:
+                out.print("CRAW\n");
+                break;
+            case 130:
+                out.print("Normal Movie\n");
+                break;
+            case 131:
+                out.print("CRM StandardRaw\n");
+                break;
+            default:
+                out.print("Unknown quality ({})\n", record.quality);
+                break;
+            }
+        }
+
+        break;
+    }
+    default:
+        // Camera type and quality are only decoded from Sony and Canon makernotes
+        break;
+    }
+}
+
+// LibRaw's strings are char arrays that are usually, but not necessarily, null-terminated
+template <std::size_t Size>
+static std::string_view field(const char (&value)[Size])
+{
+    return { value, strnlen(value, Size) };
+}
+
+PhotoRecord readRecord(const LibRaw& raw)
+{
+    // libraw_data_t is several KB, only look at it through references
+    const auto& imgdata = raw.imgdata;
+    const auto& sizes = imgdata.sizes;
+    const auto& meta = imgdata.idata;
+    const auto& other = imgdata.other;
+    const auto& lensInfo = imgdata.lens;
+
+    auto record = PhotoRecord {
+        .timestamp = other.timestamp,
+        .iso_speed = other.iso_speed,
+        .shutter = other.shutter,
+        .aperture = other.aperture,
+        .focal_len = other.focal_len,
+        .width = sizes.width,
+        .height = sizes.height,
+        .raw_width = sizes.raw_width,
+        .raw_height = sizes.raw_height,
+        .maker_index = meta.maker_index,
+        .lens_id = lensInfo.makernotes.LensID,
+        .make = field(meta.make),
+        .model = field(meta.model),
+        .software = field(meta.software),
+        .lens_make = field(lensInfo.LensMake),
+        .lens = field(lensInfo.Lens),
+        .lens_serial = field(lensInfo.LensSerial),
+        .body_serial = field(imgdata.shootinginfo.BodySerial),
+    };
+
+    switch (meta.maker_index) {
+    case LIBRAW_CAMERAMAKER_Sony:
+        record.camera_type = imgdata.makernotes.sony.CameraType;
+        record.quality = imgdata.makernotes.sony.Quality;
+        break;
+    case LIBRAW_CAMERAMAKER_Canon:
+        record.quality = imgdata.makernotes.canon.Quality;
+        break;
+    default:
+        break;
+    }
+
+    return record;
+}
+
+void verifyFastPath(FastPathStats& stats, const fs::path& path, const PhotoRecord& fast, const PhotoRecord& libraw)
+{
+    std::vector<std::string> differences {};
+    auto compare = [&](std::string_view field, const auto& fastValue, const auto& librawValue) {
+        using T = std::decay_t<decltype(fastValue)>;
+        bool equal;
+        if constexpr (std::is_floating_point_v<T>)
+            equal = std::abs(fastValue - librawValue) <= 1e-3f * std::max(std::abs(fastValue), std::abs(librawValue));
+        else
+            equal = fastValue == librawValue;
+        if (!equal)
+            differences.push_back(fmt::format("{}: fast path '{}', libraw '{}'", field, fastValue, librawValue));
+    };
+
+    compare("timestamp", fast.timestamp, libraw.timestamp);
+    compare("iso_speed", fast.iso_speed, libraw.iso_speed);
+    compare("shutter", fast.shutter, libraw.shutter);
+    compare("aperture", fast.aperture, libraw.aperture);
+    compare("focal_len", fast.focal_len, libraw.focal_len);
+    compare("width", fast.width, libraw.width);
+    compare("height", fast.height, libraw.height);
+    compare("raw_width", fast.raw_width, libraw.raw_width);
+    compare("raw_height", fast.raw_height, libraw.raw_height);
+    compare("maker_index", fast.maker_index, libraw.maker_index);
+    compare("camera_type", fast.camera_type, libraw.camera_type);
+    compare("quality", fast.quality, libraw.quality);
+    compare("lens_id", fast.lens_id, libraw.lens_id);
+    compare("make", fast.make, libraw.make);
+    compare("model", fast.model, libraw.model);
+    compare("software", fast.software, libraw.software);
+    compare("lens_make", fast.lens_make, libraw.lens_make);
+    compare("lens", fast.lens, libraw.lens);
+    compare("lens_serial", fast.lens_serial, libraw.lens_serial);
+    compare("body_serial", fast.body_serial, libraw.body_serial);
+
+    ++stats.verified;
+    if (differences.empty())
+        return;
+
+    ++stats.mismatches;
+    std::scoped_lock lock { outputMutex };
+    print(stderr, fg(color::yellow), "Fast path mismatch for {}:\n", path.string());
+    for (auto& difference : differences)
+        print(stderr, "\t{}\n", difference);
+}
+
+std::optional<PhotoRecord> extractRecord(const fs::path& path, const CommandlineOptions& options, const ScanContext& context, LibRaw& raw, StageTimer& timer,
+    ExtractFailure& failure, const ArchiveMember* member)
+{
+    auto* cache = context.cache;
+    auto deadline = options.fileTimeout.count() != 0 ? Deadline::clock::now() + options.fileTimeout : Deadline::max();
+    // Archive members are stat()ed, mapped and checked through their archive
+    const auto& file = member != nullptr ? member->archive : path;
+    std::error_code error {};
+    if (!exists(file, error)) {
+        failure = ExtractFailure { .path = path, .stage = Stage::Open, .code = LIBRAW_IO_ERROR };
+        return std::nullopt;
+    }
+
+    // stat(), page faults on the mapping and the fast path parser can't be cancelled halfway, but once they return,
+    // time they spent stalled on a slow mount counts against the budget like LibRaw's reads do
+    auto expired = [&](Stage stage) {
+        if (deadline == Deadline::max() || Deadline::clock::now() < deadline)
+            return false;
+        failure = ExtractFailure { .path = path, .stage = stage, .code = LIBRAW_CANCELLED_BY_CALLBACK, .timedOut = true };
+        return true;
+    };
+
+    std::optional<PhotoRecord> record {};
+    std::optional<MetadataCache::FileStat> stat {};
+    std::string cacheKey {};
+    if (cache != nullptr) {
+        cacheKey = fs::absolute(path).lexically_normal().string();
+        stat = MetadataCache::statFile(file);
+        timer.lap(Stage::Open);
+        if (expired(Stage::Open))
+            return std::nullopt;
+        if (stat.has_value())
+            record = cache->lookup(cacheKey, *stat);
+        timer.lap(Stage::Extract);
+    }
+    auto cached = record.has_value();
+
+    std::optional<PhotoRecord> fastRecord {};
+    if (!record.has_value() && (options.fastPath || options.verifyFastPath) && TiffParser::supports(path) && (member == nullptr || !member->deflated)) {
+        MappedFile mapping { file };
+        timer.lap(Stage::Open);
+        auto offset = member != nullptr ? member->offset : 0;
+        auto size = member != nullptr ? member->size : mapping.size();
+        if (mapping.valid() && offset + size <= mapping.size())
+            fastRecord = TiffParser::parse(mapping.data() + offset, size);
+        timer.lap(Stage::Extract);
+        if (expired(Stage::Extract))
+            return std::nullopt;
+        if (!options.verifyFastPath)
+            record = fastRecord;
+        else if (!fastRecord.has_value() && context.fastPath != nullptr)
+            ++context.fastPath->declined;
+    }
+
+    if (!record.has_value()) {
+        RawSource source { path, options.ioMode, deadline, member };
+        auto result = source.open(raw);
+        timer.lap(Stage::Open);
+        if (result != LIBRAW_SUCCESS) {
+            raw.recycle();
+            failure = ExtractFailure { .path = path, .stage = Stage::Open, .code = result, .timedOut = source.timedOut() };
+            return std::nullopt;
+        }
+        record = readRecord(raw);
+        // Releases the file and per-file buffers but keeps the instance for the worker's next file,
+        // must happen before `source` goes away since LibRaw may still point into it
+        raw.recycle();
+
+        if (fastRecord.has_value())
+            verifyFastPath(*context.fastPath, path, *fastRecord, *record);
+    }
+    // Also charges closing the file (LibRaw::recycle, munmap) to extraction
+    timer.lap(Stage::Extract);
+
+    if (cache != nullptr && stat.has_value() && !cached)
+        cache->store(cacheKey, *stat, *record);
+
+    return record;
+}
+
+std::optional<MetadataCache::FileStat> filterStat(const fs::path& path, const ArchiveMember* member)
+{
+    auto stat = MetadataCache::statFile(member != nullptr ? member->archive : path);
+    if (stat.has_value() && member != nullptr)
+        stat->size = member->size;
+    return stat;
+}
+
+void reportFailure(const ScanContext& context, const ExtractFailure& failure, const CommandlineOptions& options)
+{
+    if (context.failures == nullptr)
+        PANIC(fmt::format("{} (use --keep-going to skip files that can't be read)", FailureReport::describe(failure, options.fileTimeout)));
+    context.failures->add(failure);
+}
+
+bool matchFile(const RawFile& file, const ScanContext& context)
+{
+    const auto* filter = context.filter;
+    if (filter == nullptr)
+        return true;
+    auto stat = filter->usesStat() ? filterStat(file.path, file.member ? &*file.member : nullptr) : std::nullopt;
+    return filter->evaluate(FilterInput { file.path.native(), stat ? &*stat : nullptr }) != false;
+}
+
+std::optional<PhotoRecord> scanFile(const RawFile& file, const CommandlineOptions& options, const ScanContext& context, LibRaw& raw, StageTimer& timer)
+{
+    const auto& path = file.path;
+    const auto* member = file.member ? &*file.member : nullptr;
+
+    // Conditions on the path, size or modification time are checked before the file is opened
+    const auto* filter = context.filter;
+    std::optional<MetadataCache::FileStat> stat {};
+    if (filter != nullptr) {
+        if (filter->usesStat())
+            stat = filterStat(path, member);
+        if (filter->evaluate(FilterInput { path.native(), stat ? &*stat : nullptr }) == false)
+            return std::nullopt;
+    }
+
+    ExtractFailure failure {};
+    auto record = extractRecord(path, options, context, raw, timer, failure, member);
+    if (!record.has_value()) {
+        reportFailure(context, failure, options);
+        return std::nullopt;
+    }
+    if (filter != nullptr && filter->usesRecord() && filter->evaluate(FilterInput { path.native(), stat ? &*stat : nullptr, &*record }) != true)
+        return std::nullopt;
+    return record;
+}
+
+void emitRecord(const RawFile& file, const PhotoRecord* record, const CommandlineOptions& options, const ScanContext& context, StageTimer& timer)
+{
+    const auto& path = file.path;
+    if (record == nullptr) {
+        // Every index has to reach the ordered writer, or the blocks after it would be held back forever
+        auto ordered = options.outputFormat != OutputFormat::Binary && (options.outputFormat != OutputFormat::Text || !options.silent);
+        if (ordered)
+            context.output->submit(file.index, OutputBuffer { options.color });
+        return;
+    }
+
+    switch (options.outputFormat) {
+    case OutputFormat::Text:
+        if (!options.silent) {
+            OutputBuffer block { options.color };
+            printFileHeader(block, path);
+            printMetadata(block, *record, options);
+            timer.lap(Stage::Format);
+            context.output->submit(file.index, std::move(block));
+        }
+        break;
+    case OutputFormat::JsonLines: {
+        OutputBuffer block { false };
+        RecordWriter::writeJson(block, path, *record);
+        timer.lap(Stage::Format);
+        context.output->submit(file.index, std::move(block));
+        break;
+    }
+    case OutputFormat::Csv: {
+        OutputBuffer block { false };
+        RecordWriter::writeCsv(block, path, *record);
+        timer.lap(Stage::Format);
+        context.output->submit(file.index, std::move(block));
+        break;
+    }
+    case OutputFormat::Binary:
+        context.columns->add(file.index, path, *record);
+        timer.lap(Stage::Format);
+        break;
+    }
+    timer.lap(Stage::Output);
+}
+
+void populateArrays(Data* data, const RawFile& file, const CommandlineOptions& options, const ScanContext& context, LibRaw& raw, Profiler* profiler)
+{
+    StageTimes times {};
+    StageTimer timer { profiler != nullptr ? &times : nullptr };
+    if (profiler != nullptr && file.discovered != ProfileClock::time_point {})
+        times[static_cast<std::size_t>(Stage::Queue)] = timer.start() - file.discovered;
+
+    auto record = scanFile(file, options, context, raw, timer);
+    if (record.has_value()) {
+        data->add(*record);
+        timer.lap(Stage::Aggregate);
+    }
+    emitRecord(file, record ? &*record : nullptr, options, context, timer);
+
+    if (profiler != nullptr && record.has_value())
+        profiler->addFile(file.path, times);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <libraw/libraw.h>
+#include <optional>
+
+#include "CommandlineOptions.h"
+#include "Data.h"
+#include "Discovery.h"
+#include "FailureReport.h"
+#include "Filter.h"
+#include "MetadataCache.h"
+#include "Output.h"
+#include "PhotoRecord.h"
+#include "Profiler.h"
+#include "RecordWriter.h"
+
+/// @brief Files checked and files mismatching in --verify-fastpath mode
+struct FastPathStats {
+    std::atomic<std::size_t> verified { 0 };
+    std::atomic<std::size_t> mismatches { 0 };
+    /// @brief Files the fast path left to LibRaw, so there was nothing to compare
+    std::atomic<std::size_t> declined { 0 };
+};
+
+/// @brief Objects shared by all workers for the duration of a scan
+struct ScanContext {
+    MetadataCache* cache { nullptr };
+    OrderedOutput* output { nullptr };
+    ColumnarWriter* columns { nullptr };
+    FastPathStats* fastPath { nullptr };
+    /// @brief With --keep-going, collects the files that can't be read; without, the first one aborts the scan
+    FailureReport* failures { nullptr };
+    /// @brief --where: files it rules out are neither printed nor counted
+    const Filter* filter { nullptr };
+};
+
+void printFileHeader(OutputBuffer&, const std::filesystem::path&);
+void printMetadata(OutputBuffer&, const PhotoRecord&, const CommandlineOptions&);
+
+[[nodiscard]] PhotoRecord readRecord(const LibRaw&);
+
+/// @brief Reports every field where the TIFF fast path disagrees with LibRaw
+void verifyFastPath(FastPathStats&, const std::filesystem::path&, const PhotoRecord& fast, const PhotoRecord& libraw);
+
+/// @brief Reads the metadata of one file from the cache, the TIFF fast path or LibRaw, charging the time to `timer`.
+/// Returns nothing and fills in `failure` if the file is missing, LibRaw rejects it or it exceeds --file-timeout.
+/// @param member Where the file is stored if it is inside an archive
+[[nodiscard]] std::optional<PhotoRecord> extractRecord(const std::filesystem::path&, const CommandlineOptions&, const ScanContext&, LibRaw&, StageTimer& timer,
+    ExtractFailure& failure, const ArchiveMember* member = nullptr);
+
+/// @brief Size and modification time --where compares against. Archive members have their own size but the
+/// archive's modification time. Nothing if the file can't be stat()ed.
+[[nodiscard]] std::optional<MetadataCache::FileStat> filterStat(const std::filesystem::path&, const ArchiveMember* member = nullptr);
+
+/// @brief Adds `failure` to the context's report, or aborts with it if there is none
+void reportFailure(const ScanContext&, const ExtractFailure&, const CommandlineOptions&);
+
+/// @brief Applies the conditions of --where that only need the path and stat() of `file`, without reading it.
+/// True if there is no filter or those conditions can't rule the file out.
+[[nodiscard]] bool matchFile(const RawFile&, const ScanContext&);
+
+/// @brief Extracts the metadata of one file and applies --where. Files the filter can rule out by their path and
+/// stat() alone are skipped without being read. Returns nothing if the filter rules the file out or it fails,
+/// failures are reported to the context.
+[[nodiscard]] std::optional<PhotoRecord> scanFile(const RawFile&, const CommandlineOptions&, const ScanContext&, LibRaw&, StageTimer& timer);
+
+/// @brief Emits a file's record in the configured output format, or an empty block for a skipped file (null
+/// `record`) so the ordered writer can move past it
+void emitRecord(const RawFile&, const PhotoRecord* record, const CommandlineOptions&, const ScanContext&, StageTimer& timer);
+
+/// @brief scanFile(), adding the record to `data`, and emitRecord() for one file on the calling thread
+/// @param raw The calling worker's LibRaw instance, recycled after every file instead of constructing one per file
+/// @param profiler The calling worker's profiler, if --profile is set
+void populateArrays(Data* data, const RawFile& file, const CommandlineOptions& options, const ScanContext& context, LibRaw& raw, Profiler* profiler = nullptr);
@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <libraw/libraw.h>
+
+#include "FailureReport.h"
+
+using fmt::fg, fmt::color;
+
+void FailureReport::add(ExtractFailure failure)
+{
+    std::scoped_lock lock { m_mutex };
+    m_failures.push_back(std::move(failure));
+}
+
+std::size_t FailureReport::size() const
+{
+    std::scoped_lock lock { m_mutex };
+    return m_failures.size();
+}
+
+void FailureReport::clear()
+{
+    std::scoped_lock lock { m_mutex };
+    m_failures.clear();
+}
+
+std::string FailureReport::describe(const ExtractFailure& failure, std::chrono::milliseconds fileTimeout)
+{
+    if (failure.timedOut)
+        return fmt::format("{} ({}): exceeded the time budget of {} ms", failure.path.native(), stageName(failure.stage), fileTimeout.count());
+    return fmt::format("{} ({}): {} ({})", failure.path.native(), stageName(failure.stage), libraw_strerror(failure.code), failure.code);
+}
+
+void FailureReport::print(OutputBuffer& out, std::chrono::milliseconds fileTimeout) const
+{
+    std::scoped_lock lock { m_mutex };
+    if (m_failures.empty())
+        return;
+
+    auto failures = m_failures;
+    std::ranges::sort(failures, {}, &ExtractFailure::path);
+    out.print(fg(color::red), "{} {} could not be read:\n", failures.size(), failures.size() == 1 ? "file" : "files");
+    for (const auto& failure : failures) {
+        out.print("\t{}\n", describe(failure, fileTimeout));
+    }
+}
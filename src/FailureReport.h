@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Output.h"
+#include "Profiler.h"
+
+/// @brief A file whose metadata could not be read
+struct ExtractFailure {
+    std::filesystem::path path {};
+    /// @brief Stage the file failed in, Open for missing files and everything LibRaw rejects
+    Stage stage { Stage::Open };
+    /// @brief LibRaw error code (LIBRAW_*)
+    int code { 0 };
+    /// @brief Set when the file was cancelled by --file-timeout, `code` is LIBRAW_CANCELLED_BY_CALLBACK then
+    bool timedOut { false };
+};
+
+/// @brief --keep-going: collects the files that failed instead of aborting the scan on the first one
+class FailureReport final {
+public:
+    /// @brief Thread-safe
+    void add(ExtractFailure);
+
+    [[nodiscard]] std::size_t size() const;
+
+    void clear();
+
+    /// @brief Lists all failures, sorted by path
+    void print(OutputBuffer&, std::chrono::milliseconds fileTimeout) const;
+
+    /// @brief One line describing `failure`, without a trailing newline
+    [[nodiscard]] static std::string describe(const ExtractFailure&, std::chrono::milliseconds fileTimeout);
+
+private:
+    mutable std::mutex m_mutex {};
+    std::vector<ExtractFailure> m_failures {};
+};
@@ -0,0 +1,571 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fmt/color.h>
+
+#include "Filter.h"
+#include "macros.h"
+
+using fmt::print, fmt::fg, fmt::color;
+using Field = Filter::Field;
+using Comparison = Filter::Comparison;
+
+// Deepest the evaluation stack may grow
+static constexpr std::size_t maxStackDepth = 64;
+// Every nesting level holds back at most the left operands of one `or` and one `and` on the stack
+static constexpr std::size_t maxNesting = (maxStackDepth - 1) / 2;
+
+enum class FieldKind : std::uint8_t {
+    /// @brief Equal within 0.1%, metadata values are rounded differently by every camera
+    Real,
+    Integer,
+    /// @brief Dates like 2024-05-01 or 2024-05-01T18:30, in local time, or seconds since the epoch
+    Time,
+    Text,
+};
+
+struct FieldInfo {
+    std::string_view name;
+    Field field;
+    FieldKind kind;
+};
+
+// In the order of Field, so a field's kind is a lookup
+static constexpr std::array fields {
+    FieldInfo { "iso", Field::Iso, FieldKind::Real },
+    FieldInfo { "shutter", Field::Shutter, FieldKind::Real },
+    FieldInfo { "aperture", Field::Aperture, FieldKind::Real },
+    FieldInfo { "focal", Field::Focal, FieldKind::Real },
+    FieldInfo { "width", Field::Width, FieldKind::Integer },
+    FieldInfo { "height", Field::Height, FieldKind::Integer },
+    FieldInfo { "resolution", Field::Resolution, FieldKind::Real },
+    FieldInfo { "lensid", Field::LensId, FieldKind::Integer },
+    FieldInfo { "timestamp", Field::Timestamp, FieldKind::Time },
+    FieldInfo { "camera", Field::Camera, FieldKind::Text },
+    FieldInfo { "make", Field::Make, FieldKind::Text },
+    FieldInfo { "model", Field::Model, FieldKind::Text },
+    FieldInfo { "lens", Field::Lens, FieldKind::Text },
+    FieldInfo { "software", Field::Software, FieldKind::Text },
+    FieldInfo { "path", Field::Path, FieldKind::Text },
+    FieldInfo { "size", Field::Size, FieldKind::Integer },
+    FieldInfo { "mtime", Field::ModificationTime, FieldKind::Time },
+};
+
+static constexpr bool fieldsAreInOrder()
+{
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        if (static_cast<std::size_t>(fields[i].field) != i)
+            return false;
+    }
+    return true;
+}
+static_assert(fieldsAreInOrder(), "fields must list every Field in declaration order");
+
+static FieldKind kindOf(Field field)
+{
+    return fields[static_cast<std::size_t>(field)].kind;
+}
+
+static bool isStatField(Field field)
+{
+    return field == Field::Size || field == Field::ModificationTime;
+}
+
+static bool isRecordField(Field field)
+{
+    return !isStatField(field) && field != Field::Path;
+}
+
+static char fold(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static std::string folded(std::string_view text)
+{
+    std::string result(text.size(), '\0');
+    for (std::size_t i = 0; i < text.size(); ++i)
+        result[i] = fold(text[i]);
+    return result;
+}
+
+// A field's text, made of up to two parts joined with a space (make and model), compared without copying
+struct TextValue {
+    std::string_view first {};
+    std::string_view second {};
+
+    [[nodiscard]] std::size_t size() const { return second.empty() ? first.size() : first.size() + 1 + second.size(); }
+
+    [[nodiscard]] char at(std::size_t index) const
+    {
+        if (index < first.size())
+            return fold(first[index]);
+        return index == first.size() ? ' ' : fold(second[index - first.size() - 1]);
+    }
+
+    [[nodiscard]] bool matchesAt(std::size_t start, std::string_view needle) const
+    {
+        for (std::size_t i = 0; i < needle.size(); ++i) {
+            if (at(start + i) != needle[i])
+                return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool equals(std::string_view needle) const { return size() == needle.size() && matchesAt(0, needle); }
+
+    [[nodiscard]] bool contains(std::string_view needle) const
+    {
+        for (std::size_t start = 0; start + needle.size() <= size(); ++start) {
+            if (matchesAt(start, needle))
+                return true;
+        }
+        return false;
+    }
+};
+
+static std::optional<double> numberOf(Field field, const FilterInput& input)
+{
+    if (isStatField(field)) {
+        if (input.stat == nullptr)
+            return std::nullopt;
+        if (field == Field::Size)
+            return static_cast<double>(input.stat->size);
+        return static_cast<double>(input.stat->mtime_ns) / 1e9;
+    }
+
+    if (input.record == nullptr)
+        return std::nullopt;
+    auto& record = *input.record;
+    switch (field) {
+    case Field::Iso:
+        return record.iso_speed;
+    case Field::Shutter:
+        return record.shutter;
+    case Field::Aperture:
+        return record.aperture;
+    case Field::Focal:
+        return record.focal_len;
+    case Field::Width:
+        return record.width;
+    case Field::Height:
+        return record.height;
+    case Field::Resolution:
+        return record.width * record.height / 1e6;
+    case Field::LensId:
+        return static_cast<double>(record.lens_id);
+    case Field::Timestamp:
+        return static_cast<double>(record.timestamp);
+    default:
+        UNREACHABLE();
+    }
+}
+
+static std::optional<TextValue> textOf(Field field, const FilterInput& input)
+{
+    if (field == Field::Path)
+        return TextValue { input.path };
+    if (input.record == nullptr)
+        return std::nullopt;
+
+    auto& record = *input.record;
+    switch (field) {
+    case Field::Camera:
+        return TextValue { record.make, record.model };
+    case Field::Make:
+        return TextValue { record.make };
+    case Field::Model:
+        return TextValue { record.model };
+    case Field::Lens:
+        return TextValue { record.lens };
+    case Field::Software:
+        return TextValue { record.software };
+    default:
+        UNREACHABLE();
+    }
+}
+
+/// @brief A plain or fractional number (1/250), sizes may carry a binary K, M, G or T suffix
+static std::optional<double> parseNumber(std::string_view text, bool allowSuffix)
+{
+    double multiplier = 1.0;
+    if (allowSuffix && !text.empty()) {
+        auto suffix = std::string_view { "kmgt" }.find(fold(text.back()));
+        if (suffix != std::string_view::npos) {
+            multiplier = std::pow(1024.0, static_cast<double>(suffix + 1));
+            text.remove_suffix(1);
+        }
+    }
+
+    auto parse = [](std::string_view part) -> std::optional<double> {
+        double value {};
+        auto [end, error] = std::from_chars(part.data(), part.data() + part.size(), value);
+        if (error != std::errc {} || end != part.data() + part.size() || part.empty())
+            return std::nullopt;
+        return value;
+    };
+    auto slash = text.find('/');
+    if (slash == std::string_view::npos) {
+        auto value = parse(text);
+        return value.has_value() ? std::optional { *value * multiplier } : std::nullopt;
+    }
+    auto numerator = parse(text.substr(0, slash));
+    auto denominator = parse(text.substr(slash + 1));
+    if (!numerator.has_value() || !denominator.has_value() || *denominator == 0.0)
+        return std::nullopt;
+    return *numerator / *denominator * multiplier;
+}
+
+static std::optional<double> parseTime(const std::string& text)
+{
+    std::tm time {};
+    int consumed = 0;
+    if (std::sscanf(text.c_str(), "%4d-%2d-%2d%n", &time.tm_year, &time.tm_mon, &time.tm_mday, &consumed) != 3)
+        return parseNumber(text, false);
+
+    auto rest = text.c_str() + consumed;
+    if (*rest == 'T') {
+        int length = 0;
+        if (std::sscanf(rest, "T%2d:%2d%n", &time.tm_hour, &time.tm_min, &length) != 2)
+            return std::nullopt;
+        rest += length;
+        if (*rest == ':') {
+            if (std::sscanf(rest, ":%2d%n", &time.tm_sec, &length) != 1)
+                return std::nullopt;
+            rest += length;
+        }
+    }
+    if (*rest != '\0')
+        return std::nullopt;
+
+    time.tm_year -= 1900;
+    time.tm_mon -= 1;
+    time.tm_isdst = -1;
+    auto timestamp = std::mktime(&time);
+    if (timestamp == -1)
+        return std::nullopt;
+    return static_cast<double>(timestamp);
+}
+
+/// @brief Recursive descent over the expression, emitting instructions in postfix order:
+/// or := and ("or" and)*, and := unary ("and" unary)*, unary := "not" unary | "(" or ")" | field op value
+class Filter::Parser final {
+public:
+    Parser(std::string_view text, Filter& filter)
+        : m_text(text)
+        , m_filter(filter)
+    {
+    }
+
+    bool parse()
+    {
+        if (!parseOr())
+            return false;
+        skipSpace();
+        if (m_position != m_text.size())
+            return fail("expected 'and', 'or' or the end of the expression");
+        return true;
+    }
+
+    [[nodiscard]] std::string_view error() const { return m_error; }
+    [[nodiscard]] std::size_t errorPosition() const { return m_errorPosition; }
+
+private:
+    bool parseOr()
+    {
+        if (!parseAnd())
+            return false;
+        while (keyword("or") || symbol("||")) {
+            if (!parseAnd())
+                return false;
+            emit(Opcode::Or);
+        }
+        return true;
+    }
+
+    bool parseAnd()
+    {
+        if (!parseUnary())
+            return false;
+        while (keyword("and") || symbol("&&")) {
+            if (!parseUnary())
+                return false;
+            emit(Opcode::And);
+        }
+        return true;
+    }
+
+    bool parseUnary()
+    {
+        if (++m_depth > maxNesting)
+            return fail("expression nests too deeply");
+        auto parsed = parseUnaryAtDepth();
+        --m_depth;
+        return parsed;
+    }
+
+    bool parseUnaryAtDepth()
+    {
+        if (keyword("not") || symbol("!")) {
+            if (!parseUnary())
+                return false;
+            emit(Opcode::Not);
+            return true;
+        }
+        if (symbol("(")) {
+            if (!parseOr())
+                return false;
+            return symbol(")") || fail("expected ')'");
+        }
+        return parseComparison();
+    }
+
+    bool parseComparison()
+    {
+        skipSpace();
+        auto start = m_position;
+        auto name = folded(word());
+        auto info = std::find_if(ITERATORS(fields), [&](const FieldInfo& field) { return field.name == name; });
+        if (info == fields.end()) {
+            m_position = start;
+            return fail(name.empty() ? "expected a field" : "unknown field, expected iso, shutter, aperture, focal, width, height, resolution, lensid, "
+                                                            "timestamp, camera, make, model, lens, software, path, size or mtime");
+        }
+
+        auto instruction = Instruction { .field = info->field };
+        if (!parseComparisonOperator(instruction.comparison))
+            return fail("expected a comparison: =, !=, <, <=, >, >=, ~ or !~");
+        auto text = info->kind == FieldKind::Text;
+        auto textOperator = instruction.comparison == Comparison::Contains || instruction.comparison == Comparison::NotContains;
+        auto ordering = instruction.comparison != Comparison::Equal && instruction.comparison != Comparison::NotEqual && !textOperator;
+        if (text && ordering)
+            return fail("text can only be compared with =, !=, ~ and !~");
+        if (!text && textOperator)
+            return fail("~ and !~ only apply to text");
+
+        skipSpace();
+        auto valueStart = m_position;
+        auto value = parseValue();
+        if (!value.has_value())
+            return false;
+        if (text) {
+            instruction.text = folded(*value);
+        } else {
+            auto number = info->kind == FieldKind::Time ? parseTime(*value) : parseNumber(*value, info->field == Field::Size);
+            if (!number.has_value()) {
+                m_position = valueStart;
+                return fail(info->kind == FieldKind::Time ? "expected a date like 2024-05-01 or 2024-05-01T18:30" : "expected a number");
+            }
+            instruction.number = *number;
+        }
+
+        m_filter.m_usesStat |= isStatField(info->field);
+        m_filter.m_usesRecord |= isRecordField(info->field);
+        m_filter.m_program.push_back(std::move(instruction));
+        return true;
+    }
+
+    bool parseComparisonOperator(Comparison& comparison)
+    {
+        // Longer operators first, so "<=" is not read as "<"
+        static constexpr std::array<std::pair<std::string_view, Comparison>, 9> operators { {
+            { "==", Comparison::Equal },
+            { "!=", Comparison::NotEqual },
+            { "<=", Comparison::LessEqual },
+            { ">=", Comparison::GreaterEqual },
+            { "!~", Comparison::NotContains },
+            { "=", Comparison::Equal },
+            { "<", Comparison::Less },
+            { ">", Comparison::Greater },
+            { "~", Comparison::Contains },
+        } };
+        for (auto& [text, value] : operators) {
+            if (symbol(text)) {
+                comparison = value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief A quoted string, or everything up to the next space, parenthesis, & or |
+    std::optional<std::string> parseValue()
+    {
+        if (m_position < m_text.size() && (m_text[m_position] == '"' || m_text[m_position] == '\'')) {
+            auto end = m_text.find(m_text[m_position], m_position + 1);
+            if (end == std::string_view::npos) {
+                fail("unterminated string");
+                return std::nullopt;
+            }
+            auto value = m_text.substr(m_position + 1, end - m_position - 1);
+            m_position = end + 1;
+            return std::string { value };
+        }
+
+        auto start = m_position;
+        while (m_position < m_text.size() && std::string_view { " \t()&|" }.find(m_text[m_position]) == std::string_view::npos)
+            ++m_position;
+        if (m_position == start) {
+            fail("expected a value");
+            return std::nullopt;
+        }
+        return std::string { m_text.substr(start, m_position - start) };
+    }
+
+    std::string_view word()
+    {
+        auto start = m_position;
+        while (m_position < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[m_position])) || m_text[m_position] == '_'))
+            ++m_position;
+        return m_text.substr(start, m_position - start);
+    }
+
+    /// @brief Consumes `name` if it is the next whole word, in any letter case
+    bool keyword(std::string_view name)
+    {
+        skipSpace();
+        auto start = m_position;
+        if (folded(word()) == name)
+            return true;
+        m_position = start;
+        return false;
+    }
+
+    bool symbol(std::string_view text)
+    {
+        skipSpace();
+        if (m_text.substr(m_position, text.size()) != text)
+            return false;
+        m_position += text.size();
+        return true;
+    }
+
+    void skipSpace()
+    {
+        while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position])))
+            ++m_position;
+    }
+
+    void emit(Opcode opcode) { m_filter.m_program.push_back(Instruction { .opcode = opcode }); }
+
+    bool fail(std::string_view message)
+    {
+        m_error = message;
+        m_errorPosition = m_position;
+        return false;
+    }
+
+    std::string_view m_text;
+    Filter& m_filter;
+    std::size_t m_position { 0 };
+    std::size_t m_depth { 0 };
+    std::string_view m_error {};
+    std::size_t m_errorPosition { 0 };
+};
+
+std::optional<Filter> Filter::compile(std::string_view expression)
+{
+    Filter filter {};
+    Parser parser { expression, filter };
+    if (!parser.parse()) {
+        print(stderr, fg(color::red), "Invalid --where expression: {}\n", parser.error());
+        print(stderr, "\t{}\n\t{:>{}}\n", expression, "^", parser.errorPosition() + 1);
+        return std::nullopt;
+    }
+
+    // The parser's nesting limit keeps evaluation within the fixed stack
+    std::size_t depth = 0;
+    for (auto& instruction : filter.m_program) {
+        depth += instruction.opcode == Opcode::Compare ? 1 : 0;
+        depth -= instruction.opcode == Opcode::And || instruction.opcode == Opcode::Or ? 1 : 0;
+        ASSERT(depth <= maxStackDepth);
+    }
+    ASSERT(depth == 1);
+    return filter;
+}
+
+std::optional<bool> Filter::compare(const Instruction& instruction, const FilterInput& input)
+{
+    auto comparison = instruction.comparison;
+    auto kind = kindOf(instruction.field);
+    if (kind == FieldKind::Text) {
+        auto text = textOf(instruction.field, input);
+        if (!text.has_value())
+            return std::nullopt;
+        switch (comparison) {
+        case Comparison::Equal:
+            return text->equals(instruction.text);
+        case Comparison::NotEqual:
+            return !text->equals(instruction.text);
+        case Comparison::Contains:
+            return text->contains(instruction.text);
+        case Comparison::NotContains:
+            return !text->contains(instruction.text);
+        default:
+            UNREACHABLE();
+        }
+    }
+
+    auto value = numberOf(instruction.field, input);
+    if (!value.has_value())
+        return std::nullopt;
+    auto operand = instruction.number;
+    auto equal = kind == FieldKind::Real ? std::abs(*value - operand) <= 1e-3 * std::max(std::abs(*value), std::abs(operand)) : *value == operand;
+    switch (comparison) {
+    case Comparison::Equal:
+        return equal;
+    case Comparison::NotEqual:
+        return !equal;
+    case Comparison::Less:
+        return !equal && *value < operand;
+    case Comparison::LessEqual:
+        return equal || *value < operand;
+    case Comparison::Greater:
+        return !equal && *value > operand;
+    case Comparison::GreaterEqual:
+        return equal || *value > operand;
+    default:
+        UNREACHABLE();
+    }
+}
+
+std::optional<bool> Filter::evaluate(const FilterInput& input) const
+{
+    // Unknown operands only decide `and` and `or` if the other side does
+    std::array<std::optional<bool>, maxStackDepth> stack {};
+    std::size_t size = 0;
+    for (auto& instruction : m_program) {
+        switch (instruction.opcode) {
+        case Opcode::Compare:
+            stack[size++] = compare(instruction, input);
+            break;
+        case Opcode::Not:
+            if (stack[size - 1].has_value())
+                stack[size - 1] = !*stack[size - 1];
+            break;
+        case Opcode::And: {
+            auto right = stack[--size];
+            auto& left = stack[size - 1];
+            if (left == false || right == false)
+                left = false;
+            else if (!left.has_value() || !right.has_value())
+                left = std::nullopt;
+            break;
+        }
+        case Opcode::Or: {
+            auto right = stack[--size];
+            auto& left = stack[size - 1];
+            if (left == true || right == true)
+                left = true;
+            else if (!left.has_value() || !right.has_value())
+                left = std::nullopt;
+            break;
+        }
+        }
+    }
+    return stack[0];
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MetadataCache.h"
+#include "PhotoRecord.h"
+
+/// @brief What a filter can look at. Whatever is not known yet is left unset, comparisons on it stay undecided.
+struct FilterInput {
+    std::string_view path {};
+    const MetadataCache::FileStat* stat { nullptr };
+    const PhotoRecord* record { nullptr };
+};
+
+/// @brief --where: a boolean expression over the extracted fields, compiled once into a postfix program.
+///
+/// `iso > 3200 and camera ~ "ILCE-7M4"`, `lensid = 32870`, `shutter >= 1/60 or not (focal < 50)`,
+/// `timestamp >= 2024-05-01 and size > 40M`. Text is compared case-insensitively, `~` tests for a substring.
+/// Evaluation uses three-valued logic, so a filter can be run on the path and stat() of a file alone and
+/// rule it out before any of it is read.
+class Filter final {
+public:
+    /// @brief Returns nothing after printing the error on stderr if the expression is malformed
+    [[nodiscard]] static std::optional<Filter> compile(std::string_view expression);
+
+    /// @brief Whether any comparison is on the file's size or modification time
+    [[nodiscard]] bool usesStat() const { return m_usesStat; }
+    /// @brief Whether any comparison is on the photo's metadata, which only extraction provides
+    [[nodiscard]] bool usesRecord() const { return m_usesRecord; }
+
+    /// @brief True or false, or nothing if the answer depends on fields `input` doesn't have
+    [[nodiscard]] std::optional<bool> evaluate(const FilterInput&) const;
+
+    /// @brief Fields an expression can compare
+    enum class Field : std::uint8_t {
+        Iso,
+        Shutter,
+        Aperture,
+        Focal,
+        Width,
+        Height,
+        Resolution,
+        LensId,
+        Timestamp,
+        Camera,
+        Make,
+        Model,
+        Lens,
+        Software,
+        Path,
+        Size,
+        ModificationTime,
+    };
+
+    enum class Comparison : std::uint8_t {
+        Equal,
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Contains,
+        NotContains,
+    };
+
+private:
+    enum class Opcode : std::uint8_t {
+        Compare,
+        And,
+        Or,
+        Not,
+    };
+
+    struct Instruction {
+        Opcode opcode { Opcode::Compare };
+        Field field { Field::Iso };
+        Comparison comparison { Comparison::Equal };
+        double number { 0.0 };
+        /// @brief Lower-cased operand of text comparisons
+        std::string text {};
+    };
+
+    class Parser;
+
+    [[nodiscard]] static std::optional<bool> compare(const Instruction&, const FilterInput&);
+
+    std::vector<Instruction> m_program {};
+    bool m_usesStat { false };
+    bool m_usesRecord { false };
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fmt/format.h>
+#include <string_view>
+
+/// @brief A string of at most `Capacity` bytes stored inline, like the char arrays LibRaw fills in. Longer values
+/// are truncated. Copying one never allocates, so PhotoRecord stays trivially copyable and can be passed around,
+/// cached and stored per file without touching the heap.
+template <std::size_t Capacity>
+class FixedString final {
+    static_assert(Capacity <= 255, "The size is stored in one byte");
+
+public:
+    FixedString() = default;
+
+    FixedString(std::string_view value) { assign(value); }
+
+    FixedString& operator=(std::string_view value)
+    {
+        assign(value);
+        return *this;
+    }
+
+    void assign(std::string_view value)
+    {
+        m_size = static_cast<std::uint8_t>(std::min(value.size(), Capacity));
+        // May be a view of this string itself, e.g. when stripping a prefix
+        std::memmove(m_data.data(), value.data(), m_size);
+    }
+
+    [[nodiscard]] std::string_view view() const { return { m_data.data(), m_size }; }
+    operator std::string_view() const { return view(); }
+
+    [[nodiscard]] bool empty() const { return m_size == 0; }
+    [[nodiscard]] std::size_t size() const { return m_size; }
+    [[nodiscard]] char operator[](std::size_t index) const { return m_data[index]; }
+
+    bool operator==(const FixedString& other) const { return view() == other.view(); }
+
+private:
+    std::array<char, Capacity> m_data {};
+    std::uint8_t m_size { 0 };
+};
+
+template <std::size_t Capacity>
+struct fmt::formatter<FixedString<Capacity>> : fmt::formatter<std::string_view> {
+    auto format(const FixedString<Capacity>& value, format_context& context) const
+    {
+        return fmt::formatter<std::string_view>::format(value.view(), context);
+    }
+};
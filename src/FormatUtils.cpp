@@ -2,39 +2,79 @@
 
 #include "FormatUtils.h"
 
-std::string FormatUtils::formatShutterSpeed(float shutter)
+template <typename Value>
+static std::string toString(fmt::appender (*append)(fmt::appender, Value), Value value)
+{
+    fmt::memory_buffer buffer {};
+    append(fmt::appender(buffer), value);
+    return fmt::to_string(buffer);
+}
+
+fmt::appender FormatUtils::appendShutterSpeed(fmt::appender out, float shutter)
 {
     if (shutter < 1.0f)
-        return fmt::format("1/{}s", std::round(1.0f / shutter));
-    return fmt::format("{}s", shutter);
+        return fmt::format_to(out, "1/{}s", std::round(1.0f / shutter));
+    return fmt::format_to(out, "{}s", shutter);
 }
 
-std::string FormatUtils::formatAperture(float aperture)
+fmt::appender FormatUtils::appendAperture(fmt::appender out, float aperture)
 {
     auto rounded = std::round(aperture * 10) / 10;
-    return fmt::format("f/{}", rounded);
+    return fmt::format_to(out, "f/{}", rounded);
+}
+
+fmt::appender FormatUtils::appendISO(fmt::appender out, float iso)
+{
+    return fmt::format_to(out, "ISO {}", std::round(iso));
+}
+
+fmt::appender FormatUtils::appendFocalLength(fmt::appender out, float focal)
+{
+    return fmt::format_to(out, "{}mm", std::round(focal));
+}
+
+fmt::appender FormatUtils::appendResolution(fmt::appender out, unsigned int resolution)
+{
+    return fmt::format_to(out, "{}MP", std::round(static_cast<float>(resolution) / 1000000.0f));
+}
+
+fmt::appender FormatUtils::appendLens(fmt::appender out, std::string_view lensMake, std::string_view lens)
+{
+    if (lensMake.empty() && lens.empty())
+        return fmt::format_to(out, "Unknown lens");
+    if (lensMake.empty())
+        return fmt::format_to(out, "{}", lens);
+    return fmt::format_to(out, "{} {}", lensMake, lens);
+}
+
+std::string FormatUtils::formatShutterSpeed(float shutter)
+{
+    return toString(appendShutterSpeed, shutter);
+}
+
+std::string FormatUtils::formatAperture(float aperture)
+{
+    return toString(appendAperture, aperture);
 }
 
 std::string FormatUtils::formatISO(float iso)
 {
-    return fmt::format("ISO {}", std::round(iso));
+    return toString(appendISO, iso);
 }
 
 std::string FormatUtils::formatFocalLength(float focal)
 {
-    return fmt::format("{}mm", std::round(focal));
+    return toString(appendFocalLength, focal);
 }
 
 std::string FormatUtils::formatResolution(unsigned int resolution)
 {
-    return fmt::format("{}MP", std::round(static_cast<float>(resolution) / 1000000.0f));
+    return toString(appendResolution, resolution);
 }
 
-std::string FormatUtils::formatLens(const libraw_lensinfo_t& lens)
+std::string FormatUtils::formatLens(const std::string& lensMake, const std::string& lens)
 {
-    if (stringEmpty(lens.LensMake) && stringEmpty(lens.Lens))
-        return "Unknown lens";
-    if (stringEmpty(lens.LensMake))
-        return lens.Lens;
-    return fmt::format("{} {}", lens.LensMake, lens.Lens);
+    fmt::memory_buffer buffer {};
+    appendLens(fmt::appender(buffer), lensMake, lens);
+    return fmt::to_string(buffer);
 }
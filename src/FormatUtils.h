@@ -1,8 +1,11 @@
 #pragma once
 
-#include <libraw/libraw_types.h>
+#include <fmt/format.h>
 #include <string>
+#include <string_view>
 
+/// @brief Human-readable metric values. The append* variants write into a caller-owned fmt buffer
+/// (fmt::memory_buffer, OutputBuffer) and never allocate; the string-returning ones wrap them.
 class FormatUtils final {
 public:
     [[nodiscard]] static std::string formatShutterSpeed(float);
@@ -10,11 +13,12 @@ public:
     [[nodiscard]] static std::string formatISO(float);
     [[nodiscard]] static std::string formatFocalLength(float);
     [[nodiscard]] static std::string formatResolution(unsigned int);
-    [[nodiscard]] static std::string formatLens(const libraw_lensinfo_t&);
+    [[nodiscard]] static std::string formatLens(const std::string& lensMake, const std::string& lens);
 
-private:
-    static constexpr bool stringEmpty(const char* str)
-    {
-        return str == nullptr || str[0] == '\0';
-    }
+    static fmt::appender appendShutterSpeed(fmt::appender, float);
+    static fmt::appender appendAperture(fmt::appender, float);
+    static fmt::appender appendISO(fmt::appender, float);
+    static fmt::appender appendFocalLength(fmt::appender, float);
+    static fmt::appender appendResolution(fmt::appender, unsigned int);
+    static fmt::appender appendLens(fmt::appender, std::string_view lensMake, std::string_view lens);
 };
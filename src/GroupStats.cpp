@@ -0,0 +1,125 @@
+#include "GroupStats.h"
+
+std::optional<GroupBy> parseGroupBy(std::string_view name)
+{
+    if (name == "none")
+        return GroupBy::None;
+    if (name == "camera")
+        return GroupBy::Camera;
+    if (name == "lens")
+        return GroupBy::Lens;
+    if (name == "camera,lens" || name == "lens,camera")
+        return GroupBy::CameraLens;
+    return std::nullopt;
+}
+
+MetricStats::MetricStats(bool exact)
+    : iso_speeds(exact)
+    , shutter_speeds(exact)
+    , focal_lengths(exact)
+    , aperture_values(exact)
+    , resolutions(exact)
+{
+}
+
+void MetricStats::add(float isoSpeed, float shutterSpeed, float focalLength, float aperture, float resolution)
+{
+    iso_speeds.add(isoSpeed);
+    shutter_speeds.add(shutterSpeed);
+    focal_lengths.add(focalLength);
+    aperture_values.add(aperture);
+    resolutions.add(resolution);
+}
+
+void MetricStats::merge(const MetricStats& other)
+{
+    iso_speeds.merge(other.iso_speeds);
+    shutter_speeds.merge(other.shutter_speeds);
+    focal_lengths.merge(other.focal_lengths);
+    aperture_values.merge(other.aperture_values);
+    resolutions.merge(other.resolutions);
+}
+
+void MetricStats::save(ByteWriter& writer) const
+{
+    iso_speeds.save(writer);
+    shutter_speeds.save(writer);
+    focal_lengths.save(writer);
+    aperture_values.save(writer);
+    resolutions.save(writer);
+}
+
+void MetricStats::load(ByteReader& reader)
+{
+    iso_speeds.load(reader);
+    shutter_speeds.load(reader);
+    focal_lengths.load(reader);
+    aperture_values.load(reader);
+    resolutions.load(reader);
+}
+
+GroupStats::GroupStats(GroupBy groupBy, bool exact)
+    : m_groupBy(groupBy)
+    , m_exact(exact)
+{
+}
+
+MetricStats& GroupStats::group(InternTable::Id camera, InternTable::Id lens)
+{
+    if (m_groupBy == GroupBy::Lens)
+        camera = 0;
+    if (m_groupBy == GroupBy::Camera)
+        lens = 0;
+
+    if (camera >= m_index.size())
+        m_index.resize(camera + 1);
+    auto& lenses = m_index[camera];
+    if (lens >= lenses.size())
+        lenses.resize(lens + 1, noGroup);
+
+    auto& index = lenses[lens];
+    if (index == noGroup) {
+        index = static_cast<std::uint32_t>(m_groups.size());
+        m_keys.push_back(static_cast<std::uint64_t>(camera) << 32 | lens);
+        m_groups.emplace_back(m_exact);
+    }
+    return m_groups[index];
+}
+
+void GroupStats::merge(const GroupStats& other, const std::vector<InternTable::Id>& cameraIds, const std::vector<InternTable::Id>& lensIds)
+{
+    for (std::size_t index = 0; index < other.size(); ++index) {
+        // Translating an id that is not grouped by would read past the mapping, it is zero anyway
+        auto camera = m_groupBy == GroupBy::Lens ? 0 : cameraIds[other.camera(index)];
+        auto lens = m_groupBy == GroupBy::Camera ? 0 : lensIds[other.lens(index)];
+        group(camera, lens).merge(other.stats(index));
+    }
+}
+
+void GroupStats::save(ByteWriter& writer) const
+{
+    writer.write(static_cast<std::uint64_t>(m_groups.size()));
+    for (std::size_t index = 0; index < m_groups.size(); ++index) {
+        writer.write(m_keys[index]);
+        m_groups[index].save(writer);
+    }
+}
+
+void GroupStats::load(ByteReader& reader, std::size_t cameras, std::size_t lenses)
+{
+    auto count = reader.read<std::uint64_t>();
+    for (std::uint64_t index = 0; index < count && !reader.failed(); ++index) {
+        auto key = reader.read<std::uint64_t>();
+        MetricStats stats { m_exact };
+        stats.load(reader);
+
+        // Checked before the ids size the index
+        auto camera = static_cast<InternTable::Id>(key >> 32);
+        auto lens = static_cast<InternTable::Id>(key);
+        if ((m_groupBy != GroupBy::Lens && camera >= cameras) || (m_groupBy != GroupBy::Camera && lens >= lenses)) {
+            reader.fail();
+            return;
+        }
+        group(camera, lens).merge(stats);
+    }
+}
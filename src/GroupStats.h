@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "InternTable.h"
+#include "Statistics.h"
+
+/// @brief What --group-by splits the summary by
+enum class GroupBy {
+    None,
+    Camera,
+    Lens,
+    /// @brief Cross-tab, one group per camera and lens combination
+    CameraLens,
+};
+
+[[nodiscard]] std::optional<GroupBy> parseGroupBy(std::string_view);
+
+/// @brief The metrics the summary reports, for all photos or for one group
+struct MetricStats {
+    StreamingStats iso_speeds;
+    StreamingStats shutter_speeds;
+    StreamingStats focal_lengths;
+    StreamingStats aperture_values;
+    StreamingStats resolutions;
+
+    explicit MetricStats(bool exact = false);
+
+    void add(float isoSpeed, float shutterSpeed, float focalLength, float aperture, float resolution);
+    void merge(const MetricStats& other);
+
+    [[nodiscard]] std::size_t count() const { return iso_speeds.count(); }
+
+    void save(ByteWriter&) const;
+    void load(ByteReader&);
+};
+
+/// @brief MetricStats per group, filled in the same pass as the global statistics.
+/// Groups are identified by the camera and lens ids of the owning Data's KeyCounts.
+class GroupStats final {
+public:
+    GroupStats(GroupBy, bool exact);
+
+    [[nodiscard]] bool enabled() const { return m_groupBy != GroupBy::None; }
+    [[nodiscard]] GroupBy groupBy() const { return m_groupBy; }
+
+    /// @brief Returns the stats of the group a photo with these ids belongs to, creating it if needed
+    MetricStats& group(InternTable::Id camera, InternTable::Id lens);
+
+    /// @param cameraIds, lensIds Map the other instance's camera and lens ids to this instance's
+    void merge(const GroupStats& other, const std::vector<InternTable::Id>& cameraIds, const std::vector<InternTable::Id>& lensIds);
+
+    [[nodiscard]] std::size_t size() const { return m_groups.size(); }
+    /// @brief Camera id of group `index`, meaningless when grouping by lens only
+    [[nodiscard]] InternTable::Id camera(std::size_t index) const { return static_cast<InternTable::Id>(m_keys[index] >> 32); }
+    /// @brief Lens id of group `index`, meaningless when grouping by camera only
+    [[nodiscard]] InternTable::Id lens(std::size_t index) const { return static_cast<InternTable::Id>(m_keys[index]); }
+    [[nodiscard]] const MetricStats& stats(std::size_t index) const { return m_groups[index]; }
+
+    /// @brief Writes the groups, ids refer to the KeyCounts saved alongside
+    void save(ByteWriter&) const;
+    /// @brief Adds saved groups, which must use the same grouping. Fails the reader on ids past `cameras` or
+    /// `lenses`, the sizes of the tables loaded alongside.
+    void load(ByteReader&, std::size_t cameras, std::size_t lenses);
+
+private:
+    static constexpr std::uint32_t noGroup = std::numeric_limits<std::uint32_t>::max();
+
+    GroupBy m_groupBy;
+    bool m_exact;
+    // Group index by camera id, then lens id, noGroup where no photo was added yet. Ids are dense, so this
+    // stays small and a lookup is two array accesses instead of hashing
+    std::vector<std::vector<std::uint32_t>> m_index {};
+    // (camera id << 32 | lens id), with the id that is not grouped by left zero
+    std::vector<std::uint64_t> m_keys {};
+    std::vector<MetricStats> m_groups {};
+};
@@ -0,0 +1,65 @@
+#include "InternTable.h"
+
+static constexpr std::uint64_t fnvOffset = 0xCBF29CE484222325ull;
+static constexpr std::uint64_t fnvPrime = 0x100000001B3ull;
+
+static std::uint64_t mix(std::uint64_t hash, std::uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) {
+        hash = (hash ^ (value & 0xFF)) * fnvPrime;
+        value >>= 8;
+    }
+    return hash;
+}
+
+static std::uint64_t mix(std::uint64_t hash, std::string_view value)
+{
+    for (auto c : value)
+        hash = (hash ^ static_cast<unsigned char>(c)) * fnvPrime;
+    // The length keeps ("ab", "c") and ("a", "bc") apart
+    return mix(hash, value.size());
+}
+
+std::uint64_t InternTable::hash(std::string_view first, std::string_view second, std::uint64_t number)
+{
+    auto hash = mix(mix(mix(fnvOffset, first), second), number);
+    // FNV-1a leaves the low bits weak, and those pick the slot
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+InternTable::Id InternTable::intern(std::string_view first, std::string_view second, std::uint64_t number)
+{
+    if ((m_keys.size() + 1) * 4 > m_slots.size() * 3)
+        grow();
+
+    auto keyHash = hash(first, second, number);
+    auto mask = m_slots.size() - 1;
+    for (auto slot = keyHash & mask;; slot = (slot + 1) & mask) {
+        auto id = m_slots[slot];
+        if (id == emptySlot) {
+            id = static_cast<Id>(m_keys.size());
+            m_slots[slot] = id;
+            m_keys.push_back({ std::string { first }, std::string { second }, number });
+            m_hashes.push_back(keyHash);
+            return id;
+        }
+        auto& key = m_keys[id];
+        if (m_hashes[id] == keyHash && key.number == number && key.first == first && key.second == second)
+            return id;
+    }
+}
+
+void InternTable::grow()
+{
+    m_slots.assign(m_slots.empty() ? initialSlots : m_slots.size() * 2, emptySlot);
+    auto mask = m_slots.size() - 1;
+    for (Id id = 0; id < m_keys.size(); ++id) {
+        auto slot = m_hashes[id] & mask;
+        while (m_slots[slot] != emptySlot)
+            slot = (slot + 1) & mask;
+        m_slots[slot] = id;
+    }
+}
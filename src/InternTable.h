@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief Assigns dense ids (0, 1, 2, ...) to keys made of two strings and a number, e.g. (make, model) or
+/// (lens make, lens, LensID). Open addressing with linear probing over the ids, looking up a known key
+/// neither allocates nor chases pointers; only new keys are copied into owned strings.
+class InternTable final {
+public:
+    using Id = std::uint32_t;
+
+    struct Key {
+        std::string first {};
+        std::string second {};
+        std::uint64_t number {};
+    };
+
+    /// @brief Returns the id of the key, assigning the next free one if it has not been seen yet
+    Id intern(std::string_view first, std::string_view second, std::uint64_t number = 0);
+
+    [[nodiscard]] std::size_t size() const { return m_keys.size(); }
+    [[nodiscard]] bool empty() const { return m_keys.empty(); }
+    [[nodiscard]] const Key& key(Id id) const { return m_keys[id]; }
+
+private:
+    static constexpr Id emptySlot = std::numeric_limits<Id>::max();
+    static constexpr std::size_t initialSlots = 64;
+
+    [[nodiscard]] static std::uint64_t hash(std::string_view first, std::string_view second, std::uint64_t number);
+    void grow();
+
+    std::vector<Key> m_keys {};
+    // Hash of every key, so growing and mismatching probes never touch the strings
+    std::vector<std::uint64_t> m_hashes {};
+    // Power of two sized, at most 3/4 full
+    std::vector<Id> m_slots {};
+};
@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/color.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MetadataCache.h"
+#include "macros.h"
+
+namespace fs = std::filesystem;
+
+using fmt::print, fmt::fg, fmt::color;
+
+static constexpr char fileMagic[8] = { 'R', 'A', 'W', 'I', 'N', 'F', 'O', 'C' };
+static constexpr std::uint32_t fileVersion = 1;
+// Flush the journal to disk every this many appended records
+static constexpr std::size_t syncInterval = 256;
+// Compact the journal once superseded records outnumber live ones by this factor
+static constexpr std::size_t compactionFactor = 2;
+
+struct FileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+};
+
+struct RecordHeader {
+    std::uint32_t payload_size;
+    std::uint32_t checksum;
+};
+
+enum StringField : std::size_t {
+    Path,
+    Make,
+    Model,
+    Software,
+    LensMake,
+    Lens,
+    LensSerial,
+    BodySerial,
+    StringFieldCount,
+};
+
+// Fixed-size part of a record payload, followed by the strings in StringField order (not NUL-terminated)
+struct FixedFields {
+    std::uint64_t file_size;
+    std::int64_t mtime_ns;
+    std::int64_t timestamp;
+    std::uint64_t lens_id;
+    float iso_speed;
+    float shutter;
+    float aperture;
+    float focal_len;
+    std::uint32_t maker_index;
+    std::int32_t quality;
+    std::uint16_t width;
+    std::uint16_t height;
+    std::uint16_t raw_width;
+    std::uint16_t raw_height;
+    std::uint16_t camera_type;
+    std::uint16_t string_lengths[StringFieldCount];
+    std::uint16_t reserved[3];
+};
+static_assert(sizeof(FixedFields) == 88, "FixedFields must not contain padding");
+
+static std::uint32_t checksum(const std::byte* data, std::size_t size)
+{
+    // FNV-1a, only meant to detect torn or garbage tails
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i)
+        hash = (hash ^ static_cast<std::uint32_t>(data[i])) * 16777619u;
+    return hash;
+}
+
+static std::string_view pathOf(const std::byte* payload)
+{
+    FixedFields fixed {};
+    std::memcpy(&fixed, payload, sizeof(fixed));
+    return { reinterpret_cast<const char*>(payload + sizeof(fixed)), fixed.string_lengths[Path] };
+}
+
+static bool writeAll(int fd, const void* data, std::size_t size)
+{
+    auto bytes = static_cast<const char*>(data);
+    while (size != 0) {
+        auto written = ::write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Missing, empty or starting with our header. A file shorter than the header is a run interrupted right after
+// creating it if what's there matches the header so far.
+static bool isCacheFile(const fs::path& path)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT;
+
+    FileHeader expected {};
+    std::memcpy(expected.magic, fileMagic, sizeof(fileMagic));
+    expected.version = fileVersion;
+    FileHeader header {};
+    auto bytes = ::pread(fd, &header, sizeof(header), 0);
+    ::close(fd);
+    if (bytes < 0)
+        return false;
+    // Only the magic and version are compared, reserved is zero in both
+    return std::memcmp(&header, &expected, std::min<std::size_t>(static_cast<std::size_t>(bytes), offsetof(FileHeader, reserved))) == 0;
+}
+
+std::unique_ptr<MetadataCache> MetadataCache::open(fs::path path)
+{
+    std::error_code error {};
+    if (path.has_parent_path())
+        fs::create_directories(path.parent_path(), error);
+
+    // Compaction replaces the journal, so the lock lives in a file of its own
+    auto lockPath = fs::path { path }.concat(".lock");
+    auto lockFd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd < 0) {
+        print(stderr, fg(color::red), "Could not open {}: {}\n", lockPath.string(), std::strerror(errno));
+        return nullptr;
+    }
+    if (::flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+        print(stderr, fg(color::yellow), "Waiting for another rawinfo to finish with {}\n", path.string());
+        while (::flock(lockFd, LOCK_EX) != 0 && errno == EINTR) { }
+    }
+
+    if (!isCacheFile(path)) {
+        print(stderr, fg(color::red), "{} is not a rawinfo cache or was written by another version, refusing to overwrite it\n", path.string());
+        ::close(lockFd);
+        return nullptr;
+    }
+    return std::unique_ptr<MetadataCache> { new MetadataCache(std::move(path), lockFd) };
+}
+
+MetadataCache::MetadataCache(fs::path path, int lockFd)
+    : m_path(std::move(path))
+    , m_lockFd(lockFd)
+{
+    load();
+    if (m_recordCount > compactionFactor * m_index.size()) {
+        compact();
+        load();
+    }
+
+    m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    ASSERT_MSG(m_fd >= 0, m_path.c_str());
+
+    if (m_validSize == 0) {
+        FileHeader header {};
+        std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        header.version = fileVersion;
+        ASSERT(::ftruncate(m_fd, 0) == 0);
+        ASSERT(writeAll(m_fd, &header, sizeof(header)));
+        m_validSize = sizeof(header);
+    } else {
+        // Drop whatever an interrupted run left after the last intact record
+        ASSERT(::ftruncate(m_fd, static_cast<off_t>(m_validSize)) == 0);
+    }
+    ASSERT(::lseek(m_fd, 0, SEEK_END) >= 0);
+}
+
+MetadataCache::~MetadataCache()
+{
+    if (m_fd >= 0) {
+        ::fdatasync(m_fd);
+        ::close(m_fd);
+    }
+    if (m_mapping != nullptr)
+        ::munmap(const_cast<std::byte*>(m_mapping), m_mappingSize);
+    // Releases the lock, after everything is on disk
+    if (m_lockFd >= 0)
+        ::close(m_lockFd);
+}
+
+std::optional<MetadataCache::FileStat> MetadataCache::statFile(const fs::path& path)
+{
+    struct stat st { };
+    if (::stat(path.c_str(), &st) != 0)
+        return std::nullopt;
+
+    return FileStat {
+        .size = static_cast<std::uint64_t>(st.st_size),
+        .mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec,
+    };
+}
+
+void MetadataCache::load()
+{
+    if (m_mapping != nullptr)
+        ::munmap(const_cast<std::byte*>(m_mapping), m_mappingSize);
+    m_mapping = nullptr;
+    m_mappingSize = 0;
+    m_validSize = 0;
+    m_recordCount = 0;
+    m_index.clear();
+
+    auto fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st { };
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        return;
+    }
+
+    m_mappingSize = static_cast<std::size_t>(st.st_size);
+    auto* mapping = ::mmap(nullptr, m_mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        m_mappingSize = 0;
+        return;
+    }
+    m_mapping = static_cast<const std::byte*>(mapping);
+
+    FileHeader header {};
+    std::memcpy(&header, m_mapping, sizeof(header));
+    if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.version != fileVersion)
+        return; // open() already refused files that aren't ours
+
+    auto offset = sizeof(FileHeader);
+    while (offset + sizeof(RecordHeader) <= m_mappingSize) {
+        RecordHeader record {};
+        std::memcpy(&record, m_mapping + offset, sizeof(record));
+
+        auto payloadOffset = offset + sizeof(RecordHeader);
+        if (record.payload_size < sizeof(FixedFields) || record.payload_size > m_mappingSize - payloadOffset)
+            break;
+
+        const auto* payload = m_mapping + payloadOffset;
+        if (checksum(payload, record.payload_size) != record.checksum)
+            break;
+
+        // Later records supersede earlier ones for the same path
+        m_index[pathOf(payload)] = payload;
+        ++m_recordCount;
+        offset = payloadOffset + record.payload_size;
+    }
+    m_validSize = offset;
+}
+
+void MetadataCache::compact()
+{
+    auto temporary = m_path;
+    temporary += ".tmp";
+
+    auto fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    ASSERT_MSG(fd >= 0, temporary.c_str());
+
+    auto ok = writeAll(fd, m_mapping, sizeof(FileHeader));
+    for (auto& [key, payload] : m_index) {
+        const auto* record = payload - sizeof(RecordHeader);
+        RecordHeader header {};
+        std::memcpy(&header, record, sizeof(header));
+        ok = ok && writeAll(fd, record, sizeof(RecordHeader) + header.payload_size);
+    }
+    ok = ok && ::fsync(fd) == 0;
+    ::close(fd);
+
+    if (ok)
+        fs::rename(temporary, m_path);
+    else
+        fs::remove(temporary);
+}
+
+std::optional<PhotoRecord> MetadataCache::lookup(std::string_view key, const FileStat& stat) const
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+        return std::nullopt;
+
+    FixedFields fixed {};
+    std::memcpy(&fixed, it->second, sizeof(fixed));
+    if (FileStat { fixed.file_size, fixed.mtime_ns } != stat)
+        return std::nullopt;
+
+    std::string_view strings[StringFieldCount] {};
+    const auto* cursor = reinterpret_cast<const char*>(it->second + sizeof(fixed));
+    for (std::size_t i = 0; i < StringFieldCount; ++i) {
+        strings[i] = { cursor, fixed.string_lengths[i] };
+        cursor += fixed.string_lengths[i];
+    }
+
+    return PhotoRecord {
+        .timestamp = static_cast<std::time_t>(fixed.timestamp),
+        .iso_speed = fixed.iso_speed,
+        .shutter = fixed.shutter,
+        .aperture = fixed.aperture,
+        .focal_len = fixed.focal_len,
+        .width = fixed.width,
+        .height = fixed.height,
+        .raw_width = fixed.raw_width,
+        .raw_height = fixed.raw_height,
+        .maker_index = fixed.maker_index,
+        .camera_type = fixed.camera_type,
+        .quality = fixed.quality,
+        .lens_id = fixed.lens_id,
+        .make = strings[Make],
+        .model = strings[Model],
+        .software = strings[Software],
+        .lens_make = strings[LensMake],
+        .lens = strings[Lens],
+        .lens_serial = strings[LensSerial],
+        .body_serial = strings[BodySerial],
+    };
+}
+
+void MetadataCache::store(std::string_view key, const FileStat& stat, const PhotoRecord& record)
+{
+    const std::string_view strings[StringFieldCount] = {
+        key,
+        record.make,
+        record.model,
+        record.software,
+        record.lens_make,
+        record.lens,
+        record.lens_serial,
+        record.body_serial,
+    };
+
+    FixedFields fixed {
+        .file_size = stat.size,
+        .mtime_ns = stat.mtime_ns,
+        .timestamp = static_cast<std::int64_t>(record.timestamp),
+        .lens_id = record.lens_id,
+        .iso_speed = record.iso_speed,
+        .shutter = record.shutter,
+        .aperture = record.aperture,
+        .focal_len = record.focal_len,
+        .maker_index = record.maker_index,
+        .quality = record.quality,
+        .width = record.width,
+        .height = record.height,
+        .raw_width = record.raw_width,
+        .raw_height = record.raw_height,
+        .camera_type = record.camera_type,
+        .string_lengths = {},
+        .reserved = {},
+    };
+    auto payloadSize = sizeof(fixed);
+    for (std::size_t i = 0; i < StringFieldCount; ++i) {
+        if (strings[i].size() > UINT16_MAX)
+            return; // Not worth caching
+        fixed.string_lengths[i] = static_cast<std::uint16_t>(strings[i].size());
+        payloadSize += strings[i].size();
+    }
+
+    std::scoped_lock lock { m_writeMutex };
+
+    m_scratch.resize(sizeof(RecordHeader) + payloadSize);
+    auto* payload = m_scratch.data() + sizeof(RecordHeader);
+    std::memcpy(payload, &fixed, sizeof(fixed));
+    auto* cursor = payload + sizeof(fixed);
+    for (auto& string : strings) {
+        std::memcpy(cursor, string.data(), string.size());
+        cursor += string.size();
+    }
+
+    RecordHeader header {
+        .payload_size = static_cast<std::uint32_t>(payloadSize),
+        .checksum = checksum(payload, payloadSize),
+    };
+    std::memcpy(m_scratch.data(), &header, sizeof(header));
+
+    // One write per record: a crash leaves at most one torn record, which load() discards
+    if (!writeAll(m_fd, m_scratch.data(), m_scratch.size())) {
+        // Cut off the partial record so later appends stay readable
+        if (::ftruncate(m_fd, static_cast<off_t>(m_validSize)) == 0)
+            ::lseek(m_fd, 0, SEEK_END);
+        return;
+    }
+    m_validSize += m_scratch.size();
+    if (++m_appended % syncInterval == 0)
+        ::fdatasync(m_fd);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "PhotoRecord.h"
+
+/// @brief Persistent, memory-mapped store of PhotoRecords keyed by path, file size and modification time.
+///
+/// The on-disk file is an append-only journal of checksummed records, so an interrupted run keeps everything
+/// it stored up to the last complete record. When the cache is opened, a journal with too many superseded entries
+/// is compacted into a temporary file which then atomically replaces the original, before anything is appended.
+/// Concurrent runs on the same cache take turns: each holds an exclusive lock on `<path>.lock` while it is open.
+class MetadataCache final {
+public:
+    /// @brief Identity of a file on disk; a cached record is only valid while this matches
+    struct FileStat {
+        std::uint64_t size {};
+        std::int64_t mtime_ns {};
+
+        bool operator==(const FileStat&) const = default;
+    };
+
+    /// @brief Opens or creates the cache at `path`, waiting for any other process using it. Prints an error and
+    /// returns nothing if the file exists but isn't a cache of this version, instead of overwriting it.
+    [[nodiscard]] static std::unique_ptr<MetadataCache> open(std::filesystem::path path);
+    ~MetadataCache();
+
+    MetadataCache(const MetadataCache&) = delete;
+    MetadataCache& operator=(const MetadataCache&) = delete;
+
+    [[nodiscard]] static std::optional<FileStat> statFile(const std::filesystem::path&);
+
+    /// @brief Thread-safe, only reads the mapping built when the cache was opened
+    [[nodiscard]] std::optional<PhotoRecord> lookup(std::string_view key, const FileStat&) const;
+
+    /// @brief Thread-safe, appends one record to the journal
+    void store(std::string_view key, const FileStat&, const PhotoRecord&);
+
+    [[nodiscard]] std::size_t size() const { return m_index.size(); }
+
+private:
+    MetadataCache(std::filesystem::path path, int lockFd);
+
+    void load();
+    void compact();
+
+    std::filesystem::path m_path {};
+    const std::byte* m_mapping { nullptr };
+    std::size_t m_mappingSize { 0 };
+    // Byte offset just past the last intact record, kept up to date while appending
+    std::size_t m_validSize { 0 };
+    std::size_t m_recordCount { 0 };
+    std::unordered_map<std::string_view, const std::byte*> m_index {};
+
+    std::mutex m_writeMutex {};
+    int m_fd { -1 };
+    int m_lockFd { -1 };
+    std::size_t m_appended { 0 };
+    std::vector<std::byte> m_scratch {};
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdio>
+#include <fmt/color.h>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string_view>
+
+/// @brief Collects (optionally colored) output in memory so it can be written with a single call.
+/// With color disabled, styles are dropped before any escape sequence is generated.
+class OutputBuffer final {
+public:
+    explicit OutputBuffer(bool color)
+        : m_color(color)
+    {
+    }
+
+    template <typename... Args>
+    void print(fmt::format_string<Args...> format, Args&&... args)
+    {
+        fmt::format_to(std::back_inserter(m_buffer), format, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void print(const fmt::text_style& style, fmt::format_string<Args...> format, Args&&... args)
+    {
+        if (!m_color) {
+            fmt::format_to(std::back_inserter(m_buffer), format, std::forward<Args>(args)...);
+            return;
+        }
+        fmt::vformat_to(std::back_inserter(m_buffer), style, fmt::string_view(format), fmt::make_format_args(args...));
+    }
+
+    void append(std::string_view text) { m_buffer.append(text.data(), text.data() + text.size()); }
+    void append(char c) { m_buffer.push_back(c); }
+    /// @brief Target for the append* formatters of FormatUtils and TimeUtils
+    [[nodiscard]] fmt::appender appender() { return fmt::appender(m_buffer); }
+
+    [[nodiscard]] bool color() const { return m_color; }
+    [[nodiscard]] bool empty() const { return m_buffer.size() == 0; }
+
+    void writeTo(std::FILE* stream) const { std::fwrite(m_buffer.data(), 1, m_buffer.size(), stream); }
+
+private:
+    bool m_color;
+    // Large enough for a typical per-file block, so rendering one does not allocate
+    fmt::basic_memory_buffer<char, 1024> m_buffer {};
+};
+
+/// @brief Format argument that runs an append* formatter (FormatUtils, TimeUtils) straight into the output,
+/// e.g. `out.print(fg(color::gray), "({})", Formatted { TimeUtils::appendTimeSince, timestamp })`
+template <typename Value>
+struct Formatted {
+    fmt::appender (*append)(fmt::appender, Value);
+    Value value;
+};
+
+template <typename Value>
+struct fmt::formatter<Formatted<Value>> {
+    constexpr auto parse(format_parse_context& context) { return context.begin(); }
+    auto format(const Formatted<Value>& formatted, format_context& context) const { return formatted.append(context.out(), formatted.value); }
+};
+
+/// @brief Reorder stage for per-file output: blocks may arrive from any worker in any order, but are written
+/// in index order. Every index from 0 up must eventually be submitted, empty blocks included.
+class OrderedOutput final {
+public:
+    explicit OrderedOutput(std::FILE* stream)
+        : m_stream(stream)
+    {
+    }
+
+    void submit(std::size_t index, OutputBuffer&& block)
+    {
+        std::scoped_lock lock { m_mutex };
+        if (index != m_next) {
+            m_pending.emplace(index, std::move(block));
+            return;
+        }
+
+        block.writeTo(m_stream);
+        ++m_next;
+        for (auto it = m_pending.begin(); it != m_pending.end() && it->first == m_next; it = m_pending.erase(it)) {
+            it->second.writeTo(m_stream);
+            ++m_next;
+        }
+    }
+
+private:
+    std::FILE* m_stream;
+    std::mutex m_mutex {};
+    std::size_t m_next { 0 };
+    std::map<std::size_t, OutputBuffer> m_pending {};
+};
@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <cstring>
+#include <fmt/color.h>
+#include <fstream>
+#include <iterator>
+
+#include "PartialSummary.h"
+
+namespace fs = std::filesystem;
+
+using fmt::print, fmt::fg, fmt::color;
+
+static constexpr char fileMagic[8] = { 'R', 'A', 'W', 'I', 'N', 'F', 'O', 'P' };
+static constexpr std::uint32_t fileVersion = 3;
+
+static_assert(sizeof(PartialSummary::FileHeader) == 32, "FileHeader must not contain padding");
+
+static std::uint32_t checksum(const std::byte* data, std::size_t size)
+{
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i)
+        hash = (hash ^ static_cast<std::uint32_t>(data[i])) * 16777619u;
+    return hash;
+}
+
+bool PartialSummary::write(const fs::path& path, const Data& data, std::chrono::milliseconds time)
+{
+    ByteWriter payload {};
+    data.save(payload);
+    auto& bytes = payload.buffer();
+
+    FileHeader header {};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = fileVersion;
+    header.exact_stats = data.iso_speeds.exact();
+    header.group_by = static_cast<std::uint8_t>(data.groups.groupBy());
+    header.scan_time_ms = time.count();
+    header.payload_size = bytes.size();
+    auto sum = checksum(bytes.data(), bytes.size());
+
+    // Written next to the target and renamed, so a reader never sees a half-written partial
+    auto temporary = fs::path { path }.concat(".tmp");
+    auto* file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        print(stderr, fg(color::red), "Could not create {}\n", temporary.string());
+        return false;
+    }
+    auto written = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size()
+        && std::fwrite(&sum, sizeof(sum), 1, file) == 1;
+    written = std::fclose(file) == 0 && written;
+
+    std::error_code error {};
+    if (written)
+        fs::rename(temporary, path, error);
+    if (!written || error) {
+        print(stderr, fg(color::red), "Could not write {}\n", path.string());
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+std::optional<PartialSummary> PartialSummary::read(const fs::path& path)
+{
+    std::ifstream stream { path, std::ios::binary };
+    if (!stream) {
+        print(stderr, fg(color::red), "Could not open {}\n", path.string());
+        return std::nullopt;
+    }
+    std::vector<char> contents { std::istreambuf_iterator<char> { stream }, {} };
+    auto* bytes = reinterpret_cast<const std::byte*>(contents.data());
+
+    FileHeader header {};
+    if (contents.size() < sizeof(header)) {
+        print(stderr, fg(color::red), "{} is not a partial summary\n", path.string());
+        return std::nullopt;
+    }
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.version != fileVersion
+        || header.group_by > static_cast<std::uint8_t>(GroupBy::CameraLens)) {
+        print(stderr, fg(color::red), "{} is not a partial summary of this rawinfo version\n", path.string());
+        return std::nullopt;
+    }
+
+    std::uint32_t sum {};
+    auto* payload = bytes + sizeof(header);
+    if (contents.size() < sizeof(header) + sizeof(sum) || header.payload_size != contents.size() - sizeof(header) - sizeof(sum)) {
+        print(stderr, fg(color::red), "{} is truncated\n", path.string());
+        return std::nullopt;
+    }
+    std::memcpy(&sum, payload + header.payload_size, sizeof(sum));
+    if (sum != checksum(payload, header.payload_size)) {
+        print(stderr, fg(color::red), "{} is corrupt (checksum mismatch)\n", path.string());
+        return std::nullopt;
+    }
+
+    auto partial = PartialSummary {
+        .data = Data { header.exact_stats != 0, static_cast<GroupBy>(header.group_by) },
+        .time = std::chrono::milliseconds { header.scan_time_ms },
+    };
+    ByteReader reader { payload, header.payload_size };
+    partial.data.load(reader);
+    if (reader.failed() || !reader.atEnd()) {
+        print(stderr, fg(color::red), "{} is corrupt\n", path.string());
+        return std::nullopt;
+    }
+    return partial;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+
+#include "Data.h"
+
+/// @brief The aggregation state of one scan, written with --emit-partial and combined with --merge, so shards of
+/// an archive can be scanned where they are stored and summarized in one place.
+///
+/// Layout: a FileHeader, the payload written by Data::save, then an FNV-1a checksum of the payload.
+/// Partials can only be merged if they were written with the same --exact-stats and --group-by settings.
+class PartialSummary final {
+public:
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint8_t exact_stats;
+        std::uint8_t group_by;
+        std::uint16_t reserved;
+        std::int64_t scan_time_ms;
+        std::uint64_t payload_size;
+    };
+
+    Data data;
+    /// @brief How long the scan took
+    std::chrono::milliseconds time {};
+
+    [[nodiscard]] static bool write(const std::filesystem::path&, const Data&, std::chrono::milliseconds time);
+    /// @brief Returns nothing (after printing why on stderr) if the file is unreadable, truncated or corrupt
+    [[nodiscard]] static std::optional<PartialSummary> read(const std::filesystem::path&);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ctime>
+#include <type_traits>
+
+#include "FixedString.h"
+
+/// @brief Everything rawinfo reads from a raw file, decoupled from the LibRaw instance it came from. Strings are
+/// stored inline with the capacities of LibRaw's own fields, so records are copied without allocating.
+struct PhotoRecord {
+    std::time_t timestamp {};
+    float iso_speed {};
+    float shutter {};
+    float aperture {};
+    float focal_len {};
+    unsigned short width {};
+    unsigned short height {};
+    unsigned short raw_width {};
+    unsigned short raw_height {};
+    unsigned int maker_index {};
+    /// @brief Sony camera type (LIBRAW_SONY_*), zero for other makers
+    unsigned short camera_type {};
+    /// @brief Sony or Canon makernote quality setting
+    int quality {};
+    unsigned long long lens_id {};
+    FixedString<63> make {};
+    FixedString<63> model {};
+    FixedString<63> software {};
+    FixedString<127> lens_make {};
+    FixedString<127> lens {};
+    FixedString<127> lens_serial {};
+    FixedString<63> body_serial {};
+};
+
+static_assert(std::is_trivially_copyable_v<PhotoRecord>);
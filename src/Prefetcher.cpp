@@ -0,0 +1,273 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define RAWINFO_HAVE_IO_URING 1
+#endif
+
+#include "Prefetcher.h"
+#include "macros.h"
+
+namespace fs = std::filesystem;
+
+using fmt::print, fmt::fg, fmt::color;
+
+#ifdef RAWINFO_HAVE_IO_URING
+
+/// @brief Minimal io_uring submission/completion ring, driven through the raw system calls so there is no
+/// liburing dependency. Only ever touched by the thread owning the Prefetcher.
+class Prefetcher::Ring final {
+public:
+    /// @brief Returns nothing if the kernel lacks io_uring or IORING_OP_READ, or io_uring is blocked
+    static std::unique_ptr<Ring> create(unsigned entries)
+    {
+        io_uring_params params {};
+        auto fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0)
+            return nullptr;
+
+        auto ring = std::unique_ptr<Ring>(new Ring { fd });
+        // IORING_OP_READ arrived in the same release (5.6) as this feature flag
+        if ((params.features & IORING_FEAT_RW_CUR_POS) == 0 || !ring->map(params))
+            return nullptr;
+        return ring;
+    }
+
+    ~Ring()
+    {
+        if (m_sqes != nullptr)
+            ::munmap(m_sqes, m_sqesSize);
+        if (m_cqRing != nullptr && m_cqRing != m_sqRing)
+            ::munmap(m_cqRing, m_cqRingSize);
+        if (m_sqRing != nullptr)
+            ::munmap(m_sqRing, m_sqRingSize);
+        ::close(m_fd);
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    /// @brief Queues a read of `length` bytes at `offset` and submits it. The caller keeps the number of
+    /// reads in flight below the ring size, so there is always a free entry. Check error() afterwards.
+    void submitRead(int fd, void* buffer, unsigned length, std::uint64_t offset, std::uint64_t userData)
+    {
+        auto tail = *m_sqTail;
+        auto index = tail & *m_sqMask;
+        auto& sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.user_data = userData;
+        m_sqArray[index] = index;
+        std::atomic_ref { *m_sqTail }.store(tail + 1, std::memory_order_release);
+        enter(0);
+    }
+
+    /// @brief Pops the user data of one finished read, blocking for one if `wait` is set. Returns nothing once
+    /// error() is set.
+    std::optional<std::uint64_t> complete(bool wait)
+    {
+        auto head = *m_cqHead;
+        if (wait && head == std::atomic_ref { *m_cqTail }.load(std::memory_order_acquire) && !enter(1))
+            return std::nullopt;
+        if (head == std::atomic_ref { *m_cqTail }.load(std::memory_order_acquire))
+            return std::nullopt;
+
+        // A failed read needs no handling, the extractor will simply find the data uncached
+        auto userData = m_cqes[head & *m_cqMask].user_data;
+        std::atomic_ref { *m_cqHead }.store(head + 1, std::memory_order_release);
+        return userData;
+    }
+
+    /// @brief The errno io_uring_enter failed with, after which the ring is unusable; zero while it works
+    [[nodiscard]] int error() const { return m_error; }
+
+private:
+    explicit Ring(int fd)
+        : m_fd(fd)
+    {
+    }
+
+    bool map(const io_uring_params& params)
+    {
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        auto singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping)
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+        auto* sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED)
+            return false;
+        m_sqRing = sqRing;
+
+        auto* cqRing = singleMapping ? sqRing : ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED)
+            return false;
+        m_cqRing = cqRing;
+
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        auto* sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return false;
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+        auto* sq = static_cast<char*>(m_sqRing);
+        m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto* cq = static_cast<char*>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Submits everything queued since the last call and optionally waits for completions. Anything but a
+    // transient failure (e.g. EFAULT, ENXIO or EOPNOTSUPP from some kernels and seccomp profiles) is kept in m_error.
+    bool enter(unsigned minComplete)
+    {
+        while (m_error == 0) {
+            auto pending = *m_sqTail - std::atomic_ref { *m_sqHead }.load(std::memory_order_acquire);
+            auto flags = minComplete != 0 ? IORING_ENTER_GETEVENTS : 0u;
+            if (::syscall(__NR_io_uring_enter, m_fd, pending, minComplete, flags, nullptr, 0) >= 0)
+                return true;
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                m_error = errno;
+        }
+        return false;
+    }
+
+    int m_fd;
+    int m_error { 0 };
+    void* m_sqRing { nullptr };
+    std::size_t m_sqRingSize { 0 };
+    void* m_cqRing { nullptr };
+    std::size_t m_cqRingSize { 0 };
+    io_uring_sqe* m_sqes { nullptr };
+    std::size_t m_sqesSize { 0 };
+    unsigned* m_sqHead { nullptr };
+    unsigned* m_sqTail { nullptr };
+    unsigned* m_sqMask { nullptr };
+    unsigned* m_sqArray { nullptr };
+    unsigned* m_cqHead { nullptr };
+    unsigned* m_cqTail { nullptr };
+    unsigned* m_cqMask { nullptr };
+    io_uring_cqe* m_cqes { nullptr };
+};
+
+#else
+
+// Without io_uring headers every read goes through posix_fadvise
+class Prefetcher::Ring final {
+public:
+    static std::unique_ptr<Ring> create(unsigned) { return nullptr; }
+    void submitRead(int, void*, unsigned, std::uint64_t, std::uint64_t) { UNREACHABLE(); }
+    std::optional<std::uint64_t> complete(bool) { UNREACHABLE(); }
+    int error() const { UNREACHABLE(); }
+};
+
+#endif
+
+// More in flight than this only adds queueing in the block layer
+static constexpr std::size_t maxRingEntries = 4096;
+
+Prefetcher::Prefetcher(std::size_t window, std::size_t headerSize)
+    : m_headerSize(headerSize)
+{
+    ASSERT(window > 0);
+    window = std::min(window, maxRingEntries);
+    m_ring = Ring::create(static_cast<unsigned>(window));
+    if (m_ring != nullptr) {
+        m_slots.assign(window, -1);
+        m_sink = std::make_unique_for_overwrite<char[]>(m_headerSize);
+    }
+}
+
+Prefetcher::~Prefetcher()
+{
+    drain();
+}
+
+void Prefetcher::prefetch(const fs::path& path, std::uint64_t offset)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    if (m_ring == nullptr) {
+        // Starts asynchronous readahead of the range, like readahead(2), and returns immediately
+        ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(m_headerSize), POSIX_FADV_WILLNEED);
+        ::close(fd);
+        return;
+    }
+
+    reap(false);
+    if (m_inFlight == m_slots.size())
+        reap(true);
+    if (m_ring == nullptr) {
+        // reap() gave up on the ring
+        ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(m_headerSize), POSIX_FADV_WILLNEED);
+        ::close(fd);
+        return;
+    }
+
+    auto slot = static_cast<std::size_t>(std::find(ITERATORS(m_slots), -1) - m_slots.begin());
+    ASSERT(slot < m_slots.size());
+    m_slots[slot] = fd;
+    ++m_inFlight;
+    // Every read lands in the same sink, only the page cache is meant to keep the data
+    m_ring->submitRead(fd, m_sink.get(), static_cast<unsigned>(m_headerSize), offset, slot);
+    if (m_ring->error() != 0)
+        abandonRing();
+}
+
+void Prefetcher::drain()
+{
+    while (m_inFlight != 0)
+        reap(true);
+}
+
+void Prefetcher::reap(bool wait)
+{
+    while (auto slot = m_ring->complete(wait)) {
+        ASSERT(*slot < m_slots.size() && m_slots[*slot] >= 0);
+        ::close(m_slots[*slot]);
+        m_slots[*slot] = -1;
+        --m_inFlight;
+        wait = false;
+    }
+    if (m_ring->error() != 0)
+        abandonRing();
+}
+
+void Prefetcher::abandonRing()
+{
+    // Read-ahead is only an optimization, a scan must not fail over it
+    print(stderr, fg(color::yellow), "io_uring failed ({}), prefetching with posix_fadvise instead\n", std::strerror(m_ring->error()));
+    // Closing the ring cancels the reads still in flight; m_sink stays allocated until the Prefetcher goes away in
+    // case the kernel is still finishing one
+    m_ring.reset();
+    for (auto& fd : m_slots) {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+    m_inFlight = 0;
+}
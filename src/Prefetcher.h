@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "RawSource.h"
+
+/// @brief --prefetch: reads the header region of upcoming files ahead of the extractors, so their opens hit
+/// the page cache instead of waiting on a seek. Reads are submitted through io_uring, up to `window` at a time;
+/// where io_uring is unavailable (old kernels, seccomp filters) the kernel's own readahead is requested with
+/// posix_fadvise instead, also when the ring stops working halfway. Not thread-safe, one thread feeds it.
+class Prefetcher final {
+public:
+    explicit Prefetcher(std::size_t window, std::size_t headerSize = PreadDatastream::defaultWindowSize);
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    /// @brief Starts reading the header region of `path` from `offset` on (the start of an archive member),
+    /// blocks while `window` reads are still in flight. Files that can't be opened are skipped, the extractor
+    /// reports them.
+    void prefetch(const std::filesystem::path&, std::uint64_t offset = 0);
+
+    /// @brief Blocks until all submitted reads have completed
+    void drain();
+
+private:
+    class Ring;
+
+    void reap(bool wait);
+    /// @brief Falls back to posix_fadvise for good once io_uring fails, with a warning
+    void abandonRing();
+
+    std::size_t m_headerSize;
+    std::unique_ptr<Ring> m_ring {};
+    // Open descriptor of every in-flight read, indexed by slot; -1 marks a free slot
+    std::vector<int> m_slots {};
+    std::size_t m_inFlight { 0 };
+    // The data itself is never looked at, all reads share one buffer
+    std::unique_ptr<char[]> m_sink {};
+};
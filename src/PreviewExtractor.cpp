@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cstdio>
+#include <fmt/color.h>
+
+#include "PreviewExtractor.h"
+#include "RawSource.h"
+#include "TiffParser.h"
+
+namespace fs = std::filesystem;
+
+using fmt::fg, fmt::color;
+
+PreviewExtractor::PreviewExtractor(fs::path directory, const CommandlineOptions& options)
+    : m_directory(std::move(directory))
+    , m_options(options)
+    , m_raws(options.jobs)
+{
+}
+
+fs::path PreviewExtractor::target(const fs::path& path) const
+{
+    // Without the root and any leading "..", so every preview stays inside the directory
+    fs::path relative {};
+    for (auto& part : path.lexically_normal().relative_path()) {
+        if (part != "..")
+            relative /= part;
+    }
+    // Appended rather than replacing the extension, IMG_0001.CR2 and IMG_0001.CR3 would otherwise share a preview
+    relative += ".jpg";
+    return m_directory / relative;
+}
+
+bool PreviewExtractor::exists(const RawFile& file)
+{
+    std::error_code error {};
+    if (!fs::exists(target(file.path), error))
+        return false;
+    ++m_existing;
+    return true;
+}
+
+void PreviewExtractor::extract(const RawFile& file, std::size_t worker, StageTimer& timer)
+{
+    auto previewPath = target(file.path);
+    std::error_code error {};
+    // Workers race to create the same directories, whoever loses finds them there; write() reports real problems
+    fs::create_directories(previewPath.parent_path(), error);
+
+    const auto* member = file.member ? &*file.member : nullptr;
+    if (member == nullptr || !member->deflated) {
+        MappedFile mapping { member != nullptr ? member->archive : file.path };
+        auto offset = member != nullptr ? member->offset : 0;
+        auto size = member != nullptr ? member->size : mapping.size();
+        if (mapping.valid() && offset + size <= mapping.size()) {
+            if (auto preview = TiffParser::findPreview(mapping.data() + offset, size)) {
+                timer.lap(Stage::Open);
+                mapping.willNeed(offset + preview->offset, preview->length);
+                write(previewPath, mapping.data() + offset + preview->offset, preview->length);
+                timer.lap(Stage::Output);
+                return;
+            }
+        }
+    }
+
+    auto& raw = m_raws[worker];
+    if (raw == nullptr)
+        raw = std::make_unique<LibRaw>();
+    auto deadline = m_options.fileTimeout.count() != 0 ? Deadline::clock::now() + m_options.fileTimeout : Deadline::max();
+    RawSource source { file.path, m_options.ioMode, deadline, member };
+    auto opened = source.open(*raw) == LIBRAW_SUCCESS && raw->unpack_thumb() == LIBRAW_SUCCESS;
+    timer.lap(Stage::Open);
+    const auto& thumbnail = raw->imgdata.thumbnail;
+    // Bitmap thumbnails would have to be encoded first
+    if (opened && thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG && thumbnail.thumb != nullptr && thumbnail.tlength != 0)
+        write(previewPath, reinterpret_cast<const unsigned char*>(thumbnail.thumb), thumbnail.tlength);
+    else
+        ++m_missing;
+    // Must happen before `source` goes away, LibRaw may still point into it
+    raw->recycle();
+    timer.lap(Stage::Output);
+}
+
+bool PreviewExtractor::write(const fs::path& previewPath, const unsigned char* data, std::size_t size)
+{
+    auto temporary = fs::path { previewPath }.concat(".tmp");
+    auto* file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        fmt::print(stderr, fg(color::red), "Could not create {}\n", temporary.string());
+        ++m_failed;
+        return false;
+    }
+    // Straight from the caller's buffer (usually the mapped raw file), there's nothing to gain from a stdio copy
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    auto written = std::fwrite(data, 1, size, file) == size;
+    written = std::fclose(file) == 0 && written;
+
+    std::error_code error {};
+    if (written)
+        fs::rename(temporary, previewPath, error);
+    if (!written || error) {
+        fmt::print(stderr, fg(color::red), "Could not write {}\n", previewPath.string());
+        fs::remove(temporary, error);
+        ++m_failed;
+        return false;
+    }
+    ++m_written;
+    m_bytes += size;
+    return true;
+}
+
+void PreviewExtractor::print(OutputBuffer& out, ProfileClock::duration elapsed) const
+{
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    auto megabytes = static_cast<double>(m_bytes.load()) / 1e6;
+    out.print(fg(color::green), "Wrote {} {}", m_written.load(), m_written == 1 ? "preview" : "previews");
+    out.print(" ({:.1f} MB) to {} in {:.2f} s, {:.1f} MB/s\n", megabytes, m_directory.string(), seconds, seconds > 0.0 ? megabytes / seconds : 0.0);
+    if (m_existing != 0)
+        out.print("Skipped {} existing {}\n", m_existing.load(), m_existing == 1 ? "preview" : "previews");
+    if (m_missing != 0)
+        out.print(fg(color::yellow), "{} {} no embedded JPEG preview\n", m_missing.load(), m_missing == 1 ? "file has" : "files have");
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <libraw/libraw.h>
+#include <memory>
+#include <vector>
+
+#include "CommandlineOptions.h"
+#include "Discovery.h"
+#include "Output.h"
+#include "Profiler.h"
+
+/// @brief --extract-previews: writes the JPEG preview every raw file embeds, byte for byte, without decoding
+/// or re-encoding anything. TIFF-based files are copied straight out of their mapping (see
+/// TiffParser::findPreview), everything else goes through LibRaw::unpack_thumb().
+///
+/// Previews mirror the scanned paths below the output directory, `photos/2024/DSC01234.ARW` becomes
+/// `<directory>/photos/2024/DSC01234.ARW.jpg`. The raw extension stays, so files that only differ in it
+/// (`IMG_0001.CR2` and `IMG_0001.CR3`) get a preview each. Previews that already exist are skipped, so an interrupted or
+/// repeated run only writes what's missing.
+class PreviewExtractor final {
+public:
+    PreviewExtractor(std::filesystem::path directory, const CommandlineOptions& options);
+
+    /// @brief Whether the preview of `file` already exists, e.g. from an earlier run, in which case it's counted as
+    /// skipped. Meant for ScanOptions::skip, so existing previews cost a stat() instead of reading the raw file.
+    [[nodiscard]] bool exists(const RawFile& file);
+
+    /// @brief Writes the preview of `file`, charging the time to Stage::Open and Stage::Output. Thread-safe as long
+    /// as every worker passes its own index, below CommandlineOptions::jobs.
+    void extract(const RawFile& file, std::size_t worker, StageTimer& timer);
+
+    /// @brief Where the preview of the file at `path` goes
+    [[nodiscard]] std::filesystem::path target(const std::filesystem::path& path) const;
+
+    /// @brief Previews that could not be written (the error is printed as it happens)
+    [[nodiscard]] std::size_t failed() const { return m_failed; }
+
+    /// @brief Files with a preview written, skipped, missing or failed
+    [[nodiscard]] std::size_t files() const { return m_written + m_existing + m_missing + m_failed; }
+
+    /// @brief How many previews were written, skipped and missing, and the throughput over `elapsed`
+    void print(OutputBuffer&, ProfileClock::duration elapsed) const;
+
+private:
+    /// @brief Writes under a temporary name and renames it, an interrupted write never leaves a truncated
+    /// preview behind that the next run would skip
+    bool write(const std::filesystem::path& target, const unsigned char* data, std::size_t size);
+
+    std::filesystem::path m_directory;
+    const CommandlineOptions& m_options;
+    /// @brief Only files LibRaw has to open need one, created on a worker's first such file
+    std::vector<std::unique_ptr<LibRaw>> m_raws;
+    std::atomic<std::size_t> m_written { 0 };
+    std::atomic<std::size_t> m_existing { 0 };
+    std::atomic<std::size_t> m_missing { 0 };
+    std::atomic<std::size_t> m_failed { 0 };
+    std::atomic<std::uint64_t> m_bytes { 0 };
+};
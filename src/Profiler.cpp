@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <optional>
+
+#include "Profiler.h"
+#include "macros.h"
+
+namespace chrono = std::chrono;
+
+using fmt::fg, fmt::color;
+
+std::string_view stageName(Stage stage)
+{
+    switch (stage) {
+    case Stage::Queue:
+        return "queue wait";
+    case Stage::Open:
+        return "open";
+    case Stage::Extract:
+        return "extract";
+    case Stage::Aggregate:
+        return "aggregate";
+    case Stage::Format:
+        return "format";
+    case Stage::Output:
+        return "output";
+    }
+    UNREACHABLE();
+}
+
+static float toMicroseconds(ProfileClock::duration duration)
+{
+    return chrono::duration<float, std::micro>(duration).count();
+}
+
+static std::string formatMicroseconds(double microseconds)
+{
+    if (microseconds >= 1e6)
+        return fmt::format("{:.2f}s", microseconds / 1e6);
+    if (microseconds >= 1e3)
+        return fmt::format("{:.2f}ms", microseconds / 1e3);
+    return fmt::format("{:.1f}us", microseconds);
+}
+
+// Heap order that keeps the fastest of the kept files at the front
+static constexpr auto slower = [](const auto& a, const auto& b) { return a.total > b.total; };
+
+Profiler::Profiler(std::size_t slowestLimit)
+    : m_slowestLimit(slowestLimit)
+{
+}
+
+void Profiler::addFile(const std::filesystem::path& path, const StageTimes& stages)
+{
+    // Queue wait depends on how far discovery runs ahead, not on the file, so it is not part of the file's time
+    auto total = ProfileClock::duration::zero();
+    for (std::size_t stage = 0; stage < stageCount; ++stage) {
+        m_stages[stage].add(toMicroseconds(stages[stage]));
+        if (static_cast<Stage>(stage) != Stage::Queue)
+            total += stages[stage];
+    }
+    m_files.add(toMicroseconds(total));
+
+    // Most files are faster than the current cut-off, skip copying their path
+    if (m_slowest.size() < m_slowestLimit || total > m_slowest.front().total)
+        keepIfSlow({ path, stages, total });
+}
+
+void Profiler::addDirectory(ProfileClock::duration duration)
+{
+    m_directories.add(toMicroseconds(duration));
+}
+
+void Profiler::keepIfSlow(SlowFile&& file)
+{
+    if (m_slowestLimit == 0)
+        return;
+    if (m_slowest.size() == m_slowestLimit) {
+        if (file.total <= m_slowest.front().total)
+            return;
+        std::pop_heap(ITERATORS(m_slowest), slower);
+        m_slowest.pop_back();
+    }
+    m_slowest.push_back(std::move(file));
+    std::push_heap(ITERATORS(m_slowest), slower);
+}
+
+void Profiler::merge(const Profiler& other)
+{
+    for (std::size_t stage = 0; stage < stageCount; ++stage)
+        m_stages[stage].merge(other.m_stages[stage]);
+    m_files.merge(other.m_files);
+    m_directories.merge(other.m_directories);
+    for (auto file : other.m_slowest)
+        keepIfSlow(std::move(file));
+}
+
+void Profiler::print(OutputBuffer& out, ProfileClock::duration wallTime, ProfileClock::duration discoveryTime) const
+{
+    auto printRow = [&out](std::string_view name, const StreamingStats& stats, std::optional<double> share) {
+        out.print(fg(color::cyan), "\t{:<16}", name);
+        if (stats.empty()) {
+            out.print("-\n");
+            return;
+        }
+        auto total = stats.mean() * static_cast<double>(stats.count());
+        out.print("{:>10} ", formatMicroseconds(total));
+        if (share.has_value())
+            out.print(fg(color::gray), "{:>6.1f}%  ", *share * 100.0);
+        else
+            out.print("{:>9}", "");
+        out.print(fg(color::gray), "p50: ");
+        out.print("{:<10}", formatMicroseconds(stats.quantile(0.5)));
+        out.print(fg(color::gray), "p99: ");
+        out.print("{:<10}", formatMicroseconds(stats.quantile(0.99)));
+        out.print(fg(color::gray), "max: ");
+        out.print("{}\n", formatMicroseconds(stats.max()));
+    };
+
+    auto fileTotal = m_files.mean() * static_cast<double>(m_files.count());
+    out.print(fg(color::cyan), "Profile: ");
+    out.print("{} files in {} wall, directory walk {} ({} directories)\n", m_files.count(),
+        formatMicroseconds(toMicroseconds(wallTime)), formatMicroseconds(toMicroseconds(discoveryTime)), m_directories.count());
+    for (std::size_t stage = 0; stage < stageCount; ++stage) {
+        auto& stats = m_stages[stage];
+        auto total = stats.mean() * static_cast<double>(stats.count());
+        auto share = static_cast<Stage>(stage) == Stage::Queue || fileTotal <= 0 ? std::nullopt : std::optional { total / fileTotal };
+        printRow(stageName(static_cast<Stage>(stage)), stats, share);
+    }
+    printRow("per file", m_files, 1.0);
+    printRow("per directory", m_directories, std::nullopt);
+
+    if (m_slowest.empty())
+        return;
+
+    auto slowest = m_slowest;
+    std::sort(ITERATORS(slowest), slower);
+    out.print(fg(color::cyan), "Slowest files:\n");
+    for (auto& file : slowest) {
+        out.print("\t{:>10}  {}\n", formatMicroseconds(toMicroseconds(file.total)), file.path.string());
+        out.print(fg(color::gray), "\t\t");
+        for (std::size_t stage = 0; stage < stageCount; ++stage)
+            out.print(fg(color::gray), "{}{} {}", stage == 0 ? "" : ", ", stageName(static_cast<Stage>(stage)), formatMicroseconds(toMicroseconds(file.stages[stage])));
+        out.print("\n");
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "Output.h"
+#include "Statistics.h"
+
+/// @brief Phases one file goes through, in order
+enum class Stage : std::size_t {
+    /// @brief Discovered but waiting in the queue for an extraction worker
+    Queue,
+    /// @brief stat, mmap or LibRaw::open_file (which parses the headers)
+    Open,
+    /// @brief Cache lookup, TIFF fast path or copying fields out of LibRaw
+    Extract,
+    /// @brief Adding to the summary statistics and the cache
+    Aggregate,
+    /// @brief Rendering the per-file block or record
+    Format,
+    /// @brief Handing the block to the ordered writer, including any writes it triggers
+    Output,
+};
+
+constexpr std::size_t stageCount = static_cast<std::size_t>(Stage::Output) + 1;
+
+using ProfileClock = std::chrono::steady_clock;
+using StageTimes = std::array<ProfileClock::duration, stageCount>;
+
+[[nodiscard]] std::string_view stageName(Stage);
+
+/// @brief Charges elapsed time to stages: every lap() adds the time since the previous lap.
+/// Constructed without a target it never reads the clock, so the disabled case costs a branch per lap.
+class StageTimer final {
+public:
+    explicit StageTimer(StageTimes* times)
+        : m_times(times)
+    {
+        if (m_times != nullptr)
+            m_last = ProfileClock::now();
+    }
+
+    void lap(Stage stage)
+    {
+        if (m_times == nullptr)
+            return;
+        auto now = ProfileClock::now();
+        (*m_times)[static_cast<std::size_t>(stage)] += now - m_last;
+        m_last = now;
+    }
+
+    [[nodiscard]] ProfileClock::time_point start() const { return m_last; }
+
+private:
+    StageTimes* m_times;
+    ProfileClock::time_point m_last {};
+};
+
+/// @brief Per-stage latency distributions and the slowest files of a scan (--profile).
+/// A file's time is the sum of its stages after leaving the queue.
+/// Each worker fills its own instance, they are merged once the scan is done.
+class Profiler final {
+public:
+    explicit Profiler(std::size_t slowestLimit = 10);
+
+    void addFile(const std::filesystem::path&, const StageTimes&);
+    /// @brief Time spent listing one directory, not counting its subdirectories
+    void addDirectory(ProfileClock::duration);
+    void merge(const Profiler& other);
+
+    /// @param wallTime Duration of the whole scan
+    /// @param discoveryTime Duration of the directory walk, which overlaps with extraction
+    void print(OutputBuffer& out, ProfileClock::duration wallTime, ProfileClock::duration discoveryTime) const;
+
+private:
+    struct SlowFile {
+        std::filesystem::path path;
+        StageTimes stages;
+        ProfileClock::duration total;
+    };
+
+    void keepIfSlow(SlowFile&& file);
+
+    std::size_t m_slowestLimit;
+    // Latencies in microseconds
+    std::array<StreamingStats, stageCount> m_stages;
+    StreamingStats m_files {};
+    StreamingStats m_directories {};
+    // Min-heap on total time, the front is the fastest of the slowest files kept
+    std::vector<SlowFile> m_slowest {};
+};
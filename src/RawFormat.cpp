@@ -0,0 +1,56 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+
+#include "RawFormat.h"
+
+namespace fs = std::filesystem;
+
+using namespace std::string_view_literals;
+
+RawFormat sniffRawFormat(const unsigned char* data, std::size_t size)
+{
+    auto matches = [&](std::size_t offset, std::string_view magic) {
+        return size >= offset + magic.size() && std::memcmp(data + offset, magic.data(), magic.size()) == 0;
+    };
+
+    if (matches(0, "FUJIFILM"sv))
+        return RawFormat::Raf;
+    // ISO base media file with Canon's brand
+    if (matches(4, "ftypcrx "sv))
+        return RawFormat::Cr3;
+    if (matches(0, "II\x1a\0\0\0HEAPCCDR"sv))
+        return RawFormat::Crw;
+    if (matches(0, "\0MRM"sv))
+        return RawFormat::Mrw;
+    if (matches(0, "FOVb"sv))
+        return RawFormat::X3f;
+    // Phase One
+    if (matches(0, "IIII"sv))
+        return RawFormat::Iiq;
+    // Olympus and Panasonic use TIFF with their own magic number
+    if (matches(0, "IIRO"sv) || matches(0, "IIRS"sv) || matches(0, "MMOR"sv))
+        return RawFormat::Orf;
+    if (matches(0, "IIU\0"sv))
+        return RawFormat::Rw2;
+    if (matches(0, "II*\0"sv) || matches(0, "MM\0*"sv)) {
+        if (matches(8, "CR\x02"sv))
+            return RawFormat::Cr2;
+        return RawFormat::Tiff;
+    }
+    return RawFormat::Unknown;
+}
+
+RawFormat sniffRawFormat(const fs::path& path)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return RawFormat::Unknown;
+
+    std::array<unsigned char, sniffLength> head {};
+    auto size = ::pread(fd, head.data(), head.size(), 0);
+    ::close(fd);
+    return size > 0 ? sniffRawFormat(head.data(), static_cast<std::size_t>(size)) : RawFormat::Unknown;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+/// @brief Raw container formats rawinfo looks for. Tiff stands for any TIFF-based raw that can't be told
+/// apart from the others by its header alone (NEF, DNG, PEF, ...).
+enum class RawFormat : std::uint8_t {
+    Unknown,
+    Tiff,
+    Arw,
+    Cr2,
+    Cr3,
+    Crw,
+    Nef,
+    Raf,
+    Dng,
+    Orf,
+    Rw2,
+    Pef,
+    Srw,
+    Mrw,
+    X3f,
+    Iiq,
+    Kodak,
+    Hasselblad,
+    Leaf,
+};
+
+/// @brief Extensions are at most this long, which lets them be compared as one integer
+constexpr std::size_t maxExtensionLength = 4;
+
+/// @brief Lower-cased extension packed into an integer, zero if it is empty, too long or not ASCII
+constexpr std::uint32_t packExtension(std::string_view extension)
+{
+    if (extension.empty() || extension.size() > maxExtensionLength)
+        return 0;
+    std::uint32_t packed = 0;
+    for (auto c : extension) {
+        if (static_cast<unsigned char>(c) >= 0x80)
+            return 0;
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c - 'A' + 'a');
+        packed = packed << 8 | static_cast<unsigned char>(c);
+    }
+    return packed;
+}
+
+struct RawExtension {
+    std::uint32_t key;
+    RawFormat format;
+
+    constexpr RawExtension(std::string_view name, RawFormat format)
+        : key(packExtension(name))
+        , format(format)
+    {
+    }
+};
+
+/// @brief Extensions of the formats LibRaw reads, see https://www.libraw.org/supported-cameras
+constexpr std::array rawExtensions {
+    RawExtension { "arw", RawFormat::Arw },
+    RawExtension { "srf", RawFormat::Arw },
+    RawExtension { "sr2", RawFormat::Arw },
+    RawExtension { "cr2", RawFormat::Cr2 },
+    RawExtension { "cr3", RawFormat::Cr3 },
+    RawExtension { "crw", RawFormat::Crw },
+    RawExtension { "nef", RawFormat::Nef },
+    RawExtension { "nrw", RawFormat::Nef },
+    RawExtension { "raf", RawFormat::Raf },
+    RawExtension { "dng", RawFormat::Dng },
+    RawExtension { "orf", RawFormat::Orf },
+    RawExtension { "rw2", RawFormat::Rw2 },
+    RawExtension { "rwl", RawFormat::Rw2 },
+    RawExtension { "raw", RawFormat::Rw2 },
+    RawExtension { "pef", RawFormat::Pef },
+    RawExtension { "srw", RawFormat::Srw },
+    RawExtension { "mrw", RawFormat::Mrw },
+    RawExtension { "x3f", RawFormat::X3f },
+    RawExtension { "iiq", RawFormat::Iiq },
+    RawExtension { "kdc", RawFormat::Kodak },
+    RawExtension { "dcr", RawFormat::Kodak },
+    RawExtension { "3fr", RawFormat::Hasselblad },
+    RawExtension { "fff", RawFormat::Hasselblad },
+    RawExtension { "mos", RawFormat::Leaf },
+};
+
+constexpr bool rawExtensionsAreValid()
+{
+    for (std::size_t i = 0; i < rawExtensions.size(); ++i) {
+        if (rawExtensions[i].key == 0)
+            return false;
+        for (std::size_t j = i + 1; j < rawExtensions.size(); ++j) {
+            if (rawExtensions[i].key == rawExtensions[j].key)
+                return false;
+        }
+    }
+    return true;
+}
+static_assert(rawExtensionsAreValid(), "raw extensions must be unique, ASCII and at most maxExtensionLength long");
+
+/// @brief Packed extension of the last component of `filename`, zero if it has none we could match
+constexpr std::uint32_t extensionKey(std::string_view filename)
+{
+    auto dot = filename.rfind('.');
+    if (dot == std::string_view::npos || filename.find('/', dot) != std::string_view::npos)
+        return 0;
+    return packExtension(filename.substr(dot + 1));
+}
+
+/// @brief Format named by the extension of `filename`, matched case-insensitively
+constexpr RawFormat rawFormatFromFilename(std::string_view filename)
+{
+    auto key = extensionKey(filename);
+    if (key == 0)
+        return RawFormat::Unknown;
+    for (const auto& entry : rawExtensions) {
+        if (entry.key == key)
+            return entry.format;
+    }
+    return RawFormat::Unknown;
+}
+
+static_assert(rawFormatFromFilename("DSC00001.ARW") == RawFormat::Arw);
+static_assert(rawFormatFromFilename("dir.cr2/IMG_0001.cr2") == RawFormat::Cr2);
+static_assert(rawFormatFromFilename("dir.nef/notes") == RawFormat::Unknown);
+static_assert(rawFormatFromFilename("IMG_0001.JPG") == RawFormat::Unknown);
+
+/// @brief Enough bytes for every magic number sniffRawFormat() knows
+constexpr std::size_t sniffLength = 16;
+
+/// @brief Classifies a file by the first sniffLength bytes of its contents
+[[nodiscard]] RawFormat sniffRawFormat(const unsigned char* data, std::size_t size);
+
+/// @brief Reads the start of `path` (one small read) and classifies it, Unknown if it can't be read
+[[nodiscard]] RawFormat sniffRawFormat(const std::filesystem::path&);
@@ -0,0 +1,465 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "RawSource.h"
+
+namespace fs = std::filesystem;
+
+std::optional<IoMode> parseIoMode(std::string_view name)
+{
+    if (name == "libraw")
+        return IoMode::LibRaw;
+    if (name == "mmap")
+        return IoMode::Mmap;
+    if (name == "pread")
+        return IoMode::Pread;
+    return std::nullopt;
+}
+
+MappedFile::MappedFile(const fs::path& path)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st { };
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        auto size = static_cast<std::size_t>(st.st_size);
+        auto* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // LibRaw jumps between IFDs, sequential readahead would mostly fetch pixel data we never look at
+            ::madvise(mapping, size, MADV_RANDOM);
+            m_data = static_cast<const unsigned char*>(mapping);
+            m_size = size;
+        }
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != nullptr)
+        ::munmap(const_cast<unsigned char*>(m_data), m_size);
+}
+
+void MappedFile::willNeed(std::size_t offset, std::size_t length) const
+{
+    if (m_data == nullptr || offset >= m_size)
+        return;
+    // madvise wants a page-aligned start
+    auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto start = offset / page * page;
+    ::madvise(const_cast<unsigned char*>(m_data) + start, std::min(offset + length, m_size) - start, MADV_WILLNEED);
+}
+
+static std::size_t preadAll(int fd, unsigned char* out, std::size_t count, std::int64_t offset)
+{
+    std::size_t total = 0;
+    while (total < count) {
+        auto got = ::pread(fd, out + total, count - total, static_cast<off_t>(offset + total));
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        total += static_cast<std::size_t>(got);
+    }
+    return total;
+}
+
+CopyingDatastream::CopyingDatastream(std::string name)
+    : m_name(std::move(name))
+{
+}
+
+int CopyingDatastream::read(void* ptr, size_t size, size_t nmemb)
+{
+    if (size == 0)
+        return 0;
+
+    auto* out = static_cast<unsigned char*>(ptr);
+    auto wanted = size * nmemb;
+    std::size_t total = 0;
+    while (total < wanted) {
+        auto copied = copyAt(out + total, wanted - total);
+        if (copied == 0)
+            break;
+        total += copied;
+        m_position += static_cast<std::int64_t>(copied);
+    }
+    return static_cast<int>(total / size);
+}
+
+int CopyingDatastream::seek(INT64 offset, int whence)
+{
+    switch (whence) {
+    case SEEK_SET:
+        m_position = offset;
+        break;
+    case SEEK_CUR:
+        m_position += offset;
+        break;
+    case SEEK_END:
+        m_position = m_size + offset;
+        break;
+    default:
+        return -1;
+    }
+    m_position = std::clamp<std::int64_t>(m_position, 0, m_size);
+    return 0;
+}
+
+INT64 CopyingDatastream::tell()
+{
+    return m_position;
+}
+
+INT64 CopyingDatastream::size()
+{
+    return m_size;
+}
+
+int CopyingDatastream::get_char()
+{
+    unsigned char value {};
+    if (copyAt(&value, 1) != 1)
+        return -1;
+    ++m_position;
+    return value;
+}
+
+char* CopyingDatastream::gets(char* str, int size)
+{
+    if (size <= 0 || m_position >= m_size)
+        return nullptr;
+
+    int length = 0;
+    while (length < size - 1) {
+        auto c = get_char();
+        if (c < 0)
+            break;
+        str[length++] = static_cast<char>(c);
+        if (c == '\n')
+            break;
+    }
+    str[length] = '\0';
+    return str;
+}
+
+int CopyingDatastream::scanf_one(const char* format, void* value)
+{
+    // Same contract as LibRaw's buffer datastream: parse one token, then skip past it
+    char token[32] {};
+    auto start = m_position;
+    auto copied = copyAt(reinterpret_cast<unsigned char*>(token), sizeof(token) - 1);
+    if (copied == 0)
+        return 0;
+
+    auto result = std::sscanf(token, format, value);
+    if (result > 0) {
+        std::size_t skipped = 0;
+        while (skipped < copied) {
+            ++skipped;
+            auto c = skipped < copied ? token[skipped] : '\0';
+            if (c == '\0' || c == ' ' || c == '\t' || c == '\n' || skipped > 24)
+                break;
+        }
+        m_position = std::min(start + static_cast<std::int64_t>(skipped), m_size);
+    }
+    return result;
+}
+
+int CopyingDatastream::eof()
+{
+    return m_position >= m_size;
+}
+
+const char* CopyingDatastream::fname()
+{
+    return m_name.c_str();
+}
+
+PreadDatastream::PreadDatastream(const fs::path& path, std::size_t windowSize)
+    : CopyingDatastream(path.string())
+{
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+        return;
+
+    struct stat st { };
+    if (::fstat(m_fd, &st) != 0) {
+        ::close(m_fd);
+        m_fd = -1;
+        return;
+    }
+    m_size = st.st_size;
+    readWindow(windowSize);
+}
+
+PreadDatastream::PreadDatastream(const fs::path& file, std::int64_t offset, std::int64_t size, std::string name, std::size_t windowSize)
+    : CopyingDatastream(std::move(name))
+    , m_offset(offset)
+{
+    m_fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+        return;
+    m_size = size;
+    readWindow(windowSize);
+}
+
+void PreadDatastream::readWindow(std::size_t windowSize)
+{
+    ::posix_fadvise(m_fd, m_offset, m_size, POSIX_FADV_RANDOM);
+    m_window.resize(std::min(windowSize, static_cast<std::size_t>(m_size)));
+    m_window.resize(preadAll(m_fd, m_window.data(), m_window.size(), m_offset));
+}
+
+PreadDatastream::~PreadDatastream()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+int PreadDatastream::valid()
+{
+    return m_fd >= 0;
+}
+
+std::size_t PreadDatastream::copyAt(unsigned char* out, std::size_t count)
+{
+    if (m_position >= m_size)
+        return 0;
+    count = std::min(count, static_cast<std::size_t>(m_size - m_position));
+
+    if (m_position < static_cast<std::int64_t>(m_window.size())) {
+        auto available = std::min(count, m_window.size() - static_cast<std::size_t>(m_position));
+        std::memcpy(out, m_window.data() + m_position, available);
+        return available;
+    }
+
+    // Large reads past the window (e.g. embedded previews) bypass the block cache
+    if (count >= blockSize)
+        return preadAll(m_fd, out, count, m_offset + m_position);
+
+    auto blockOffset = m_position - m_position % static_cast<std::int64_t>(blockSize);
+    if (blockOffset != m_blockOffset) {
+        m_block.resize(std::min(blockSize, static_cast<std::size_t>(m_size - blockOffset)));
+        m_block.resize(preadAll(m_fd, m_block.data(), m_block.size(), m_offset + blockOffset));
+        m_blockOffset = blockOffset;
+    }
+    auto inBlock = static_cast<std::size_t>(m_position - blockOffset);
+    if (inBlock >= m_block.size())
+        return 0;
+    auto available = std::min(count, m_block.size() - inBlock);
+    std::memcpy(out, m_block.data() + inBlock, available);
+    return available;
+}
+
+#ifdef RAWINFO_HAVE_ZLIB
+
+InflateDatastream::InflateDatastream(const ArchiveMember& member, std::string name)
+    : CopyingDatastream(std::move(name))
+    , m_offset(static_cast<std::int64_t>(member.offset))
+    , m_storedSize(static_cast<std::int64_t>(member.storedSize))
+{
+    m_size = static_cast<std::int64_t>(member.size);
+    m_fd = ::open(member.archive.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+        return;
+
+    m_zlib = std::make_unique<z_stream>();
+    // Zip members are raw deflate streams, without a zlib header
+    if (inflateInit2(m_zlib.get(), -MAX_WBITS) != Z_OK) {
+        m_zlib.reset();
+        return;
+    }
+    m_input.resize(chunkSize);
+}
+
+InflateDatastream::~InflateDatastream()
+{
+    if (m_zlib != nullptr)
+        inflateEnd(m_zlib.get());
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+int InflateDatastream::valid()
+{
+    return m_fd >= 0 && m_zlib != nullptr;
+}
+
+bool InflateDatastream::inflateTo(std::size_t end)
+{
+    end = std::min(end, static_cast<std::size_t>(m_size));
+    while (m_data.size() < end && !m_finished) {
+        if (m_zlib->avail_in == 0) {
+            auto wanted = static_cast<std::size_t>(std::min<std::int64_t>(chunkSize, m_storedSize - m_consumed));
+            auto got = preadAll(m_fd, m_input.data(), wanted, m_offset + m_consumed);
+            if (got == 0)
+                return false;
+            m_consumed += static_cast<std::int64_t>(got);
+            m_zlib->next_in = m_input.data();
+            m_zlib->avail_in = static_cast<uInt>(got);
+        }
+
+        // Grow in steps of at least a chunk, LibRaw's reads are mostly a few bytes
+        auto used = m_data.size();
+        m_data.resize(std::min(std::max(end, used + chunkSize), static_cast<std::size_t>(m_size)));
+        m_zlib->next_out = m_data.data() + used;
+        m_zlib->avail_out = static_cast<uInt>(m_data.size() - used);
+        auto result = inflate(m_zlib.get(), Z_NO_FLUSH);
+        m_data.resize(m_data.size() - m_zlib->avail_out);
+        if (result == Z_STREAM_END)
+            m_finished = true;
+        else if (result != Z_OK && result != Z_BUF_ERROR)
+            return false;
+    }
+    return m_data.size() >= end;
+}
+
+std::size_t InflateDatastream::copyAt(unsigned char* out, std::size_t count)
+{
+    if (m_position >= m_size)
+        return 0;
+    auto position = static_cast<std::size_t>(m_position);
+    count = std::min(count, static_cast<std::size_t>(m_size) - position);
+    inflateTo(position + count);
+    if (position >= m_data.size())
+        return 0;
+
+    auto available = std::min(count, m_data.size() - position);
+    std::memcpy(out, m_data.data() + position, available);
+    return available;
+}
+
+#endif
+
+namespace {
+
+/// @brief Fails every read of the wrapped datastream once the deadline has passed. LibRaw runs no progress
+/// callbacks while it opens a file, so its reads are the only place a slow file can be cancelled. The exception
+/// is the one LibRaw's own callbacks cancel with; open_datastream() turns it into LIBRAW_CANCELLED_BY_CALLBACK.
+template <typename Stream>
+class DeadlineDatastream final : public Stream {
+public:
+    template <typename... Args>
+    DeadlineDatastream(Deadline deadline, bool& timedOut, Args&&... args)
+        : Stream(std::forward<Args>(args)...)
+        , m_deadline(deadline)
+        , m_timedOut(timedOut)
+    {
+    }
+
+    int read(void* ptr, size_t size, size_t nmemb) override
+    {
+        check();
+        return Stream::read(ptr, size, nmemb);
+    }
+
+    int seek(INT64 offset, int whence) override
+    {
+        check();
+        return Stream::seek(offset, whence);
+    }
+
+private:
+    // Most of LibRaw's reads are a few bytes, reading the clock for each would cost more than the reads
+    static constexpr unsigned checkInterval = 16;
+
+    void check()
+    {
+        if (!m_timedOut && (m_calls++ % checkInterval != 0 || std::chrono::steady_clock::now() < m_deadline))
+            return;
+        m_timedOut = true;
+        throw LIBRAW_EXCEPTION_CANCELLED_BY_CALLBACK;
+    }
+
+    Deadline m_deadline;
+    bool& m_timedOut;
+    unsigned m_calls { 0 };
+};
+
+}
+
+RawSource::RawSource(fs::path path, IoMode mode, Deadline deadline, const ArchiveMember* member)
+    : m_path(std::move(path))
+    , m_mode(mode)
+    , m_deadline(deadline)
+    , m_member(member)
+{
+}
+
+template <typename Stream, typename... Args>
+void RawSource::makeStream(Args&&... args)
+{
+    if (m_deadline == Deadline::max())
+        m_stream = std::make_unique<Stream>(std::forward<Args>(args)...);
+    else
+        m_stream = std::make_unique<DeadlineDatastream<Stream>>(m_deadline, m_timedOut, std::forward<Args>(args)...);
+}
+
+int RawSource::open(LibRaw& raw)
+{
+    if (m_member != nullptr) {
+        if (!m_member->deflated) {
+            makeStream<PreadDatastream>(m_member->archive, static_cast<std::int64_t>(m_member->offset), static_cast<std::int64_t>(m_member->size), m_path.string());
+        } else {
+#ifdef RAWINFO_HAVE_ZLIB
+            makeStream<InflateDatastream>(*m_member, m_path.string());
+#else
+            return LIBRAW_NOT_IMPLEMENTED;
+#endif
+        }
+        return openStream(raw);
+    }
+
+    if (m_deadline == Deadline::max()) {
+        switch (m_mode) {
+        case IoMode::LibRaw:
+            return raw.open_file(m_path.c_str());
+        case IoMode::Mmap:
+            m_mapping = std::make_unique<MappedFile>(m_path);
+            if (!m_mapping->valid())
+                return LIBRAW_IO_ERROR;
+            return raw.open_buffer(m_mapping->data(), m_mapping->size());
+        case IoMode::Pread:
+            makeStream<PreadDatastream>(m_path);
+            return openStream(raw);
+        }
+        return LIBRAW_UNSPECIFIED_ERROR;
+    }
+
+    // With a deadline every mode reads through a datastream that can cancel, LibRaw's own included
+    switch (m_mode) {
+    case IoMode::LibRaw:
+        makeStream<LibRaw_bigfile_datastream>(m_path.c_str());
+        break;
+    case IoMode::Mmap:
+        m_mapping = std::make_unique<MappedFile>(m_path);
+        if (!m_mapping->valid())
+            return LIBRAW_IO_ERROR;
+        makeStream<LibRaw_buffer_datastream>(m_mapping->data(), m_mapping->size());
+        break;
+    case IoMode::Pread:
+        makeStream<PreadDatastream>(m_path);
+        break;
+    }
+    return openStream(raw);
+}
+
+int RawSource::openStream(LibRaw& raw)
+{
+    if (m_stream == nullptr || !m_stream->valid())
+        return LIBRAW_IO_ERROR;
+    try {
+        return raw.open_datastream(m_stream.get());
+    } catch (LibRaw_exceptions) {
+        // Builds that don't catch it in open_datastream() hand the cancellation through
+        return LIBRAW_CANCELLED_BY_CALLBACK;
+    }
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <libraw/libraw.h>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+#ifdef RAWINFO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "Archive.h"
+
+/// @brief How raw files are read before LibRaw parses them
+enum class IoMode {
+    /// @brief LibRaw's own buffered file stream (LibRaw::open_file)
+    LibRaw,
+    /// @brief Memory-map the whole file, only the pages LibRaw touches are faulted in
+    Mmap,
+    /// @brief One large pread of the header window, anything past it is read on demand
+    Pread,
+};
+
+[[nodiscard]] std::optional<IoMode> parseIoMode(std::string_view);
+
+/// @brief Point in time after which reading a file is given up, Deadline::max() never expires
+using Deadline = std::chrono::steady_clock::time_point;
+
+/// @brief Read-only memory mapping of a whole file
+class MappedFile final {
+public:
+    explicit MappedFile(const std::filesystem::path&);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] bool valid() const { return m_data != nullptr; }
+    [[nodiscard]] const unsigned char* data() const { return m_data; }
+    [[nodiscard]] std::size_t size() const { return m_size; }
+
+    /// @brief Has the kernel read a range ahead in one go, for data that is about to be copied out whole
+    void willNeed(std::size_t offset, std::size_t length) const;
+
+private:
+    const unsigned char* m_data { nullptr };
+    std::size_t m_size { 0 };
+};
+
+/// @brief LibRaw's stdio-like datastream interface implemented on top of a single primitive that copies the
+/// bytes at the current position. Subclasses set m_size and provide copyAt().
+class CopyingDatastream : public LibRaw_abstract_datastream {
+public:
+    int read(void* ptr, size_t size, size_t nmemb) override;
+    int seek(INT64 offset, int whence) override;
+    INT64 tell() override;
+    INT64 size() override;
+    int get_char() override;
+    char* gets(char* str, int size) override;
+    int scanf_one(const char* format, void* value) override;
+    int eof() override;
+    const char* fname() override;
+
+protected:
+    explicit CopyingDatastream(std::string name);
+
+    // Copies up to `count` bytes at m_position into `out` without moving, returns the number copied
+    virtual std::size_t copyAt(unsigned char* out, std::size_t count) = 0;
+
+    std::string m_name {};
+    std::int64_t m_size { 0 };
+    std::int64_t m_position { 0 };
+};
+
+/// @brief LibRaw datastream that serves a file from a header window fetched with a single pread.
+/// Reads outside the window go through a small block cache, so scattered tag lookups don't turn into
+/// one syscall per byte.
+class PreadDatastream : public CopyingDatastream {
+public:
+    static constexpr std::size_t defaultWindowSize = 512 * 1024;
+
+    explicit PreadDatastream(const std::filesystem::path&, std::size_t windowSize = defaultWindowSize);
+    /// @brief Serves `size` bytes at `offset` of `file` as if they were a file of their own, e.g. an archive member
+    PreadDatastream(const std::filesystem::path& file, std::int64_t offset, std::int64_t size, std::string name, std::size_t windowSize = defaultWindowSize);
+    ~PreadDatastream() override;
+
+    int valid() override;
+
+protected:
+    std::size_t copyAt(unsigned char* out, std::size_t count) override;
+
+private:
+    static constexpr std::size_t blockSize = 64 * 1024;
+
+    void readWindow(std::size_t windowSize);
+
+    int m_fd { -1 };
+    std::int64_t m_offset { 0 };
+    std::vector<unsigned char> m_window {};
+    std::vector<unsigned char> m_block {};
+    std::int64_t m_blockOffset { -1 };
+};
+
+#ifdef RAWINFO_HAVE_ZLIB
+/// @brief Serves a deflated archive member, inflating it only as far as LibRaw has read into it.
+/// Metadata sits near the start of a raw file, so most of the compressed data is never even read.
+class InflateDatastream : public CopyingDatastream {
+public:
+    InflateDatastream(const ArchiveMember&, std::string name);
+    ~InflateDatastream() override;
+
+    int valid() override;
+
+protected:
+    std::size_t copyAt(unsigned char* out, std::size_t count) override;
+
+private:
+    static constexpr std::size_t chunkSize = 64 * 1024;
+
+    // Inflates until `end` bytes are available or the member is done, returns false on corrupt data
+    bool inflateTo(std::size_t end);
+
+    int m_fd { -1 };
+    std::int64_t m_offset { 0 };
+    std::int64_t m_storedSize { 0 };
+    std::int64_t m_consumed { 0 };
+    std::unique_ptr<z_stream> m_zlib {};
+    bool m_finished { false };
+    std::vector<unsigned char> m_input {};
+    std::vector<unsigned char> m_data {};
+};
+#endif
+
+/// @brief Owns whatever backs a LibRaw instance for one file (mapping or datastream) in the selected IoMode.
+/// Must outlive every use of the LibRaw instance it opened.
+class RawSource final {
+public:
+    /// @param deadline If set, reads past it cancel open(), which then returns LIBRAW_CANCELLED_BY_CALLBACK
+    /// @param member If set, `path` is only the reported name and the data comes from this archive member,
+    /// always through a datastream regardless of the IoMode
+    RawSource(std::filesystem::path, IoMode, Deadline deadline = Deadline::max(), const ArchiveMember* member = nullptr);
+
+    /// @brief Opens the file in `raw`, returns a LibRaw error code
+    [[nodiscard]] int open(LibRaw& raw);
+
+    /// @brief Whether open() was cancelled by the deadline
+    [[nodiscard]] bool timedOut() const { return m_timedOut; }
+
+private:
+    // Sets m_stream, wrapped to enforce the deadline if there is one
+    template <typename Stream, typename... Args>
+    void makeStream(Args&&...);
+    int openStream(LibRaw&);
+
+    std::filesystem::path m_path {};
+    IoMode m_mode {};
+    Deadline m_deadline {};
+    const ArchiveMember* m_member { nullptr };
+    bool m_timedOut { false };
+    std::unique_ptr<MappedFile> m_mapping {};
+    // Declared after the mapping, a buffer datastream must go away before the memory it reads
+    std::unique_ptr<LibRaw_abstract_datastream> m_stream {};
+};
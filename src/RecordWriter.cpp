@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "FormatUtils.h"
+#include "RecordWriter.h"
+
+namespace fs = std::filesystem;
+
+static constexpr char columnarMagic[8] = { 'R', 'A', 'W', 'I', 'N', 'F', 'O', 'B' };
+static constexpr std::uint32_t columnarVersion = 1;
+static constexpr std::size_t columnAlignment = 64;
+static_assert(sizeof(ColumnarWriter::FileHeader) == 24, "FileHeader must not contain padding");
+static_assert(sizeof(ColumnarWriter::ColumnDescriptor) == 48, "ColumnDescriptor must not contain padding");
+// Headers and columns are written straight from memory, readers expect little-endian files
+static_assert(std::endian::native == std::endian::little, "The columnar format is only written on little-endian hosts");
+
+std::optional<OutputFormat> parseOutputFormat(std::string_view name)
+{
+    if (name == "text")
+        return OutputFormat::Text;
+    if (name == "jsonl")
+        return OutputFormat::JsonLines;
+    if (name == "csv")
+        return OutputFormat::Csv;
+    if (name == "bin")
+        return OutputFormat::Binary;
+    return std::nullopt;
+}
+
+static void writeJsonString(OutputBuffer& out, std::string_view value)
+{
+    out.append('"');
+    for (auto c : value) {
+        switch (c) {
+        case '"':
+            out.append("\\\"");
+            break;
+        case '\\':
+            out.append("\\\\");
+            break;
+        case '\n':
+            out.append("\\n");
+            break;
+        case '\r':
+            out.append("\\r");
+            break;
+        case '\t':
+            out.append("\\t");
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+                out.print("\\u{:04x}", static_cast<unsigned>(c));
+            else
+                out.append(c);
+            break;
+        }
+    }
+    out.append('"');
+}
+
+static void writeJsonNumber(OutputBuffer& out, float value)
+{
+    // JSON has no representation for NaN or infinities
+    if (std::isfinite(value))
+        out.print("{}", value);
+    else
+        out.append("null");
+}
+
+static void writeCsvString(OutputBuffer& out, std::string_view value)
+{
+    out.append('"');
+    for (auto c : value) {
+        if (c == '"')
+            out.append('"');
+        out.append(c);
+    }
+    out.append('"');
+}
+
+void RecordWriter::writeCsvHeader(OutputBuffer& out)
+{
+    out.append("path,timestamp,iso_speed,shutter,aperture,focal_len,width,height,raw_width,raw_height,"
+               "make,model,software,lens_make,lens,lens_id,lens_serial,body_serial,maker_index,camera_type,quality\n");
+}
+
+void RecordWriter::writeCsv(OutputBuffer& out, const fs::path& path, const PhotoRecord& record)
+{
+    writeCsvString(out, path.native());
+    out.print(",{},{},{},{},{},{},{},{},{},", record.timestamp, record.iso_speed, record.shutter, record.aperture, record.focal_len,
+        record.width, record.height, record.raw_width, record.raw_height);
+    writeCsvString(out, record.make);
+    out.append(',');
+    writeCsvString(out, record.model);
+    out.append(',');
+    writeCsvString(out, record.software);
+    out.append(',');
+    writeCsvString(out, record.lens_make);
+    out.append(',');
+    writeCsvString(out, record.lens);
+    out.print(",{},", record.lens_id);
+    writeCsvString(out, record.lens_serial);
+    out.append(',');
+    writeCsvString(out, record.body_serial);
+    out.print(",{},{},{}\n", record.maker_index, record.camera_type, record.quality);
+}
+
+void RecordWriter::writeJson(OutputBuffer& out, const fs::path& path, const PhotoRecord& record)
+{
+    out.append("{\"path\":");
+    writeJsonString(out, path.native());
+    out.print(",\"timestamp\":{},\"iso_speed\":", record.timestamp);
+    writeJsonNumber(out, record.iso_speed);
+    out.append(",\"shutter\":");
+    writeJsonNumber(out, record.shutter);
+    out.append(",\"aperture\":");
+    writeJsonNumber(out, record.aperture);
+    out.append(",\"focal_len\":");
+    writeJsonNumber(out, record.focal_len);
+    out.print(",\"width\":{},\"height\":{},\"raw_width\":{},\"raw_height\":{},\"make\":", record.width, record.height, record.raw_width, record.raw_height);
+    writeJsonString(out, record.make);
+    out.append(",\"model\":");
+    writeJsonString(out, record.model);
+    out.append(",\"software\":");
+    writeJsonString(out, record.software);
+    out.append(",\"lens_make\":");
+    writeJsonString(out, record.lens_make);
+    out.append(",\"lens\":");
+    writeJsonString(out, record.lens);
+    out.print(",\"lens_id\":{},\"lens_serial\":", record.lens_id);
+    writeJsonString(out, record.lens_serial);
+    out.append(",\"body_serial\":");
+    writeJsonString(out, record.body_serial);
+    out.print(",\"maker_index\":{},\"camera_type\":{},\"quality\":{}}}\n", record.maker_index, record.camera_type, record.quality);
+}
+
+std::uint32_t ColumnarWriter::Dictionary::intern(const std::string& value)
+{
+    auto [it, inserted] = ids.try_emplace(value, static_cast<std::uint32_t>(ids.size()));
+    if (inserted)
+        names.push(value);
+    return it->second;
+}
+
+void ColumnarWriter::add(std::size_t index, const fs::path& path, const PhotoRecord& record)
+{
+    std::scoped_lock lock { m_mutex };
+
+    m_index.push_back(index);
+    m_timestamps.push_back(record.timestamp);
+    m_isoSpeeds.push_back(record.iso_speed);
+    m_shutterSpeeds.push_back(record.shutter);
+    m_focalLengths.push_back(record.focal_len);
+    m_apertureValues.push_back(record.aperture);
+    m_resolutions.push_back(static_cast<float>(record.width * record.height));
+    m_widths.push_back(record.width);
+    m_heights.push_back(record.height);
+    m_lensIds.push_back(record.lens_id);
+    m_paths.push(path.native());
+
+    // Reused key buffer, lookups of known names don't allocate
+    m_key.assign(record.make).append(" ").append(record.model);
+    m_cameras.push_back(m_cameraNames.intern(m_key));
+    m_scratch.clear();
+    FormatUtils::appendLens(fmt::appender(m_scratch), record.lens_make, record.lens);
+    m_key.assign(m_scratch.data(), m_scratch.size());
+    m_lenses.push_back(m_lensNames.intern(m_key));
+}
+
+namespace {
+
+struct PendingColumn {
+    std::string name;
+    ColumnarWriter::ColumnType type;
+    std::uint32_t elementSize;
+    const void* data;
+    std::uint64_t size;
+};
+
+template <typename T>
+std::vector<T> permute(const std::vector<T>& column, const std::vector<std::size_t>& order)
+{
+    std::vector<T> sorted {};
+    sorted.reserve(column.size());
+    for (auto row : order)
+        sorted.push_back(column[row]);
+    return sorted;
+}
+
+std::size_t alignUp(std::size_t value)
+{
+    return (value + columnAlignment - 1) / columnAlignment * columnAlignment;
+}
+
+}
+
+void ColumnarWriter::write(std::FILE* stream)
+{
+    std::scoped_lock lock { m_mutex };
+
+    // Workers add rows in completion order; the file is in discovery order
+    std::vector<std::size_t> order(m_index.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](auto a, auto b) { return m_index[a] < m_index[b]; });
+
+    auto timestamps = permute(m_timestamps, order);
+    auto isoSpeeds = permute(m_isoSpeeds, order);
+    auto shutterSpeeds = permute(m_shutterSpeeds, order);
+    auto focalLengths = permute(m_focalLengths, order);
+    auto apertureValues = permute(m_apertureValues, order);
+    auto resolutions = permute(m_resolutions, order);
+    auto widths = permute(m_widths, order);
+    auto heights = permute(m_heights, order);
+    auto lensIds = permute(m_lensIds, order);
+    auto cameras = permute(m_cameras, order);
+    auto lenses = permute(m_lenses, order);
+    StringColumn paths {};
+    for (auto row : order)
+        paths.push(std::string_view { m_paths.data }.substr(m_paths.offsets[row], m_paths.offsets[row + 1] - m_paths.offsets[row]));
+
+    std::vector<PendingColumn> columns {};
+    auto addColumn = [&]<typename T>(std::string name, ColumnType type, const std::vector<T>& values) {
+        columns.push_back({ std::move(name), type, sizeof(T), values.data(), values.size() * sizeof(T) });
+    };
+    auto addStrings = [&](const std::string& name, const StringColumn& column) {
+        addColumn(name + ".offsets", ColumnType::U64, column.offsets);
+        columns.push_back({ name + ".data", ColumnType::Bytes, 1, column.data.data(), column.data.size() });
+    };
+    addColumn("timestamp", ColumnType::I64, timestamps);
+    addColumn("iso_speed", ColumnType::F32, isoSpeeds);
+    addColumn("shutter_speed", ColumnType::F32, shutterSpeeds);
+    addColumn("focal_length", ColumnType::F32, focalLengths);
+    addColumn("aperture", ColumnType::F32, apertureValues);
+    addColumn("resolution", ColumnType::F32, resolutions);
+    addColumn("width", ColumnType::U16, widths);
+    addColumn("height", ColumnType::U16, heights);
+    addColumn("lens_id", ColumnType::U64, lensIds);
+    addColumn("camera", ColumnType::U32, cameras);
+    addColumn("lens", ColumnType::U32, lenses);
+    addStrings("path", paths);
+    addStrings("camera.dict", m_cameraNames.names);
+    addStrings("lens.dict", m_lensNames.names);
+
+    FileHeader header {};
+    std::memcpy(header.magic, columnarMagic, sizeof(columnarMagic));
+    header.version = columnarVersion;
+    header.column_count = static_cast<std::uint32_t>(columns.size());
+    header.row_count = order.size();
+
+    std::vector<ColumnDescriptor> descriptors(columns.size());
+    auto offset = alignUp(sizeof(FileHeader) + descriptors.size() * sizeof(ColumnDescriptor));
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+        auto& descriptor = descriptors[i];
+        std::strncpy(descriptor.name, columns[i].name.c_str(), sizeof(descriptor.name) - 1);
+        descriptor.type = columns[i].type;
+        descriptor.element_size = columns[i].elementSize;
+        descriptor.offset = offset;
+        descriptor.size = columns[i].size;
+        offset = alignUp(offset + columns[i].size);
+    }
+
+    static constexpr char padding[columnAlignment] {};
+    std::size_t written = 0;
+    auto put = [&](const void* data, std::size_t size) {
+        std::fwrite(data, 1, size, stream);
+        written += size;
+    };
+    auto pad = [&] { put(padding, alignUp(written) - written); };
+
+    put(&header, sizeof(header));
+    put(descriptors.data(), descriptors.size() * sizeof(ColumnDescriptor));
+    for (auto& column : columns) {
+        pad();
+        put(column.data, column.size);
+    }
+    pad();
+    std::fflush(stream);
+}
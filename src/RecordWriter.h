@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Output.h"
+#include "PhotoRecord.h"
+
+enum class OutputFormat {
+    /// @brief Human-readable per-file blocks and summary
+    Text,
+    /// @brief One JSON object per line and file
+    JsonLines,
+    /// @brief RFC 4180 CSV with a header row
+    Csv,
+    /// @brief Columnar binary file, see ColumnarWriter
+    Binary,
+};
+
+[[nodiscard]] std::optional<OutputFormat> parseOutputFormat(std::string_view);
+
+/// @brief Machine-readable per-file records with the raw (unrounded) values.
+/// Rows are appended to an OutputBuffer, so they go through the same ordered output as text blocks.
+class RecordWriter final {
+public:
+    static void writeCsvHeader(OutputBuffer&);
+    static void writeCsv(OutputBuffer&, const std::filesystem::path&, const PhotoRecord&);
+    static void writeJson(OutputBuffer&, const std::filesystem::path&, const PhotoRecord&);
+};
+
+/// @brief Accumulates records column by column and writes them as one columnar file.
+///
+/// Layout (host byte order, only little-endian hosts are supported): a FileHeader, `column_count`
+/// ColumnDescriptors, then every column as one contiguous array starting on a 64-byte boundary, so the file can be
+/// mapped and scanned column-wise.
+/// Numeric columns mirror Data; `camera` and `lens` are dictionary ids into string columns, strings are stored
+/// as `<name>.offsets` (u64, rows + 1 entries) plus `<name>.data` (bytes). Rows are in discovery order.
+class ColumnarWriter final {
+public:
+    enum class ColumnType : std::uint32_t {
+        I64 = 1,
+        F32 = 2,
+        U16 = 3,
+        U32 = 4,
+        U64 = 5,
+        Bytes = 6,
+    };
+
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t column_count;
+        std::uint64_t row_count;
+    };
+
+    struct ColumnDescriptor {
+        char name[24];
+        ColumnType type;
+        std::uint32_t element_size;
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    /// @brief Thread-safe
+    void add(std::size_t index, const std::filesystem::path&, const PhotoRecord&);
+
+    void write(std::FILE*);
+
+private:
+    struct StringColumn {
+        std::vector<std::uint64_t> offsets { 0 };
+        std::string data {};
+
+        void push(std::string_view value)
+        {
+            data.append(value);
+            offsets.push_back(data.size());
+        }
+    };
+
+    struct Dictionary {
+        std::unordered_map<std::string, std::uint32_t> ids {};
+        StringColumn names {};
+
+        std::uint32_t intern(const std::string& value);
+    };
+
+    std::mutex m_mutex {};
+    std::vector<std::uint64_t> m_index {};
+    std::vector<std::int64_t> m_timestamps {};
+    std::vector<float> m_isoSpeeds {};
+    std::vector<float> m_shutterSpeeds {};
+    std::vector<float> m_focalLengths {};
+    std::vector<float> m_apertureValues {};
+    std::vector<float> m_resolutions {};
+    std::vector<std::uint16_t> m_widths {};
+    std::vector<std::uint16_t> m_heights {};
+    std::vector<std::uint64_t> m_lensIds {};
+    std::vector<std::uint32_t> m_cameras {};
+    std::vector<std::uint32_t> m_lenses {};
+    StringColumn m_paths {};
+    Dictionary m_cameraNames {};
+    Dictionary m_lensNames {};
+    std::string m_key {};
+    fmt::memory_buffer m_scratch {};
+};
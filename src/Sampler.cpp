@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Sampler.h"
+#include "macros.h"
+
+// Multiples of an irrational number fill [0, 1) more evenly than any other rotation, see the three-gap theorem
+static constexpr double goldenRatioConjugate = 0.6180339887498949;
+
+Sampler::Sampler(double fraction, std::size_t count)
+    : m_fraction(fraction)
+    , m_count(count)
+{
+    ASSERT((fraction > 0.0 && fraction <= 1.0) != (count != 0));
+}
+
+double Sampler::key(const RawFile& file)
+{
+    auto [it, inserted] = m_strata.try_emplace(file.path.parent_path().native(), Stratum { 0.0, 0 });
+    auto& stratum = it->second;
+    if (inserted)
+        stratum.offset = std::uniform_real_distribution<double> {}(m_random);
+
+    auto key = stratum.offset + static_cast<double>(stratum.files++) * goldenRatioConjugate;
+    return key - std::floor(key);
+}
+
+void Sampler::pass(RawFile&& file, BoundedQueue<RawFile>& output)
+{
+    // Output is written in index order, which must not have gaps
+    file.index = m_sampled++;
+    output.push(std::move(file));
+}
+
+void Sampler::run(BoundedQueue<RawFile>& input, BoundedQueue<RawFile>& output)
+{
+    auto byKey = [](const Candidate& a, const Candidate& b) { return a.key < b.key; };
+    while (auto file = input.pop()) {
+        ++m_population;
+        auto fileKey = key(*file);
+        if (m_count == 0) {
+            if (fileKey < m_fraction)
+                pass(std::move(*file), output);
+            continue;
+        }
+
+        if (m_reservoir.size() == m_count) {
+            if (fileKey >= m_reservoir.front().key)
+                continue;
+            std::pop_heap(ITERATORS(m_reservoir), byKey);
+            m_reservoir.pop_back();
+        }
+        m_reservoir.push_back(Candidate { fileKey, std::move(*file) });
+        std::push_heap(ITERATORS(m_reservoir), byKey);
+    }
+
+    // Discovery order keeps the files of one directory together for the workers
+    std::sort(ITERATORS(m_reservoir), [](const Candidate& a, const Candidate& b) { return a.file.index < b.file.index; });
+    for (auto& candidate : m_reservoir)
+        pass(std::move(candidate.file), output);
+    m_reservoir.clear();
+    output.close();
+}
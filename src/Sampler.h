@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "Discovery.h"
+
+/// @brief --sample / --sample-count: passes on a random sample of the discovered files, stratified by directory so
+/// every shoot is represented in proportion to its size.
+///
+/// Every file gets a key in [0, 1): the directory's random offset plus the file's position in the directory times
+/// the golden ratio, modulo 1. Each key is uniform on its own, but the keys of one directory are spread evenly, so
+/// any threshold selects close to the same share of every directory. A fraction keeps the files below it as they
+/// arrive; a count keeps the files with the smallest keys in a bounded reservoir until discovery is done.
+class Sampler final {
+public:
+    /// @param fraction Share of the files to keep, in (0, 1], or zero to keep a fixed number instead
+    /// @param count Number of files to keep if `fraction` is zero
+    Sampler(double fraction, std::size_t count);
+
+    /// @brief Drains `input` and pushes the sample to `output`, numbered from zero in discovery order, then closes it
+    void run(BoundedQueue<RawFile>& input, BoundedQueue<RawFile>& output);
+
+    /// @brief Files seen so far
+    [[nodiscard]] std::size_t population() const { return m_population; }
+    /// @brief Files passed on so far
+    [[nodiscard]] std::size_t sampled() const { return m_sampled; }
+
+private:
+    struct Stratum {
+        double offset;
+        std::uint64_t files;
+    };
+
+    struct Candidate {
+        double key;
+        RawFile file;
+    };
+
+    [[nodiscard]] double key(const RawFile&);
+    void pass(RawFile&& file, BoundedQueue<RawFile>& output);
+
+    double m_fraction;
+    std::size_t m_count;
+    std::size_t m_population { 0 };
+    std::size_t m_sampled { 0 };
+    /// @brief Keyed by parent directory, or by archive and directory for archive members
+    std::unordered_map<std::string, Stratum> m_strata {};
+    /// @brief Max-heap on the key, at most m_count files
+    std::vector<Candidate> m_reservoir {};
+    std::mt19937_64 m_random { std::random_device {}() };
+};
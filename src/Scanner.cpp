@@ -0,0 +1,122 @@
+#include <libraw/libraw.h>
+#include <memory>
+#include <thread>
+
+#include "Prefetcher.h"
+#include "Sampler.h"
+#include "Scanner.h"
+
+Scanner::Scanner(ScanOptions scanOptions, const CommandlineOptions& options, const ScanContext& context)
+    : m_scanOptions(std::move(scanOptions))
+    , m_options(options)
+    , m_context(context)
+{
+    if (m_scanOptions.profile.has_value()) {
+        m_discoveryProfilers.assign(m_options.jobs, Profiler { *m_scanOptions.profile });
+        m_workerProfilers.assign(m_options.jobs, Profiler { *m_scanOptions.profile });
+    }
+}
+
+void Scanner::run(const Callback& callback)
+{
+    auto start = ProfileClock::now();
+    auto profile = m_scanOptions.profile.has_value();
+
+    // Discovery and extraction run concurrently, connected through a bounded queue
+    BoundedQueue<RawFile> queue { discoveryQueueCapacity };
+    ThreadPool discoveryPool { m_options.jobs };
+    std::thread discovery { [&] {
+        findRawFiles(discoveryPool, queue, m_scanOptions.directories, m_scanOptions.files,
+            DiscoveryOptions { .sniff = m_options.sniff, .archives = m_options.archives }, profile ? &m_discoveryProfilers : nullptr);
+        m_discoveryTime = ProfileClock::now() - start;
+    } };
+
+    // With sampling, only the sampled files leave discovery
+    std::optional<Sampler> sampler {};
+    if (m_scanOptions.sampleFraction != 0.0 || m_scanOptions.sampleCount != 0)
+        sampler.emplace(m_scanOptions.sampleFraction, m_scanOptions.sampleCount);
+    BoundedQueue<RawFile> sampled { discoveryQueueCapacity };
+    std::thread sampling {};
+    if (sampler.has_value())
+        sampling = std::thread { [&] { sampler->run(queue, sampled); } };
+    auto& discovered = sampler.has_value() ? sampled : queue;
+
+    // With read-ahead, a stage between discovery and the workers keeps up to N files in flight
+    auto prefetchWindow = m_scanOptions.prefetch;
+    BoundedQueue<RawFile> prefetched { prefetchWindow };
+    std::thread prefetch {};
+    if (prefetchWindow != 0) {
+        prefetch = std::thread { [&] {
+            Prefetcher prefetcher { prefetchWindow };
+            while (auto file = discovered.pop()) {
+                if (file->member.has_value())
+                    prefetcher.prefetch(file->member->archive, file->member->offset);
+                else
+                    prefetcher.prefetch(file->path);
+                prefetched.push(std::move(*file));
+            }
+            prefetched.close();
+        } };
+    }
+    auto& workQueue = prefetchWindow != 0 ? prefetched : discovered;
+
+    std::vector<std::thread> workers {};
+    for (std::size_t worker = 0; worker < m_options.jobs; ++worker) {
+        workers.emplace_back([&, worker] {
+            auto* profiler = profile ? &m_workerProfilers[worker] : nullptr;
+            // LibRaw is too large for the stack and expensive to construct, each worker reuses one
+            auto raw = std::make_unique<LibRaw>();
+            while (auto file = workQueue.pop()) {
+                StageTimes times {};
+                StageTimer timer { profiler != nullptr ? &times : nullptr };
+                if (profiler != nullptr && file->discovered != ProfileClock::time_point {})
+                    times[static_cast<std::size_t>(Stage::Queue)] = timer.start() - file->discovered;
+
+                if (m_scanOptions.skip && m_scanOptions.skip(*file))
+                    continue;
+
+                std::optional<PhotoRecord> record {};
+                auto matched = false;
+                if (m_scanOptions.readRecords) {
+                    record = scanFile(*file, m_options, m_context, *raw, timer);
+                    matched = record.has_value();
+                } else {
+                    matched = matchFile(*file, m_context);
+                }
+                callback(ScannedFile { *file, record ? &*record : nullptr, matched, worker, timer });
+                if (profiler != nullptr && matched)
+                    profiler->addFile(file->path, times);
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    if (prefetch.joinable())
+        prefetch.join();
+    if (sampling.joinable())
+        sampling.join();
+    discovery.join();
+
+    if (sampler.has_value()) {
+        m_population = sampler->population();
+        m_sampled = sampler->sampled();
+    }
+    m_scanTime = ProfileClock::now() - start;
+}
+
+std::optional<SampleSize> Scanner::sample() const
+{
+    if (m_scanOptions.sampleFraction == 0.0 && m_scanOptions.sampleCount == 0)
+        return std::nullopt;
+    return SampleSize { m_sampled, m_population };
+}
+
+Profiler Scanner::profiler() const
+{
+    Profiler profiler { m_scanOptions.profile.value_or(0) };
+    for (auto& shard : m_discoveryProfilers)
+        profiler.merge(shard);
+    for (auto& shard : m_workerProfilers)
+        profiler.merge(shard);
+    return profiler;
+}
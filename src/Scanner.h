@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "CommandlineOptions.h"
+#include "Discovery.h"
+#include "Extractor.h"
+#include "Profiler.h"
+#include "Summary.h"
+
+/// @brief What a Scanner reads; how each file is read (I/O mode, fast path, timeouts, ...) comes from the
+/// CommandlineOptions it is given alongside
+struct ScanOptions {
+    /// @brief Searched recursively
+    std::vector<std::string> directories {};
+    std::vector<std::string> files {};
+    /// @brief Read the headers of up to this many upcoming files ahead of the workers, see Prefetcher
+    std::size_t prefetch { 0 };
+    /// @brief Only read this share of the files, see Sampler
+    double sampleFraction { 0.0 };
+    /// @brief Only read this many files, see Sampler
+    std::size_t sampleCount { 0 };
+    /// @brief Time every stage of every file, keeping this many of the slowest ones
+    std::optional<std::size_t> profile {};
+    /// @brief Extract every file's metadata. Without, files are only matched against the path, size and
+    /// modification time conditions of ScanContext::filter and reach the callback without a record.
+    bool readRecords { true };
+    /// @brief Files it returns true for are dropped before they are read and never reach the callback, e.g. ones
+    /// whose output already exists. Called concurrently on the worker threads.
+    std::function<bool(const RawFile&)> skip {};
+};
+
+/// @brief A file the Scanner is done with
+struct ScannedFile {
+    const RawFile& file;
+    /// @brief Null if the file failed (reported to ScanContext::failures), --where ruled it out or
+    /// ScanOptions::readRecords is off
+    const PhotoRecord* record;
+    /// @brief The file was read, or didn't have to be, and --where accepts it
+    bool matched;
+    /// @brief Index of the worker thread calling back, below CommandlineOptions::jobs, e.g. for Aggregator shards
+    std::size_t worker;
+    /// @brief Times the file for --profile, the callback charges its own work to Aggregate, Format and Output
+    StageTimer& timer;
+};
+
+/// @brief The scan pipeline without any output: discovery, sampling and read-ahead feed `jobs` workers that
+/// extract and filter every file and hand it to a callback. Embedders get PhotoRecords in-process this way,
+/// the command-line frontend is one such caller.
+///
+///     Aggregator aggregator { options.jobs };
+///     Scanner scanner { ScanOptions { .directories = { "/photos" } }, options, context };
+///     scanner.run([&](const ScannedFile& scanned) {
+///         if (scanned.record != nullptr)
+///             aggregator.add(scanned.worker, *scanned.record);
+///     });
+///     auto data = aggregator.merge();
+class Scanner final {
+public:
+    using Callback = std::function<void(const ScannedFile&)>;
+
+    /// @param context Cache, failure report, filter and fast path statistics shared by the workers. Its output
+    /// members are only used by callbacks that write output. Both it and `options` must outlive the scanner.
+    Scanner(ScanOptions, const CommandlineOptions& options, const ScanContext& context);
+
+    /// @brief Scans everything, calling `callback` for every discovered (or sampled) file on the worker thread
+    /// that read it. Workers call concurrently and in no particular order; RawFile::index gives discovery order.
+    /// Blocks until the scan is done, can only be called once.
+    void run(const Callback& callback);
+
+    /// @brief How many files were sampled out of how many discovered, if sampling was requested
+    [[nodiscard]] std::optional<SampleSize> sample() const;
+
+    /// @brief All per-stage timings, empty unless ScanOptions::profile was set
+    [[nodiscard]] Profiler profiler() const;
+    [[nodiscard]] ProfileClock::duration discoveryTime() const { return m_discoveryTime; }
+    [[nodiscard]] ProfileClock::duration scanTime() const { return m_scanTime; }
+
+private:
+    ScanOptions m_scanOptions;
+    const CommandlineOptions& m_options;
+    const ScanContext& m_context;
+    std::size_t m_population { 0 };
+    std::size_t m_sampled { 0 };
+    // One per discovery thread and one per worker, merged by profiler()
+    std::vector<Profiler> m_discoveryProfilers {};
+    std::vector<Profiler> m_workerProfilers {};
+    ProfileClock::duration m_discoveryTime {};
+    ProfileClock::duration m_scanTime {};
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Values are copied straight from memory, partial summaries are only portable between little-endian hosts
+static_assert(std::endian::native == std::endian::little, "Partial summaries are only written on little-endian hosts");
+
+/// @brief Appends values to a byte buffer in host (little-endian) byte order
+class ByteWriter final {
+public:
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    void write(const T& value)
+    {
+        auto* bytes = reinterpret_cast<const std::byte*>(&value);
+        m_buffer.insert(m_buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    void writeString(std::string_view value)
+    {
+        write(static_cast<std::uint32_t>(value.size()));
+        auto* bytes = reinterpret_cast<const std::byte*>(value.data());
+        m_buffer.insert(m_buffer.end(), bytes, bytes + value.size());
+    }
+
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    void writeArray(const std::vector<T>& values)
+    {
+        write(static_cast<std::uint64_t>(values.size()));
+        auto* bytes = reinterpret_cast<const std::byte*>(values.data());
+        m_buffer.insert(m_buffer.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    [[nodiscard]] const std::vector<std::byte>& buffer() const { return m_buffer; }
+
+private:
+    std::vector<std::byte> m_buffer {};
+};
+
+/// @brief Reads what a ByteWriter wrote. Reading past the end yields zeroes and sets failed(),
+/// so callers can read a whole structure and check once at the end.
+class ByteReader final {
+public:
+    ByteReader(const std::byte* data, std::size_t size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    T read()
+    {
+        T value {};
+        if (!take(sizeof(T)))
+            return value;
+        std::memcpy(&value, m_data + m_position - sizeof(T), sizeof(T));
+        return value;
+    }
+
+    std::string readString()
+    {
+        auto size = read<std::uint32_t>();
+        if (!take(size))
+            return {};
+        return { reinterpret_cast<const char*>(m_data + m_position - size), size };
+    }
+
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    std::vector<T> readArray()
+    {
+        auto count = read<std::uint64_t>();
+        // Checked before multiplying, a corrupt count must not overflow or allocate
+        if (count > (m_size - m_position) / sizeof(T)) {
+            m_failed = true;
+            return {};
+        }
+        std::vector<T> values(count);
+        // An empty vector's data() may be null, which memcpy must not be given even for zero bytes
+        if (count != 0)
+            std::memcpy(values.data(), m_data + m_position, count * sizeof(T));
+        m_position += count * sizeof(T);
+        return values;
+    }
+
+    void fail() { m_failed = true; }
+    [[nodiscard]] bool failed() const { return m_failed; }
+    [[nodiscard]] bool atEnd() const { return m_position == m_size; }
+
+private:
+    bool take(std::size_t size)
+    {
+        if (m_failed || size > m_size - m_position) {
+            m_failed = true;
+            return false;
+        }
+        m_position += size;
+        return true;
+    }
+
+    const std::byte* m_data;
+    std::size_t m_size;
+    std::size_t m_position { 0 };
+    bool m_failed { false };
+};
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Statistics.h"
+#include "macros.h"
+
+// Capacities shrink by this factor per level below the top one
+static constexpr double capacityDecay = 2.0 / 3.0;
+static constexpr std::size_t minimumCapacity = 2;
+// Standard normal quantile for 95% confidence intervals
+static constexpr double z95 = 1.959963984540054;
+
+QuantileSketch::QuantileSketch(std::size_t k)
+    : m_k(std::max(k, minimumCapacity))
+{
+    m_levels.emplace_back();
+}
+
+std::size_t QuantileSketch::capacity(std::size_t level) const
+{
+    auto depth = m_levels.size() - level - 1;
+    auto capacity = static_cast<std::size_t>(std::ceil(static_cast<double>(m_k) * std::pow(capacityDecay, static_cast<double>(depth))));
+    return std::max(capacity, minimumCapacity);
+}
+
+std::size_t QuantileSketch::retained() const
+{
+    std::size_t total = 0;
+    for (auto& level : m_levels)
+        total += level.size();
+    return total;
+}
+
+void QuantileSketch::add(float value)
+{
+    m_levels.front().push_back(value);
+    ++m_count;
+    if (m_levels.front().size() >= capacity(0))
+        compress();
+}
+
+void QuantileSketch::merge(const QuantileSketch& other)
+{
+    if (other.m_levels.size() > m_levels.size())
+        m_levels.resize(other.m_levels.size());
+    for (std::size_t level = 0; level < other.m_levels.size(); ++level)
+        m_levels[level].insert(m_levels[level].end(), ITERATORS(other.m_levels[level]));
+    m_count += other.m_count;
+    compress();
+}
+
+void QuantileSketch::compress()
+{
+    // Capacities depend on the number of levels, so re-check from the bottom after every compaction
+    bool compacted = true;
+    while (compacted) {
+        compacted = false;
+        for (std::size_t level = 0; level < m_levels.size(); ++level) {
+            if (m_levels[level].size() >= capacity(level)) {
+                compact(level);
+                compacted = true;
+                break;
+            }
+        }
+    }
+}
+
+void QuantileSketch::compact(std::size_t level)
+{
+    if (level + 1 == m_levels.size())
+        m_levels.emplace_back();
+
+    auto& items = m_levels[level];
+    std::sort(ITERATORS(items));
+
+    // An odd item out stays behind so the represented weight is preserved exactly
+    float leftover {};
+    bool hasLeftover = items.size() % 2 != 0;
+    if (hasLeftover) {
+        leftover = items.back();
+        items.pop_back();
+    }
+
+    // xorshift64, a random offset keeps the compaction error unbiased
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 7;
+    m_random ^= m_random << 17;
+    auto offset = static_cast<std::size_t>(m_random & 1);
+
+    auto& next = m_levels[level + 1];
+    for (auto i = offset; i < items.size(); i += 2)
+        next.push_back(items[i]);
+
+    items.clear();
+    if (hasLeftover)
+        items.push_back(leftover);
+}
+
+void QuantileSketch::save(ByteWriter& writer) const
+{
+    writer.write(static_cast<std::uint64_t>(m_k));
+    writer.write(static_cast<std::uint64_t>(m_count));
+    writer.write(m_random);
+    writer.write(static_cast<std::uint32_t>(m_levels.size()));
+    for (auto& level : m_levels)
+        writer.writeArray(level);
+}
+
+void QuantileSketch::load(ByteReader& reader)
+{
+    m_k = std::max(static_cast<std::size_t>(reader.read<std::uint64_t>()), minimumCapacity);
+    m_count = reader.read<std::uint64_t>();
+    m_random = reader.read<std::uint64_t>();
+    auto levels = reader.read<std::uint32_t>();
+    // One level per doubling of the count, anything beyond 64 can't come from a real sketch
+    if (levels == 0 || levels > 64) {
+        reader.fail();
+        return;
+    }
+    m_levels.clear();
+    for (std::uint32_t level = 0; level < levels; ++level)
+        m_levels.push_back(reader.readArray<float>());
+}
+
+float QuantileSketch::quantile(double q) const
+{
+    std::vector<std::pair<float, std::uint64_t>> weighted {};
+    weighted.reserve(retained());
+    for (std::size_t level = 0; level < m_levels.size(); ++level) {
+        for (auto value : m_levels[level])
+            weighted.emplace_back(value, std::uint64_t { 1 } << level);
+    }
+    ASSERT(!weighted.empty());
+    std::sort(ITERATORS(weighted));
+
+    std::uint64_t total = 0;
+    for (auto& [value, weight] : weighted)
+        total += weight;
+
+    auto target = static_cast<std::uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(total));
+    std::uint64_t cumulative = 0;
+    for (auto& [value, weight] : weighted) {
+        cumulative += weight;
+        if (cumulative > target)
+            return value;
+    }
+    return weighted.back().first;
+}
+
+StreamingStats::StreamingStats(bool exact)
+    : m_exact(exact)
+{
+}
+
+void StreamingStats::add(float value)
+{
+    auto deviation = m_count == 0 ? 0.0 : value - mean();
+    ++m_count;
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+    m_sum += value;
+    m_squaredDeviations += deviation * (value - mean());
+    if (m_exact)
+        m_samples.push_back(value);
+    else
+        m_sketch.add(value);
+}
+
+void StreamingStats::merge(const StreamingStats& other)
+{
+    if (m_count != 0 && other.m_count != 0) {
+        auto deviation = other.mean() - mean();
+        auto count = static_cast<double>(m_count);
+        auto otherCount = static_cast<double>(other.m_count);
+        m_squaredDeviations += deviation * deviation * count * otherCount / (count + otherCount);
+    }
+    m_squaredDeviations += other.m_squaredDeviations;
+    m_count += other.m_count;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+    m_sum += other.m_sum;
+    if (m_exact)
+        m_samples.insert(m_samples.end(), ITERATORS(other.m_samples));
+    else
+        m_sketch.merge(other.m_sketch);
+}
+
+void StreamingStats::save(ByteWriter& writer) const
+{
+    writer.write(static_cast<std::uint8_t>(m_exact));
+    writer.write(static_cast<std::uint64_t>(m_count));
+    writer.write(m_min);
+    writer.write(m_max);
+    writer.write(m_sum);
+    writer.write(m_squaredDeviations);
+    if (m_exact)
+        writer.writeArray(m_samples);
+    else
+        m_sketch.save(writer);
+}
+
+void StreamingStats::load(ByteReader& reader)
+{
+    m_exact = reader.read<std::uint8_t>() != 0;
+    m_count = reader.read<std::uint64_t>();
+    m_min = reader.read<float>();
+    m_max = reader.read<float>();
+    m_sum = reader.read<double>();
+    m_squaredDeviations = reader.read<double>();
+    if (m_exact)
+        m_samples = reader.readArray<float>();
+    else
+        m_sketch.load(reader);
+}
+
+float StreamingStats::quantile(double q) const
+{
+    ASSERT(m_count != 0);
+    if (!m_exact)
+        return m_sketch.quantile(q);
+
+    auto index = std::min(m_samples.size() - 1, static_cast<std::size_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(m_samples.size())));
+    auto nth = m_samples.begin() + static_cast<std::ptrdiff_t>(index);
+    std::nth_element(m_samples.begin(), nth, m_samples.end());
+    return *nth;
+}
+
+// Finite population correction: a sample covering all of the population has no sampling error
+static double populationCorrection(double sampledFraction)
+{
+    return std::sqrt(std::clamp(1.0 - sampledFraction, 0.0, 1.0));
+}
+
+Interval meanInterval(const StreamingStats& stats, double sampledFraction)
+{
+    ASSERT(stats.count() != 0);
+    auto margin = z95 * std::sqrt(stats.variance() / static_cast<double>(stats.count())) * populationCorrection(sampledFraction);
+    return { stats.mean() - margin, stats.mean() + margin };
+}
+
+Interval quantileInterval(const StreamingStats& stats, double q, double sampledFraction)
+{
+    ASSERT(stats.count() != 0);
+    auto margin = z95 * std::sqrt(q * (1.0 - q) / static_cast<double>(stats.count())) * populationCorrection(sampledFraction);
+    return { stats.quantile(std::max(q - margin, 0.0)), stats.quantile(std::min(q + margin, 1.0)) };
+}
+
+Interval shareInterval(std::size_t count, std::size_t sampled, double sampledFraction)
+{
+    ASSERT(count <= sampled && sampled != 0);
+    auto share = static_cast<double>(count) / static_cast<double>(sampled);
+    auto correction = populationCorrection(sampledFraction);
+    if (correction == 0.0)
+        return { share, share };
+
+    // The correction shrinks the interval like a proportionally larger sample would
+    auto n = static_cast<double>(sampled) / (correction * correction);
+    auto z2 = z95 * z95;
+    auto center = (share + z2 / (2 * n)) / (1 + z2 / n);
+    auto margin = z95 / (1 + z2 / n) * std::sqrt(share * (1 - share) / n + z2 / (4 * n * n));
+    return { std::max(center - margin, 0.0), std::min(center + margin, 1.0) };
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Serialization.h"
+
+/// @brief Mergeable KLL quantile sketch over floats.
+/// Keeps O(k log(n/k)) samples; rank error is roughly 1.7/k with high probability.
+class QuantileSketch final {
+public:
+    static constexpr std::size_t defaultK = 200;
+
+    explicit QuantileSketch(std::size_t k = defaultK);
+
+    void add(float value);
+    void merge(const QuantileSketch& other);
+
+    /// @brief Approximate q-quantile, q in [0, 1]. Undefined if the sketch is empty.
+    [[nodiscard]] float quantile(double q) const;
+
+    [[nodiscard]] std::size_t count() const { return m_count; }
+    [[nodiscard]] std::size_t retained() const;
+
+    void save(ByteWriter&) const;
+    void load(ByteReader&);
+
+private:
+    [[nodiscard]] std::size_t capacity(std::size_t level) const;
+    void compress();
+    void compact(std::size_t level);
+
+    std::size_t m_k;
+    std::size_t m_count { 0 };
+    // Items on level h each stand for 2^h inserted values
+    std::vector<std::vector<float>> m_levels {};
+    std::uint64_t m_random { 0x9E3779B97F4A7C15ull };
+};
+
+/// @brief One-pass accumulator with exact count/min/max/mean/variance and sketched quantiles.
+/// In exact mode every sample is kept and quantiles are selected with nth_element instead.
+class StreamingStats final {
+public:
+    explicit StreamingStats(bool exact = false);
+
+    void add(float value);
+    void merge(const StreamingStats& other);
+
+    [[nodiscard]] std::size_t count() const { return m_count; }
+    [[nodiscard]] bool empty() const { return m_count == 0; }
+    [[nodiscard]] float min() const { return m_min; }
+    [[nodiscard]] float max() const { return m_max; }
+    [[nodiscard]] double mean() const { return m_count == 0 ? 0.0 : m_sum / static_cast<double>(m_count); }
+    /// @brief Sample variance (n - 1 in the denominator), zero for fewer than two values
+    [[nodiscard]] double variance() const { return m_count < 2 ? 0.0 : m_squaredDeviations / static_cast<double>(m_count - 1); }
+    [[nodiscard]] bool exact() const { return m_exact; }
+
+    /// @brief q-quantile, q in [0, 1]. For q = 0.5 this is the upper median, like indexing a sorted vector at size / 2.
+    [[nodiscard]] float quantile(double q) const;
+
+    /// @brief Writes the complete state, sketch or samples included
+    void save(ByteWriter&) const;
+    /// @brief Replaces this instance with a saved one, exactness included
+    void load(ByteReader&);
+
+private:
+    bool m_exact;
+    std::size_t m_count { 0 };
+    float m_min { std::numeric_limits<float>::max() };
+    float m_max { std::numeric_limits<float>::lowest() };
+    double m_sum { 0.0 };
+    // Sum of squared deviations from the mean, updated with Welford's method and merged with Chan's
+    double m_squaredDeviations { 0.0 };
+    QuantileSketch m_sketch {};
+    // Only filled in exact mode; reordered by quantile()
+    mutable std::vector<float> m_samples {};
+};
+
+/// @brief Two-sided 95% confidence interval
+struct Interval {
+    double low;
+    double high;
+};
+
+/// @brief Interval for the population mean estimated from a simple random sample
+/// @param sampledFraction Share of the population the sample covers, narrows the interval as it approaches 1
+[[nodiscard]] Interval meanInterval(const StreamingStats&, double sampledFraction);
+
+/// @brief Distribution-free interval for the population q-quantile, read from the sample at the ranks bounding it
+[[nodiscard]] Interval quantileInterval(const StreamingStats&, double q, double sampledFraction);
+
+/// @brief Wilson score interval for the share of the population `count` of `sampled` stand for
+[[nodiscard]] Interval shareInterval(std::size_t count, std::size_t sampled, double sampledFraction);
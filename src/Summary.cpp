@@ -0,0 +1,195 @@
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "FormatUtils.h"
+#include "Summary.h"
+#include "TimeUtils.h"
+
+using fmt::fg, fmt::color;
+
+// Sampled share of the population, set when the summary describes a --sample scan
+using SampledFraction = std::optional<double>;
+
+static void printInterval(OutputBuffer& out, const Interval& interval, const std::function<std::string(float)>& format)
+{
+    auto low = format(static_cast<float>(interval.low));
+    auto high = format(static_cast<float>(interval.high));
+    // Nothing to add where the estimate is exact at the printed precision
+    if (low != high)
+        out.print(fg(color::gray), " ({} - {})", low, high);
+}
+
+static void printMetric(OutputBuffer& out, std::string_view indent, const StreamingStats& stats, std::string_view name, const std::function<std::string(float)>& format, SampledFraction sampled)
+{
+    out.print(fg(color::cyan), "{}{}: ", indent, name);
+
+    out.print(fg(color::gray), "min: ");
+    out.print("{} ", format(stats.min()));
+    out.print(fg(color::gray), "max: ");
+    out.print("{} ", format(stats.max()));
+    out.print(fg(color::gray), "avg: ");
+    out.print("{}", format(static_cast<float>(stats.mean())));
+    // A single photo says nothing about the spread
+    auto intervals = sampled.has_value() && stats.count() > 1;
+    if (intervals)
+        printInterval(out, meanInterval(stats, *sampled), format);
+    for (auto [label, q] : { std::pair { "median", 0.5 }, std::pair { "p5", 0.05 }, std::pair { "p95", 0.95 } }) {
+        out.print(fg(color::gray), " {}: ", label);
+        out.print("{}", format(stats.quantile(q)));
+        if (intervals)
+            printInterval(out, quantileInterval(stats, q, *sampled), format);
+    }
+    out.print("\n");
+}
+
+static void printMetrics(OutputBuffer& out, std::string_view indent, const MetricStats& stats, SampledFraction sampled)
+{
+    printMetric(out, indent, stats.iso_speeds, "ISO speeds", FormatUtils::formatISO, sampled);
+    printMetric(out, indent, stats.shutter_speeds, "Shutter speeds", FormatUtils::formatShutterSpeed, sampled);
+    printMetric(out, indent, stats.focal_lengths, "Focal lengths", FormatUtils::formatFocalLength, sampled);
+    printMetric(out, indent, stats.aperture_values, "Aperture", FormatUtils::formatAperture, sampled);
+    printMetric(out, indent, stats.resolutions, "Resolutions", FormatUtils::formatResolution, sampled);
+}
+
+/// @brief "n photos", followed by the estimated share of all photos when sampling
+static void printCount(OutputBuffer& out, std::size_t count, std::size_t total, SampledFraction sampled)
+{
+    if (count == 1)
+        out.print("1 photo");
+    else
+        out.print("{} photos", count);
+    if (sampled.has_value()) {
+        auto interval = shareInterval(count, total, *sampled);
+        out.print(fg(color::gray), " ({:.1f}% - {:.1f}% of all)", interval.low * 100, interval.high * 100);
+    }
+    out.print("\n");
+}
+
+static std::string cameraName(const Data& data, InternTable::Id id)
+{
+    auto& key = data.cameras.keys.key(id);
+    return fmt::format("{} {}", key.first, key.second);
+}
+
+static std::string lensName(const Data& data, InternTable::Id id)
+{
+    auto& key = data.lenses.keys.key(id);
+    return FormatUtils::formatLens(key.first, key.second);
+}
+
+static void printGroups(OutputBuffer& out, const Data& data, SampledFraction sampled)
+{
+    auto groupBy = data.groups.groupBy();
+    auto exact = data.iso_speeds.exact();
+
+    // Groups are only named here; lenses differing in LensID alone are folded like in the lens counts
+    std::map<std::string, MetricStats> groups {};
+    for (std::size_t index = 0; index < data.groups.size(); ++index) {
+        std::string name {};
+        switch (groupBy) {
+        case GroupBy::Camera:
+            name = fmt::format("Camera '{}'", cameraName(data, data.groups.camera(index)));
+            break;
+        case GroupBy::Lens:
+            name = fmt::format("Lens '{}'", lensName(data, data.groups.lens(index)));
+            break;
+        case GroupBy::CameraLens:
+            name = fmt::format("Camera '{}' with lens '{}'", cameraName(data, data.groups.camera(index)), lensName(data, data.groups.lens(index)));
+            break;
+        case GroupBy::None:
+            UNREACHABLE();
+        }
+        groups.try_emplace(name, exact).first->second.merge(data.groups.stats(index));
+    }
+
+    for (auto& [name, stats] : groups) {
+        out.print("\n");
+        out.print(fg(color::cyan), "{}: ", name);
+        printCount(out, stats.count(), data.photoCount(), sampled);
+        printMetrics(out, "\t", stats, sampled);
+    }
+}
+
+static void printTimeline(OutputBuffer& out, const Data& data)
+{
+    auto& timeline = data.timeline;
+    auto bucket = timeline.bucket() == TimelineBucket::Hour ? "hour" : timeline.bucket() == TimelineBucket::Day ? "day" : "month";
+    out.print("\n");
+    out.print(fg(color::cyan), "Timeline by {}:\n", bucket);
+    for (auto& [key, period] : timeline.periods()) {
+        out.print(fg(color::cyan), "\t{}: ", timeline.formatPeriod(key));
+        out.print("{} {}, {} {}, {} {}", period.photos, period.photos == 1 ? "photo" : "photos", period.cameras.size(),
+            period.cameras.size() == 1 ? "camera" : "cameras", period.lenses.size(), period.lenses.size() == 1 ? "lens" : "lenses");
+        out.print(fg(color::gray), ", median: ");
+        out.print("{}\n", FormatUtils::formatISO(period.iso_speeds.median()));
+    }
+    if (timeline.undated() != 0)
+        out.print(fg(color::gray), "\t{} without a timestamp\n", timeline.undated() == 1 ? std::string { "1 photo" } : fmt::format("{} photos", timeline.undated()));
+
+    auto sessions = timeline.sessions();
+    out.print("\n");
+    out.print(fg(color::cyan), "Sessions: ");
+    out.print("{}", sessions.size());
+    out.print(fg(color::gray), " (no gap over {} minutes)\n", timeline.sessionGap().count());
+    for (auto& session : sessions) {
+        out.print("\t{} ", TimeUtils::formatISO8601(session.start));
+        out.print(fg(color::gray), "-");
+        out.print(" {} ", TimeUtils::formatISO8601(session.end));
+        out.print(fg(color::gray), "({})", TimeUtils::formatTimeSpan(session.start, session.end));
+        out.print(": {} {}\n", session.photos, session.photos == 1 ? "photo" : "photos");
+    }
+}
+
+void printSummary(OutputBuffer& out, const Data& data, std::chrono::milliseconds time, const SampleSize* sample)
+{
+    data.assertNotEmpty();
+    data.assertEqualSizes();
+
+    auto photoCount = data.photoCount();
+    SampledFraction sampled {};
+    if (sample != nullptr) {
+        ASSERT(sample->sampled <= sample->population && sample->population != 0);
+        sampled = static_cast<double>(sample->sampled) / static_cast<double>(sample->population);
+        out.print("Analyzed a sample of {} photos out of {} in {}ms ({:.02f}ms/photo)\n", photoCount, sample->population, time.count(), time.count() / static_cast<float>(photoCount));
+        out.print(fg(color::gray), "Ranges in parentheses are 95% confidence intervals for all {} photos\n", sample->population);
+    } else {
+        out.print("Analyzed {} photos in {}ms ({:.02f}ms/photo)\n", photoCount, time.count(), time.count() / static_cast<float>(photoCount));
+    }
+    out.print(fg(color::cyan), "Time frame: ");
+    out.print("{} ", TimeUtils::formatISO8601(data.timestamps.earliest));
+    out.print(fg(color::gray), "-");
+    out.print(" {} ", TimeUtils::formatISO8601(data.timestamps.latest));
+    out.print(fg(color::gray), "({})\n", TimeUtils::formatTimeSpan(data.timestamps.earliest, data.timestamps.latest));
+    printMetric(out, "", data.iso_speeds, "ISO speeds", FormatUtils::formatISO, sampled);
+    printMetric(out, "", data.shutter_speeds, "Shutter speeds", FormatUtils::formatShutterSpeed, sampled);
+    printMetric(out, "", data.focal_lengths, "Focal lengths", FormatUtils::formatFocalLength, sampled);
+    printMetric(out, "", data.aperture_values, "Aperture", FormatUtils::formatAperture, sampled);
+    printMetric(out, "", data.resolutions, "Resolutions", FormatUtils::formatResolution, sampled);
+
+    // Lenses only differing in LensID print as one, sorted by name like the cameras
+    std::map<std::string, std::size_t> lenses {};
+    for (InternTable::Id id = 0; id < data.lenses.keys.size(); ++id)
+        lenses[lensName(data, id)] += data.lenses.counts[id];
+    std::map<std::string, std::size_t> cameras {};
+    for (InternTable::Id id = 0; id < data.cameras.keys.size(); ++id)
+        cameras[cameraName(data, id)] += data.cameras.counts[id];
+
+    for (auto& [lens, count] : lenses) {
+        out.print(fg(color::cyan), "Lens '{}': ", lens);
+        printCount(out, count, photoCount, sampled);
+    }
+
+    for (auto& [camera, count] : cameras) {
+        out.print(fg(color::cyan), "Camera '{}': ", camera);
+        printCount(out, count, photoCount, sampled);
+    }
+
+    if (data.groups.enabled())
+        printGroups(out, data, sampled);
+    if (data.timeline.enabled())
+        printTimeline(out, data);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+#include "Data.h"
+#include "Output.h"
+
+/// @brief How many of the discovered files a --sample scan read
+struct SampleSize {
+    std::size_t sampled;
+    std::size_t population;
+};
+
+/// @brief Renders the multi-file summary: time frame, metric statistics, lens/camera counts, the --group-by groups and the
+/// --timeline.
+/// With `sample` set, the statistics are estimates for all discovered files and come with 95% confidence intervals.
+void printSummary(OutputBuffer& out, const Data& data, std::chrono::milliseconds time, const SampleSize* sample = nullptr);
@@ -0,0 +1,115 @@
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+// Lets submit() find the calling worker's own deque
+static thread_local const ThreadPool* currentPool { nullptr };
+static thread_local std::size_t currentWorker { 0 };
+
+ThreadPool::ThreadPool(std::size_t workerCount)
+{
+    if (workerCount == 0)
+        workerCount = 1;
+
+    m_queues.reserve(workerCount);
+    for (std::size_t i = 0; i < workerCount; ++i)
+        m_queues.push_back(std::make_unique<Queue>());
+
+    m_threads.reserve(workerCount);
+    for (std::size_t i = 0; i < workerCount; ++i)
+        m_threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::scoped_lock lock { m_mutex };
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+std::size_t ThreadPool::resolveWorkerCount(std::size_t requested)
+{
+    if (requested != 0)
+        return requested;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::submit(Task task)
+{
+    auto index = currentPool == this ? currentWorker : m_nextQueue++ % m_queues.size();
+
+    ++m_unfinished;
+    {
+        auto& queue = *m_queues[index];
+        std::scoped_lock lock { queue.mutex };
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::scoped_lock lock { m_mutex };
+        ++m_queued;
+    }
+    m_wakeup.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock lock { m_mutex };
+    m_idle.wait(lock, [this] { return m_unfinished == 0; });
+}
+
+bool ThreadPool::popLocal(std::size_t worker, Task& task)
+{
+    auto& queue = *m_queues[worker];
+    std::scoped_lock lock { queue.mutex };
+    if (queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    --m_queued;
+    return true;
+}
+
+bool ThreadPool::steal(std::size_t worker, Task& task)
+{
+    for (std::size_t offset = 1; offset < m_queues.size(); ++offset) {
+        auto& queue = *m_queues[(worker + offset) % m_queues.size()];
+        std::scoped_lock lock { queue.mutex };
+        if (queue.tasks.empty())
+            continue;
+
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        --m_queued;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(std::size_t worker)
+{
+    currentPool = this;
+    currentWorker = worker;
+
+    while (true) {
+        Task task {};
+        if (popLocal(worker, task) || steal(worker, task)) {
+            task(worker);
+            if (--m_unfinished == 0) {
+                std::scoped_lock lock { m_mutex };
+                m_idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock { m_mutex };
+        m_wakeup.wait(lock, [this] { return m_stopping || m_queued != 0; });
+        if (m_stopping && m_queued == 0)
+            return;
+    }
+}
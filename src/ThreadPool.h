@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief Fixed set of worker threads, each owning a task deque.
+/// Workers drain their own deque first and steal from the back of other workers' deques when idle.
+class ThreadPool final {
+public:
+    /// @brief Tasks receive the index of the worker running them, usable to address per-worker state
+    using Task = std::function<void(std::size_t worker)>;
+
+    explicit ThreadPool(std::size_t workerCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// @brief Queues a task. Tasks submitted from inside a worker go to that worker's own deque.
+    void submit(Task task);
+
+    /// @brief Blocks until all submitted tasks, including those submitted by other tasks, have finished
+    void wait();
+
+    [[nodiscard]] std::size_t size() const { return m_queues.size(); }
+
+    /// @brief Resolves a --jobs style value, where 0 means one worker per hardware thread
+    [[nodiscard]] static std::size_t resolveWorkerCount(std::size_t requested);
+
+private:
+    struct Queue {
+        std::mutex mutex {};
+        std::deque<Task> tasks {};
+    };
+
+    void run(std::size_t worker);
+    bool popLocal(std::size_t worker, Task& task);
+    bool steal(std::size_t worker, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues {};
+    std::vector<std::thread> m_threads {};
+    std::atomic<std::size_t> m_nextQueue { 0 };
+    // Tasks sitting in a deque, used to put idle workers to sleep
+    std::atomic<std::size_t> m_queued { 0 };
+    // Tasks queued or running, used by wait()
+    std::atomic<std::size_t> m_unfinished { 0 };
+    bool m_stopping { false };
+    std::mutex m_mutex {};
+    std::condition_variable m_wakeup {};
+    std::condition_variable m_idle {};
+};
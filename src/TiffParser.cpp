@@ -0,0 +1,626 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <libraw/libraw.h>
+#include <string_view>
+#include <vector>
+
+#include "RawFormat.h"
+#include "TiffParser.h"
+
+namespace {
+
+enum Tag : std::uint16_t {
+    NewSubfileType = 0x00FE,
+    ImageWidth = 0x0100,
+    ImageLength = 0x0101,
+    Compression = 0x0103,
+    StripOffsets = 0x0111,
+    StripByteCounts = 0x0117,
+    Make = 0x010F,
+    Model = 0x0110,
+    Software = 0x0131,
+    DateTime = 0x0132,
+    SubIFDs = 0x014A,
+    JPEGInterchangeFormat = 0x0201,
+    JPEGInterchangeFormatLength = 0x0202,
+    ExposureTime = 0x829A,
+    FNumber = 0x829D,
+    ExifIFD = 0x8769,
+    ISOSpeedRatings = 0x8827,
+    DateTimeOriginal = 0x9003,
+    FocalLength = 0x920A,
+    MakerNote = 0x927C,
+    BodySerialNumber = 0xA431,
+    LensMake = 0xA433,
+    LensModel = 0xA434,
+    LensSerialNumber = 0xA435,
+    DefaultCropSize = 0xC620,
+
+    SonyQuality = 0x0102,
+    SonyLensType = 0xB027,
+
+    CanonCameraSettings = 0x0001,
+    CanonSerialNumber = 0x000C,
+    CanonLensModel = 0x0095,
+    CanonSensorInfo = 0x00E0,
+};
+
+enum Type : std::uint16_t {
+    Byte = 1,
+    Ascii = 2,
+    Short = 3,
+    Long = 4,
+    Rational = 5,
+    Undefined = 7,
+    SShort = 8,
+    SLong = 9,
+    SRational = 10,
+    Ifd = 13,
+};
+
+// Guards against corrupt or malicious files
+constexpr std::uint16_t maxEntriesPerIfd = 1024;
+constexpr std::size_t maxIfds = 64;
+
+struct Entry {
+    std::uint16_t tag;
+    std::uint16_t type;
+    std::uint32_t count;
+    // Absolute offset of the value, whether stored inline or out of line
+    std::size_t valueOffset;
+};
+
+class Reader {
+public:
+    Reader(const unsigned char* data, std::size_t size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    bool readHeader(std::size_t& firstIfd)
+    {
+        if (m_size < 8)
+            return false;
+        if (m_data[0] == 'I' && m_data[1] == 'I')
+            m_bigEndian = false;
+        else if (m_data[0] == 'M' && m_data[1] == 'M')
+            m_bigEndian = true;
+        else
+            return false;
+        if (u16(2) != 42)
+            return false;
+        firstIfd = u32(4);
+        return true;
+    }
+
+    [[nodiscard]] bool inBounds(std::size_t offset, std::size_t length) const
+    {
+        return offset <= m_size && length <= m_size - offset;
+    }
+
+    [[nodiscard]] std::uint16_t u16(std::size_t offset) const
+    {
+        if (!inBounds(offset, 2))
+            return 0;
+        auto* p = m_data + offset;
+        return m_bigEndian ? static_cast<std::uint16_t>(p[0] << 8 | p[1]) : static_cast<std::uint16_t>(p[1] << 8 | p[0]);
+    }
+
+    [[nodiscard]] std::uint32_t u32(std::size_t offset) const
+    {
+        if (!inBounds(offset, 4))
+            return 0;
+        auto* p = m_data + offset;
+        if (m_bigEndian)
+            return std::uint32_t { p[0] } << 24 | std::uint32_t { p[1] } << 16 | std::uint32_t { p[2] } << 8 | p[3];
+        return std::uint32_t { p[3] } << 24 | std::uint32_t { p[2] } << 16 | std::uint32_t { p[1] } << 8 | p[0];
+    }
+
+    /// @brief Reads an IFD starting at `offset`, returns the offset of the next IFD (0 if none)
+    std::uint32_t readIfd(std::size_t offset, std::vector<Entry>& entries) const
+    {
+        entries.clear();
+        auto count = u16(offset);
+        if (count == 0 || count > maxEntriesPerIfd || !inBounds(offset + 2, count * 12u + 4))
+            return 0;
+
+        for (std::uint16_t i = 0; i < count; ++i) {
+            auto entryOffset = offset + 2 + i * 12u;
+            Entry entry {
+                .tag = u16(entryOffset),
+                .type = u16(entryOffset + 2),
+                .count = u32(entryOffset + 4),
+                .valueOffset = entryOffset + 8,
+            };
+            if (typeSize(entry.type) * static_cast<std::uint64_t>(entry.count) > 4)
+                entry.valueOffset = u32(entryOffset + 8);
+            entries.push_back(entry);
+        }
+        return u32(offset + 2 + count * 12u);
+    }
+
+    [[nodiscard]] std::uint32_t integer(const Entry& entry, std::size_t index = 0) const
+    {
+        if (index >= entry.count)
+            return 0;
+        switch (entry.type) {
+        case Byte:
+        case Undefined:
+            return inBounds(entry.valueOffset + index, 1) ? m_data[entry.valueOffset + index] : 0;
+        case Short:
+        case SShort:
+            return u16(entry.valueOffset + index * 2);
+        case Long:
+        case SLong:
+        case Ifd:
+            return u32(entry.valueOffset + index * 4);
+        default:
+            return 0;
+        }
+    }
+
+    [[nodiscard]] float real(const Entry& entry) const
+    {
+        if (entry.type != Rational && entry.type != SRational)
+            return static_cast<float>(integer(entry));
+
+        auto numerator = u32(entry.valueOffset);
+        auto denominator = u32(entry.valueOffset + 4);
+        if (denominator == 0)
+            return 0.0f;
+        if (entry.type == SRational)
+            return static_cast<float>(static_cast<std::int32_t>(numerator)) / static_cast<float>(static_cast<std::int32_t>(denominator));
+        return static_cast<float>(numerator) / static_cast<float>(denominator);
+    }
+
+    /// @brief A view into the file, only valid while it is being parsed
+    [[nodiscard]] std::string_view string(const Entry& entry) const
+    {
+        if ((entry.type != Ascii && entry.type != Undefined && entry.type != Byte) || !inBounds(entry.valueOffset, entry.count))
+            return {};
+
+        std::string_view value { reinterpret_cast<const char*>(m_data + entry.valueOffset), entry.count };
+        value = value.substr(0, value.find('\0'));
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back())))
+            value.remove_suffix(1);
+        return value;
+    }
+
+    [[nodiscard]] const unsigned char* at(std::size_t offset) const { return m_data + offset; }
+
+    [[nodiscard]] bool startsWith(std::size_t offset, std::string_view prefix) const
+    {
+        return inBounds(offset, prefix.size()) && std::memcmp(m_data + offset, prefix.data(), prefix.size()) == 0;
+    }
+
+private:
+    static std::uint64_t typeSize(std::uint16_t type)
+    {
+        switch (type) {
+        case Byte:
+        case Ascii:
+        case Undefined:
+            return 1;
+        case Short:
+        case SShort:
+            return 2;
+        case Long:
+        case SLong:
+        case Ifd:
+            return 4;
+        case Rational:
+        case SRational:
+            return 8;
+        default:
+            return 8; // Unknown and wide types are never interpreted inline
+        }
+    }
+
+    const unsigned char* m_data;
+    std::size_t m_size;
+    bool m_bigEndian { false };
+};
+
+struct RawIfd {
+    std::uint32_t width { 0 };
+    std::uint32_t height { 0 };
+    std::uint32_t cropWidth { 0 };
+    std::uint32_t cropHeight { 0 };
+};
+
+struct ParseState {
+    PhotoRecord record {};
+    std::string_view dateTime {};
+    std::string_view dateTimeOriginal {};
+    std::size_t exifIfd { 0 };
+    std::size_t makerNote { 0 };
+    RawIfd raw {};
+    std::uint32_t canonSerial { 0 };
+    std::size_t ifdsVisited { 0 };
+};
+
+std::time_t parseExifDate(std::string_view value)
+{
+    // "YYYY:MM:DD HH:MM:SS", copied so sscanf finds a terminator
+    std::array<char, 32> text {};
+    std::memcpy(text.data(), value.data(), std::min(value.size(), text.size() - 1));
+    // Same conversion LibRaw uses: local time, DST resolved by mktime
+    std::tm tm {};
+    if (std::sscanf(text.data(), "%d:%d:%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+        return 0;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    auto timestamp = std::mktime(&tm);
+    return timestamp == -1 ? 0 : timestamp;
+}
+
+bool startsWithIgnoreCase(std::string_view value, std::string_view prefix)
+{
+    return value.size() >= prefix.size()
+        && std::equal(prefix.begin(), prefix.end(), value.begin(), [](char a, char b) {
+               return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+           });
+}
+
+unsigned short sonyCameraType(std::string_view model)
+{
+    // LibRaw derives this from the Sony model ID table, the model name prefix carries the same information
+    if (model.starts_with("ILCE-"))
+        return LIBRAW_SONY_ILCE;
+    if (model.starts_with("ILCA-"))
+        return LIBRAW_SONY_ILCA;
+    if (model.starts_with("NEX-"))
+        return LIBRAW_SONY_NEX;
+    if (model.starts_with("SLT-"))
+        return LIBRAW_SONY_SLT;
+    if (model.starts_with("DSLR-"))
+        return LIBRAW_SONY_DSLR;
+    if (model.starts_with("DSC-"))
+        return LIBRAW_SONY_DSC;
+    return 0;
+}
+
+void walkImageIfd(const Reader& reader, std::size_t offset, ParseState& state, bool topLevel)
+{
+    std::vector<Entry> entries {};
+    while (offset != 0 && state.ifdsVisited++ < maxIfds) {
+        auto next = reader.readIfd(offset, entries);
+
+        // NewSubfileType defaults to 0 (full resolution image) when absent
+        bool isFullImage = true;
+        std::uint32_t compression = 0;
+        RawIfd ifd {};
+        std::vector<std::size_t> subIfds {};
+        for (auto& entry : entries) {
+            switch (entry.tag) {
+            case NewSubfileType:
+                isFullImage = reader.integer(entry) == 0;
+                break;
+            case ImageWidth:
+                ifd.width = reader.integer(entry);
+                break;
+            case ImageLength:
+                ifd.height = reader.integer(entry);
+                break;
+            case Compression:
+                compression = reader.integer(entry);
+                break;
+            case DefaultCropSize:
+                ifd.cropWidth = reader.integer(entry, 0);
+                ifd.cropHeight = reader.integer(entry, 1);
+                break;
+            case Make:
+                if (topLevel)
+                    state.record.make = reader.string(entry);
+                break;
+            case Model:
+                if (topLevel)
+                    state.record.model = reader.string(entry);
+                break;
+            case Software:
+                if (topLevel)
+                    state.record.software = reader.string(entry);
+                break;
+            case DateTime:
+                if (topLevel)
+                    state.dateTime = reader.string(entry);
+                break;
+            case ExifIFD:
+                state.exifIfd = reader.integer(entry);
+                break;
+            case SubIFDs:
+                for (std::uint32_t i = 0; i < entry.count && i < maxIfds; ++i)
+                    subIfds.push_back(reader.integer(entry, i));
+                break;
+            default:
+                break;
+            }
+        }
+
+        // The raw image is the largest full-resolution IFD that is not a JPEG preview
+        if (isFullImage && compression != 6 && ifd.width * static_cast<std::uint64_t>(ifd.height) > state.raw.width * static_cast<std::uint64_t>(state.raw.height))
+            state.raw = ifd;
+
+        for (auto subIfd : subIfds)
+            walkImageIfd(reader, subIfd, state, false);
+
+        if (!topLevel)
+            break;
+        offset = next;
+        topLevel = false;
+    }
+}
+
+void walkExif(const Reader& reader, ParseState& state)
+{
+    std::vector<Entry> entries {};
+    reader.readIfd(state.exifIfd, entries);
+    for (auto& entry : entries) {
+        switch (entry.tag) {
+        case ExposureTime:
+            state.record.shutter = reader.real(entry);
+            break;
+        case FNumber:
+            state.record.aperture = reader.real(entry);
+            break;
+        case ISOSpeedRatings:
+            state.record.iso_speed = static_cast<float>(reader.integer(entry));
+            break;
+        case DateTimeOriginal:
+            state.dateTimeOriginal = reader.string(entry);
+            break;
+        case FocalLength:
+            state.record.focal_len = reader.real(entry);
+            break;
+        case MakerNote:
+            state.makerNote = entry.valueOffset;
+            break;
+        case BodySerialNumber:
+            state.record.body_serial = reader.string(entry);
+            break;
+        case LensMake:
+            state.record.lens_make = reader.string(entry);
+            break;
+        case LensModel:
+            state.record.lens = reader.string(entry);
+            break;
+        case LensSerialNumber:
+            state.record.lens_serial = reader.string(entry);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool walkSonyMakerNote(const Reader& reader, ParseState& state)
+{
+    auto offset = state.makerNote;
+    if (reader.startsWith(offset, "SONY DSC ") || reader.startsWith(offset, "SONY CAM "))
+        offset += 12;
+
+    std::vector<Entry> entries {};
+    reader.readIfd(offset, entries);
+    if (entries.empty())
+        return false;
+
+    for (auto& entry : entries) {
+        switch (entry.tag) {
+        case SonyQuality:
+            state.record.quality = static_cast<int>(reader.integer(entry));
+            break;
+        case SonyLensType:
+            state.record.lens_id = reader.integer(entry);
+            break;
+        default:
+            break;
+        }
+    }
+    state.record.camera_type = sonyCameraType(state.record.model);
+    return true;
+}
+
+bool walkCanonMakerNote(const Reader& reader, ParseState& state)
+{
+    std::vector<Entry> entries {};
+    reader.readIfd(state.makerNote, entries);
+    if (entries.empty())
+        return false;
+
+    bool haveSensorInfo = false;
+    for (auto& entry : entries) {
+        switch (entry.tag) {
+        case CanonCameraSettings:
+            state.record.quality = static_cast<std::int16_t>(reader.integer(entry, 3));
+            state.record.lens_id = reader.integer(entry, 22);
+            break;
+        case CanonSerialNumber:
+            state.canonSerial = reader.integer(entry);
+            break;
+        case CanonLensModel:
+            if (state.record.lens.empty())
+                state.record.lens = reader.string(entry);
+            break;
+        case CanonSensorInfo:
+            if (entry.count > 8) {
+                auto left = reader.integer(entry, 5);
+                auto top = reader.integer(entry, 6);
+                auto right = reader.integer(entry, 7);
+                auto bottom = reader.integer(entry, 8);
+                state.record.raw_width = static_cast<unsigned short>(reader.integer(entry, 1));
+                state.record.raw_height = static_cast<unsigned short>(reader.integer(entry, 2));
+                if (right > left && bottom > top) {
+                    state.record.width = static_cast<unsigned short>(right - left + 1);
+                    state.record.height = static_cast<unsigned short>(bottom - top + 1);
+                    haveSensorInfo = true;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (state.record.body_serial.empty() && state.canonSerial != 0)
+        state.record.body_serial = std::to_string(state.canonSerial);
+    return haveSensorInfo;
+}
+
+// Previews are baseline or progressive JPEGs. CR2 also stores the raw image itself as a lossless JPEG (SOF3),
+// which only the start-of-frame marker tells apart.
+bool isPreviewJpeg(const Reader& reader, const EmbeddedPreview& preview)
+{
+    if (preview.length < 4 || !reader.inBounds(preview.offset, preview.length))
+        return false;
+    const auto* data = reader.at(preview.offset);
+    if (data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+
+    std::size_t position = 2;
+    for (std::size_t segments = 0; segments < maxEntriesPerIfd && position + 4 <= preview.length; ++segments) {
+        if (data[position] != 0xFF)
+            return false;
+        auto marker = data[position + 1];
+        if (marker == 0xFF) {
+            ++position; // Fill byte
+            continue;
+        }
+        if (marker >= 0xC0 && marker <= 0xC2)
+            return true;
+        // Any other start of frame (DHT, JPG and DAC share the range), or image data before one
+        if ((marker >= 0xC3 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) || marker == 0xDA || marker == 0xD9)
+            return false;
+        position += 2 + (std::size_t { data[position + 2] } << 8 | data[position + 3]);
+    }
+    return false;
+}
+
+void walkPreviews(const Reader& reader, std::size_t offset, std::optional<EmbeddedPreview>& largest, std::size_t& ifdsVisited, bool topLevel)
+{
+    std::vector<Entry> entries {};
+    while (offset != 0 && ifdsVisited++ < maxIfds) {
+        auto next = reader.readIfd(offset, entries);
+
+        EmbeddedPreview interchange {};
+        EmbeddedPreview strip {};
+        std::uint32_t compression = 0;
+        std::vector<std::size_t> subIfds {};
+        for (auto& entry : entries) {
+            switch (entry.tag) {
+            case JPEGInterchangeFormat:
+                interchange.offset = reader.integer(entry);
+                break;
+            case JPEGInterchangeFormatLength:
+                interchange.length = reader.integer(entry);
+                break;
+            case Compression:
+                compression = reader.integer(entry);
+                break;
+            // A JPEG stored as image data is only taken whole, from a single strip
+            case StripOffsets:
+                if (entry.count == 1)
+                    strip.offset = reader.integer(entry);
+                break;
+            case StripByteCounts:
+                if (entry.count == 1)
+                    strip.length = reader.integer(entry);
+                break;
+            case SubIFDs:
+                for (std::uint32_t i = 0; i < entry.count && i < maxIfds; ++i)
+                    subIfds.push_back(reader.integer(entry, i));
+                break;
+            default:
+                break;
+            }
+        }
+
+        auto consider = [&](const EmbeddedPreview& candidate) {
+            if ((!largest.has_value() || candidate.length > largest->length) && isPreviewJpeg(reader, candidate))
+                largest = candidate;
+        };
+        consider(interchange);
+        if (compression == 6 || compression == 7)
+            consider(strip);
+
+        for (auto subIfd : subIfds)
+            walkPreviews(reader, subIfd, largest, ifdsVisited, false);
+
+        if (!topLevel)
+            break;
+        offset = next;
+    }
+}
+
+}
+
+bool TiffParser::supports(const std::filesystem::path& path)
+{
+    auto format = rawFormatFromFilename(path.native());
+    return format == RawFormat::Arw || format == RawFormat::Cr2;
+}
+
+std::optional<PhotoRecord> TiffParser::parse(const unsigned char* data, std::size_t size)
+{
+    Reader reader { data, size };
+    std::size_t firstIfd = 0;
+    if (!reader.readHeader(firstIfd))
+        return std::nullopt;
+
+    ParseState state {};
+    walkImageIfd(reader, firstIfd, state, true);
+    if (state.exifIfd == 0 || state.record.make.empty() || state.record.model.empty())
+        return std::nullopt;
+    walkExif(reader, state);
+
+    auto& record = state.record;
+    // LibRaw reports normalized maker names and strips them from the model
+    if (startsWithIgnoreCase(record.make, "Sony")) {
+        record.make = "Sony";
+        record.maker_index = LIBRAW_CAMERAMAKER_Sony;
+    } else if (startsWithIgnoreCase(record.make, "Canon")) {
+        record.make = "Canon";
+        record.maker_index = LIBRAW_CAMERAMAKER_Canon;
+    } else {
+        return std::nullopt;
+    }
+    if (startsWithIgnoreCase(record.model, record.make) && record.model.size() > record.make.size() && record.model[record.make.size()] == ' ')
+        record.model = record.model.view().substr(record.make.size() + 1);
+
+    if (state.makerNote == 0)
+        return std::nullopt;
+    if (record.maker_index == LIBRAW_CAMERAMAKER_Sony) {
+        if (!walkSonyMakerNote(reader, state) || state.raw.width == 0)
+            return std::nullopt;
+        record.raw_width = static_cast<unsigned short>(state.raw.width);
+        record.raw_height = static_cast<unsigned short>(state.raw.height);
+        record.width = static_cast<unsigned short>(state.raw.cropWidth != 0 ? state.raw.cropWidth : state.raw.width);
+        record.height = static_cast<unsigned short>(state.raw.cropHeight != 0 ? state.raw.cropHeight : state.raw.height);
+    } else if (!walkCanonMakerNote(reader, state)) {
+        return std::nullopt;
+    }
+
+    record.timestamp = parseExifDate(state.dateTimeOriginal.empty() ? state.dateTime : state.dateTimeOriginal);
+    if (record.timestamp == 0 || record.iso_speed == 0.0f || record.shutter == 0.0f)
+        return std::nullopt;
+
+    return record;
+}
+
+std::optional<EmbeddedPreview> TiffParser::findPreview(const unsigned char* data, std::size_t size)
+{
+    Reader reader { data, size };
+    std::size_t firstIfd = 0;
+    if (!reader.readHeader(firstIfd))
+        return std::nullopt;
+
+    std::optional<EmbeddedPreview> largest {};
+    std::size_t ifdsVisited = 0;
+    walkPreviews(reader, firstIfd, largest, ifdsVisited, true);
+    return largest;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+
+#include "PhotoRecord.h"
+
+/// @brief Where in the file an embedded JPEG is stored
+struct EmbeddedPreview {
+    std::size_t offset { 0 };
+    std::size_t length { 0 };
+};
+
+/// @brief Minimal TIFF/EXIF reader for TIFF-based raw containers (Sony ARW, Canon CR2).
+/// Walks IFD0, its SubIFDs, the EXIF IFD and the Sony or Canon makernote, skipping LibRaw's camera
+/// identification entirely.
+class TiffParser final {
+public:
+    /// @brief Whether the file extension names a container this parser handles
+    [[nodiscard]] static bool supports(const std::filesystem::path&);
+
+    /// @brief Returns nothing for anything it does not fully understand, callers should fall back to LibRaw then
+    [[nodiscard]] static std::optional<PhotoRecord> parse(const unsigned char* data, std::size_t size);
+
+    /// @brief The largest baseline or progressive JPEG referenced from any IFD, i.e. the camera's full preview.
+    /// Works on any TIFF-based container (ARW, CR2, NEF, DNG, ...), not just the ones supports() names.
+    [[nodiscard]] static std::optional<EmbeddedPreview> findPreview(const unsigned char* data, std::size_t size);
+};
@@ -1,3 +1,5 @@
+#include <array>
+#include <atomic>
 #include <fmt/chrono.h>
 
 #include "TimeUtils.h"
@@ -33,72 +35,202 @@ constexpr auto timeDifference(const std::time_t& start, const std::time_t& end)
     return std::chrono::duration_cast<TimeUnit>(Clock::from_time_t(end) - Clock::from_time_t(start));
 }
 
-ALWAYS_INLINE std::string formatEnding(const char* unit, long number, const char* postfix = "ago")
+ALWAYS_INLINE fmt::appender appendEnding(fmt::appender out, const char* unit, long number, const char* postfix = "ago")
 {
     if (number == 1)
-        return fmt::format("{} {} {}", number, unit, postfix);
-    return fmt::format("{} {}s {}", number, unit, postfix);
+        return fmt::format_to(out, "{} {} {}", number, unit, postfix);
+    return fmt::format_to(out, "{} {}s {}", number, unit, postfix);
 }
 
-std::string TimeUtils::formatISO8601(const std::time_t timestamp)
+template <typename... Args>
+static std::string toString(fmt::appender (*append)(fmt::appender, Args...), Args... args)
 {
-    return fmt::format("{:%Y-%m-%dT%H:%M:%S%z}", fmt::localtime(timestamp));
+    fmt::memory_buffer buffer {};
+    append(fmt::appender(buffer), args...);
+    return fmt::to_string(buffer);
 }
 
-std::string TimeUtils::formatTimeSpan(const std::time_t start, const std::time_t end)
+static std::atomic<std::time_t> capturedNow { std::time(nullptr) };
+
+void TimeUtils::captureNow(std::time_t now)
+{
+    capturedNow.store(now, std::memory_order_relaxed);
+}
+
+std::time_t TimeUtils::now()
+{
+    return capturedNow.load(std::memory_order_relaxed);
+}
+
+namespace {
+
+/// @brief UTC offsets during one UTC day, assuming at most one DST transition per day
+struct DayOffsets {
+    std::int64_t day { std::numeric_limits<std::int64_t>::min() };
+    // First second at which `after` applies
+    std::time_t transition {};
+    long before {};
+    long after {};
+};
+
+// Per thread, so formatting never contends; photos cluster on few days, so a small direct-mapped cache hits
+constexpr std::size_t offsetCacheSize = 64;
+thread_local std::array<DayOffsets, offsetCacheSize> offsetCache {};
+
+std::int64_t floorDivide(std::int64_t value, std::int64_t divisor)
+{
+    return value / divisor - (value % divisor < 0 ? 1 : 0);
+}
+
+// localtime_r takes the libc timezone lock, so it only runs on cache misses
+long lookUpUtcOffset(std::time_t timestamp)
+{
+    std::tm local {};
+    localtime_r(&timestamp, &local);
+    return local.tm_gmtoff;
+}
+
+long utcOffset(std::time_t timestamp)
+{
+    auto day = floorDivide(timestamp, secondsInDay);
+    auto& entry = offsetCache[static_cast<std::size_t>(day) % offsetCacheSize];
+    if (entry.day != day) {
+        std::time_t start = day * secondsInDay;
+        std::time_t end = start + secondsInDay - 1;
+        entry.before = lookUpUtcOffset(start);
+        entry.after = lookUpUtcOffset(end);
+        entry.transition = end + 1;
+        if (entry.before != entry.after) {
+            // Binary search for the transition, once per such day
+            auto low = start, high = end;
+            while (low < high) {
+                auto middle = low + (high - low) / 2;
+                if (lookUpUtcOffset(middle) == entry.before)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            entry.transition = low;
+        }
+        entry.day = day;
+    }
+    return timestamp < entry.transition ? entry.before : entry.after;
+}
+
+struct CivilDate {
+    std::int64_t year;
+    unsigned month;
+    unsigned day;
+};
+
+// Howard Hinnant's civil_from_days: proleptic Gregorian date of a day count since 1970-01-01
+CivilDate civilFromDays(std::int64_t days)
+{
+    days += 719468;
+    auto era = (days >= 0 ? days : days - 146096) / 146097;
+    auto dayOfEra = static_cast<unsigned>(days - era * 146097);
+    auto yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    auto dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    auto shiftedMonth = (5 * dayOfYear + 2) / 153;
+    auto day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    auto month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    auto year = static_cast<std::int64_t>(yearOfEra) + era * 400 + (month <= 2 ? 1 : 0);
+    return { year, month, day };
+}
+
+}
+
+LocalHour TimeUtils::localHour(const std::time_t timestamp)
+{
+    auto local = static_cast<std::int64_t>(timestamp) + utcOffset(timestamp);
+    auto days = floorDivide(local, secondsInDay);
+    auto date = civilFromDays(days);
+    return { date.year, date.month, date.day, static_cast<unsigned>((local - days * secondsInDay) / secondsInHour) };
+}
+
+fmt::appender TimeUtils::appendISO8601(fmt::appender out, const std::time_t timestamp)
+{
+    auto offset = utcOffset(timestamp);
+    auto local = static_cast<std::int64_t>(timestamp) + offset;
+    auto days = floorDivide(local, secondsInDay);
+    auto secondOfDay = local - days * secondsInDay;
+    auto date = civilFromDays(days);
+
+    auto offsetMinutes = std::abs(offset) / secondsInMinute;
+    return fmt::format_to(out, "{:04}-{:02}-{:02}T{:02}:{:02}:{:02}{}{:02}{:02}", date.year, date.month, date.day,
+        secondOfDay / secondsInHour, secondOfDay % secondsInHour / secondsInMinute, secondOfDay % secondsInMinute,
+        offset < 0 ? '-' : '+', offsetMinutes / 60, offsetMinutes % 60);
+}
+
+fmt::appender TimeUtils::appendTimeSpan(fmt::appender out, const std::time_t start, const std::time_t end)
 {
     const auto duration = timeDifference(start, end);
     const auto seconds = duration.count();
     if (duration < 1s)
-        return "less than a second";
+        return fmt::format_to(out, "less than a second");
     if (duration < 1min)
-        return fmt::format("{} seconds", seconds);
+        return fmt::format_to(out, "{} seconds", seconds);
     if (duration < 1h) {
         if (seconds % secondsInMinute == 0)
-            return fmt::format("{} minutes", duration / 1min);
-        return fmt::format("{} minutes, {} seconds", duration / 1min, duration % 1min);
+            return fmt::format_to(out, "{} minutes", duration / 1min);
+        return fmt::format_to(out, "{} minutes, {} seconds", duration / 1min, duration % 1min);
     }
     // Now the chrono library begins to fall apart, yay!
     if (duration < day) {
         // TODO These checks get progressively more useless. Stop using second-precision after this point.
         if (seconds % secondsInHour == 0)
-            return fmt::format("{} hours", duration / 1h);
-        return fmt::format("{} hours, {} minutes", duration / 1h, duration % 1h / 1min);
+            return fmt::format_to(out, "{} hours", duration / 1h);
+        return fmt::format_to(out, "{} hours, {} minutes", duration / 1h, duration % 1h / 1min);
     }
     if (duration < month) {
         if (seconds % secondsInDay == 0)
-            return fmt::format("{} days", duration / day);
-        return fmt::format("{} days, {} hours", duration / day, duration % day / 1h);
+            return fmt::format_to(out, "{} days", duration / day);
+        return fmt::format_to(out, "{} days, {} hours", duration / day, duration % day / 1h);
     }
     // To make it even worse, after this point we get inaccuracies!
     if (duration < year) {
         if (seconds % secondsInMonth == 0)
-            return fmt::format("{} months", duration / month);
-        return fmt::format("approx. {} months, {} days", duration / month, duration % month / day);
+            return fmt::format_to(out, "{} months", duration / month);
+        return fmt::format_to(out, "approx. {} months, {} days", duration / month, duration % month / day);
     }
     if (seconds % secondsInYear == 0)
-        return fmt::format("{} years", duration / year);
-    return fmt::format("approx. {} years, {} months", duration / year, duration % year / month);
+        return fmt::format_to(out, "{} years", duration / year);
+    return fmt::format_to(out, "approx. {} years, {} months", duration / year, duration % year / month);
 }
 
-std::string TimeUtils::formatTimeSince(const std::time_t timestamp)
+fmt::appender TimeUtils::appendTimeSince(fmt::appender out, const std::time_t timestamp)
 {
-    auto duration = timeDifference(timestamp, Clock::to_time_t(Clock::now()));
+    auto duration = timeDifference(timestamp, now());
     auto seconds = duration.count();
 
     if (duration < 1s)
-        return "just now";
+        return fmt::format_to(out, "just now");
     if (duration < 1min)
-        return formatEnding("second", seconds);
+        return appendEnding(out, "second", seconds);
     if (duration < 1h)
-        return formatEnding("minute", seconds / secondsInMinute);
+        return appendEnding(out, "minute", seconds / secondsInMinute);
     if (duration < day)
-        return formatEnding("hour", seconds / secondsInHour);
+        return appendEnding(out, "hour", seconds / secondsInHour);
     if (duration < week)
-        return formatEnding("day", seconds / secondsInDay);
+        return appendEnding(out, "day", seconds / secondsInDay);
     if (duration < month)
-        return formatEnding("week", seconds / secondsInWeek);
+        return appendEnding(out, "week", seconds / secondsInWeek);
     if (duration < year)
-        return formatEnding("month", seconds / secondsInMonth);
-    return formatEnding("year", seconds / secondsInYear);
+        return appendEnding(out, "month", seconds / secondsInMonth);
+    return appendEnding(out, "year", seconds / secondsInYear);
+}
+
+std::string TimeUtils::formatISO8601(const std::time_t timestamp)
+{
+    return toString(appendISO8601, timestamp);
+}
+
+std::string TimeUtils::formatTimeSpan(const std::time_t start, const std::time_t end)
+{
+    return toString(appendTimeSpan, start, end);
+}
+
+std::string TimeUtils::formatTimeSince(const std::time_t timestamp)
+{
+    return toString(appendTimeSince, timestamp);
 }
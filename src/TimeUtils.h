@@ -1,11 +1,36 @@
 #pragma once
 
+#include <cstdint>
 #include <ctime>
+#include <fmt/format.h>
 #include <string>
 
+/// @brief Local calendar date and hour of a timestamp
+struct LocalHour {
+    std::int64_t year;
+    unsigned month;
+    unsigned day;
+    unsigned hour;
+};
+
+/// @brief Human-readable timestamps and durations. Like FormatUtils, the append* variants write into a
+/// caller-owned fmt buffer without allocating, and take no locks once a day's UTC offset has been looked up.
 class TimeUtils final {
 public:
+    /// @brief Sets the moment formatTimeSince measures from. Taken when the program starts; long-running
+    /// modes call this again before each batch of output instead of reading the clock per file.
+    static void captureNow(std::time_t now = std::time(nullptr));
+    [[nodiscard]] static std::time_t now();
+
+    /// @brief Same conversion as appendISO8601, cheap enough to run for every photo
+    [[nodiscard]] static LocalHour localHour(std::time_t);
+
     static std::string formatISO8601(std::time_t);
     static std::string formatTimeSpan(std::time_t start, std::time_t end);
     static std::string formatTimeSince(std::time_t);
+
+    /// @brief Local time with UTC offset, same output as strftime's "%Y-%m-%dT%H:%M:%S%z"
+    static fmt::appender appendISO8601(fmt::appender, std::time_t);
+    static fmt::appender appendTimeSpan(fmt::appender, std::time_t start, std::time_t end);
+    static fmt::appender appendTimeSince(fmt::appender, std::time_t);
 };
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <fmt/format.h>
+
+#include "TimeUtils.h"
+#include "Timeline.h"
+
+static constexpr float lowestBinIso = 12.5f;
+
+std::optional<TimelineBucket> parseTimelineBucket(std::string_view name)
+{
+    if (name == "none")
+        return TimelineBucket::None;
+    if (name == "hour")
+        return TimelineBucket::Hour;
+    if (name == "day")
+        return TimelineBucket::Day;
+    if (name == "month")
+        return TimelineBucket::Month;
+    return std::nullopt;
+}
+
+std::size_t IsoHistogram::bin(float isoSpeed)
+{
+    // Also catches zero, negative and NaN values
+    if (!(isoSpeed > lowestBinIso))
+        return 0;
+    auto thirds = std::lround(3.0 * std::log2(static_cast<double>(isoSpeed / lowestBinIso)));
+    return static_cast<std::size_t>(std::min<long>(thirds, binCount - 1));
+}
+
+void IsoHistogram::add(float isoSpeed)
+{
+    auto index = bin(isoSpeed);
+    ++m_counts[index];
+    m_values[index] = std::max(m_values[index], isoSpeed);
+}
+
+void IsoHistogram::merge(const IsoHistogram& other)
+{
+    for (std::size_t index = 0; index < binCount; ++index) {
+        m_counts[index] += other.m_counts[index];
+        m_values[index] = std::max(m_values[index], other.m_values[index]);
+    }
+}
+
+float IsoHistogram::median() const
+{
+    std::uint64_t total = 0;
+    for (auto count : m_counts)
+        total += count;
+
+    std::uint64_t seen = 0;
+    for (std::size_t index = 0; index < binCount; ++index) {
+        seen += m_counts[index];
+        if (seen > total / 2)
+            return m_values[index];
+    }
+    return 0.0f;
+}
+
+void IsoHistogram::save(ByteWriter& writer) const
+{
+    writer.write(m_counts);
+    writer.write(m_values);
+}
+
+void IsoHistogram::load(ByteReader& reader)
+{
+    m_counts = reader.read<decltype(m_counts)>();
+    m_values = reader.read<decltype(m_values)>();
+}
+
+Timeline::Timeline(TimelineBucket bucket, std::chrono::minutes sessionGap)
+    : m_bucket(bucket)
+    , m_sessionGap(static_cast<std::time_t>(std::chrono::seconds { sessionGap }.count()))
+{
+}
+
+std::int64_t Timeline::periodKey(std::time_t timestamp) const
+{
+    auto local = TimeUtils::localHour(timestamp);
+    std::int64_t key = local.year * 100 + local.month;
+    key = key * 100 + (m_bucket != TimelineBucket::Month ? local.day : 0);
+    return key * 100 + (m_bucket == TimelineBucket::Hour ? local.hour : 0);
+}
+
+// Insertion into a short sorted vector, ids stay unique
+static void addId(std::vector<InternTable::Id>& ids, InternTable::Id id)
+{
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id)
+        ids.insert(it, id);
+}
+
+void Timeline::add(std::time_t timestamp, InternTable::Id camera, InternTable::Id lens, float isoSpeed)
+{
+    // LibRaw and the fast path report a missing or unparsable date as zero
+    if (timestamp == 0) {
+        ++m_undated;
+        return;
+    }
+
+    auto& period = m_periods[periodKey(timestamp)];
+    ++period.photos;
+    addId(period.cameras, camera);
+    addId(period.lenses, lens);
+    period.iso_speeds.add(isoSpeed);
+
+    addSpan(timestamp, timestamp, 1);
+}
+
+void Timeline::addSpan(std::time_t start, std::time_t end, std::uint64_t photos)
+{
+    // Sessions are disjoint and more than the gap apart, so the ones within reach are the last few starting before
+    // `end` plus the gap
+    auto it = m_sessions.upper_bound(end + m_sessionGap);
+    if (it != m_sessions.begin()) {
+        auto previous = std::prev(it);
+        // The common case, a photo inside or just after the session it belongs to: only that session is in reach
+        if (previous->first <= start && previous->second.end + m_sessionGap >= start) {
+            previous->second.end = std::max(previous->second.end, end);
+            previous->second.photos += photos;
+            return;
+        }
+    }
+    while (it != m_sessions.begin()) {
+        auto previous = std::prev(it);
+        if (previous->second.end + m_sessionGap < start)
+            break;
+        start = std::min(start, previous->first);
+        end = std::max(end, previous->second.end);
+        photos += previous->second.photos;
+        it = m_sessions.erase(previous);
+    }
+    m_sessions.emplace_hint(it, start, Span { end, photos });
+}
+
+void Timeline::merge(const Timeline& other, const std::vector<InternTable::Id>& cameraIds, const std::vector<InternTable::Id>& lensIds)
+{
+    for (auto& [key, otherPeriod] : other.m_periods) {
+        auto& period = m_periods[key];
+        period.photos += otherPeriod.photos;
+        for (auto camera : otherPeriod.cameras)
+            addId(period.cameras, cameraIds[camera]);
+        for (auto lens : otherPeriod.lenses)
+            addId(period.lenses, lensIds[lens]);
+        period.iso_speeds.merge(otherPeriod.iso_speeds);
+    }
+    for (auto& [start, span] : other.m_sessions)
+        addSpan(start, span.end, span.photos);
+    m_undated += other.m_undated;
+}
+
+std::vector<Session> Timeline::sessions() const
+{
+    std::vector<Session> sessions {};
+    sessions.reserve(m_sessions.size());
+    for (auto& [start, span] : m_sessions)
+        sessions.push_back(Session { start, span.end, span.photos });
+    return sessions;
+}
+
+std::string Timeline::formatPeriod(std::int64_t key) const
+{
+    auto hour = key % 100;
+    auto day = key / 100 % 100;
+    auto month = key / 10000 % 100;
+    auto year = key / 1000000;
+    switch (m_bucket) {
+    case TimelineBucket::Hour:
+        return fmt::format("{:04}-{:02}-{:02} {:02}:00", year, month, day, hour);
+    case TimelineBucket::Day:
+        return fmt::format("{:04}-{:02}-{:02}", year, month, day);
+    case TimelineBucket::Month:
+        return fmt::format("{:04}-{:02}", year, month);
+    case TimelineBucket::None:
+        break;
+    }
+    return {};
+}
+
+void Timeline::save(ByteWriter& writer) const
+{
+    writer.write(m_bucket);
+    writer.write(static_cast<std::int64_t>(m_sessionGap));
+    writer.write(m_undated);
+    writer.write(static_cast<std::uint64_t>(m_periods.size()));
+    for (auto& [key, period] : m_periods) {
+        writer.write(key);
+        writer.write(period.photos);
+        writer.writeArray(period.cameras);
+        writer.writeArray(period.lenses);
+        period.iso_speeds.save(writer);
+    }
+    writer.write(static_cast<std::uint64_t>(m_sessions.size()));
+    for (auto& [start, span] : m_sessions) {
+        writer.write(static_cast<std::int64_t>(start));
+        writer.write(static_cast<std::int64_t>(span.end));
+        writer.write(span.photos);
+    }
+}
+
+void Timeline::load(ByteReader& reader)
+{
+    m_bucket = reader.read<TimelineBucket>();
+    m_sessionGap = static_cast<std::time_t>(reader.read<std::int64_t>());
+    m_undated = reader.read<std::uint64_t>();
+    if (m_bucket > TimelineBucket::Month || m_sessionGap <= 0)
+        reader.fail();
+
+    m_periods.clear();
+    auto periods = reader.read<std::uint64_t>();
+    for (std::uint64_t index = 0; index < periods && !reader.failed(); ++index) {
+        auto& period = m_periods[reader.read<std::int64_t>()];
+        period.photos = reader.read<std::uint64_t>();
+        period.cameras = reader.readArray<InternTable::Id>();
+        period.lenses = reader.readArray<InternTable::Id>();
+        period.iso_speeds.load(reader);
+    }
+
+    m_sessions.clear();
+    auto sessions = reader.read<std::uint64_t>();
+    for (std::uint64_t index = 0; index < sessions && !reader.failed(); ++index) {
+        auto start = static_cast<std::time_t>(reader.read<std::int64_t>());
+        auto end = static_cast<std::time_t>(reader.read<std::int64_t>());
+        auto photos = reader.read<std::uint64_t>();
+        if (end < start)
+            reader.fail();
+        addSpan(start, end, photos);
+    }
+}
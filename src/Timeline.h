@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "InternTable.h"
+#include "Serialization.h"
+
+/// @brief What --timeline buckets photos by
+enum class TimelineBucket : std::uint8_t {
+    None,
+    Hour,
+    Day,
+    Month,
+};
+
+[[nodiscard]] std::optional<TimelineBucket> parseTimelineBucket(std::string_view);
+
+/// @brief Default --session-gap
+constexpr std::chrono::minutes defaultSessionGap { 60 };
+
+/// @brief ISO speeds counted in 1/3-stop bins, the steps cameras use, so a median costs the same 768 bytes however
+/// many photos there are. Each bin remembers the highest ISO it has seen; for the nominal values cameras record
+/// that is the only one in the bin, which makes the median exact in practice.
+class IsoHistogram final {
+public:
+    void add(float isoSpeed);
+    void merge(const IsoHistogram& other);
+
+    /// @brief Upper median, like StreamingStats::quantile(0.5), zero if empty
+    [[nodiscard]] float median() const;
+
+    void save(ByteWriter&) const;
+    void load(ByteReader&);
+
+private:
+    // Bin 0 is ISO 12.5 and below, the last one ISO 26 million and above
+    static constexpr std::size_t binCount = 64;
+
+    [[nodiscard]] static std::size_t bin(float isoSpeed);
+
+    std::array<std::uint64_t, binCount> m_counts {};
+    std::array<float, binCount> m_values {};
+};
+
+/// @brief The photos taken within one hour, day or month
+struct TimelinePeriod {
+    std::uint64_t photos { 0 };
+    /// @brief Distinct ids from the owning Data's camera and lens KeyCounts, sorted. These grow with the number
+    /// of cameras and lenses used in the period, not with its photos.
+    std::vector<InternTable::Id> cameras {};
+    std::vector<InternTable::Id> lenses {};
+    IsoHistogram iso_speeds {};
+};
+
+/// @brief Photos with no gap longer than the session gap between consecutive ones
+struct Session {
+    std::time_t start;
+    std::time_t end;
+    std::uint64_t photos;
+};
+
+/// @brief --timeline: photo counts, distinct cameras and lenses and the median ISO per hour, day or month, and the
+/// shooting sessions. Filled in the same pass as the rest of Data without keeping or sorting any timestamps:
+/// periods are keyed by their local calendar date, and sessions are kept as disjoint intervals that every photo
+/// either falls into, extends or bridges.
+class Timeline final {
+public:
+    explicit Timeline(TimelineBucket = TimelineBucket::None, std::chrono::minutes sessionGap = defaultSessionGap);
+
+    [[nodiscard]] bool enabled() const { return m_bucket != TimelineBucket::None; }
+    [[nodiscard]] TimelineBucket bucket() const { return m_bucket; }
+    [[nodiscard]] std::chrono::minutes sessionGap() const { return std::chrono::duration_cast<std::chrono::minutes>(std::chrono::seconds { m_sessionGap }); }
+
+    void add(std::time_t timestamp, InternTable::Id camera, InternTable::Id lens, float isoSpeed);
+
+    /// @param cameraIds, lensIds Map the other instance's camera and lens ids to this instance's
+    void merge(const Timeline& other, const std::vector<InternTable::Id>& cameraIds, const std::vector<InternTable::Id>& lensIds);
+
+    /// @brief Periods in chronological order, keyed by their start as YYYYMMDDHH, with the parts finer than the
+    /// bucket left zero
+    [[nodiscard]] const std::map<std::int64_t, TimelinePeriod>& periods() const { return m_periods; }
+    /// @brief In chronological order
+    [[nodiscard]] std::vector<Session> sessions() const;
+    /// @brief Photos without a timestamp, which are left out
+    [[nodiscard]] std::uint64_t undated() const { return m_undated; }
+
+    /// @brief "2024-05-01 14:00", "2024-05-01" or "2024-05"
+    [[nodiscard]] std::string formatPeriod(std::int64_t key) const;
+
+    /// @brief Writes the settings, periods and sessions; camera and lens ids refer to the KeyCounts saved alongside
+    void save(ByteWriter&) const;
+    /// @brief Replaces this instance with a saved one, settings included
+    void load(ByteReader&);
+
+private:
+    struct Span {
+        std::time_t end;
+        std::uint64_t photos;
+    };
+
+    [[nodiscard]] std::int64_t periodKey(std::time_t) const;
+    /// @brief Adds `photos` taken between `start` and `end`, joining every session within the gap of them
+    void addSpan(std::time_t start, std::time_t end, std::uint64_t photos);
+
+    TimelineBucket m_bucket;
+    std::time_t m_sessionGap;
+    std::map<std::int64_t, TimelinePeriod> m_periods {};
+    /// @brief Keyed by start, more than the session gap apart
+    std::map<std::time_t, Span> m_sessions {};
+    std::uint64_t m_undated { 0 };
+};
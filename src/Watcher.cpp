@@ -0,0 +1,366 @@
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "Discovery.h"
+#include "Profiler.h"
+#include "Summary.h"
+#include "TimeUtils.h"
+#include "Watcher.h"
+
+namespace fs = std::filesystem;
+namespace chrono = std::chrono;
+
+using fmt::print, fmt::fg, fmt::color;
+
+// Files are picked up once their writer closes them, or when they are moved in complete
+static constexpr std::uint32_t watchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR;
+// After an event, wait this long for the rest of a burst (e.g. a card dump) before updating
+static constexpr int settleMilliseconds = 250;
+
+static bool isWatchedFile(const fs::path& path, bool sniff)
+{
+    return !path.filename().native().starts_with('.') && isRawFile(path, sniff);
+}
+
+static bool isWithin(const fs::path& path, const fs::path& root)
+{
+    auto [rootEnd, pathEnd] = std::mismatch(ITERATORS(root), path.begin(), path.end());
+    return rootEnd == root.end();
+}
+
+Watcher::Watcher(const CommandlineOptions& options, const ScanContext& context)
+    : m_options(options)
+    , m_context(context)
+    , m_settled(emptyData())
+{
+    m_context.failures = &m_failures;
+}
+
+Watcher::~Watcher()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+Data Watcher::emptyData() const
+{
+    return Data { m_options.exactStats, m_options.groupBy, m_options.timeline, m_options.sessionGap };
+}
+
+Watcher::Directory& Watcher::directory(const fs::path& path)
+{
+    return m_directories.try_emplace(path, Directory { .data = emptyData() }).first->second;
+}
+
+PhotoSample Watcher::intern(const PhotoRecord& record)
+{
+    auto lens = m_lenses.intern(record.lens_make, record.lens, record.lens_id);
+    auto camera = m_cameras.intern(record.make, record.model);
+    return PhotoSample::from(record, camera, lens);
+}
+
+void Watcher::markDirty(const fs::path& path, Directory& directory)
+{
+    directory.dirty = true;
+    // Directories edited once tend to be edited again, they stay out of m_settled from now on
+    if (directory.settled) {
+        directory.settled = false;
+        m_unsettled.insert(path);
+        m_settledStale = true;
+    }
+}
+
+void Watcher::rebuild(Directory& directory)
+{
+    if (!directory.dirty)
+        return;
+    directory.data = emptyData();
+    for (auto& [name, sample] : directory.samples)
+        directory.data.add(sample, m_cameras, m_lenses);
+    directory.dirty = false;
+}
+
+void Watcher::add(const fs::path& path, const PhotoRecord& record)
+{
+    auto normalized = path.lexically_normal();
+    std::scoped_lock lock { m_mutex };
+    auto& entry = directory(normalized.parent_path());
+    entry.samples.insert_or_assign(normalized.filename().string(), intern(record));
+    // Built on the first update along with m_settled, adding here would duplicate the scan's own aggregation
+    entry.dirty = true;
+}
+
+void Watcher::watchTree(const fs::path& root, bool scanFiles)
+{
+    auto watch = [this](const fs::path& directory) {
+        auto wd = inotify_add_watch(m_fd, directory.c_str(), watchMask);
+        if (wd < 0) {
+            print(stderr, fg(color::yellow), "Could not watch {}: {}\n", directory.string(), std::strerror(errno));
+            return;
+        }
+        m_watches.insert_or_assign(wd, directory.lexically_normal());
+    };
+
+    // The watch goes first, so files created while listing are reported by inotify or by the listing
+    watch(root);
+    std::error_code error {};
+    for (fs::recursive_directory_iterator it { root, error }, end; !error && it != end; it.increment(error)) {
+        if (it->is_directory(error) && !it->is_symlink(error))
+            watch(it->path());
+        else if (scanFiles && isWatchedFile(it->path(), m_options.sniff))
+            markChanged(it->path().lexically_normal());
+    }
+}
+
+void Watcher::forgetTree(const fs::path& root)
+{
+    for (auto it = m_watches.begin(); it != m_watches.end();) {
+        if (isWithin(it->second, root)) {
+            inotify_rm_watch(m_fd, it->first);
+            it = m_watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = m_directories.begin(); it != m_directories.end();) {
+        if (isWithin(it->first, root)) {
+            if (it->second.settled && !it->second.samples.empty())
+                m_settledStale = true;
+            m_unsettled.erase(it->first);
+            it = m_directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    std::erase_if(m_changed, [&](auto& path) { return isWithin(path, root); });
+}
+
+void Watcher::resync()
+{
+    // Events were dropped: pick up files we don't know yet and drop records of files that are gone.
+    // Files modified in place during the overflow keep their old record until they change again.
+    for (auto& [wd, path] : m_watches) {
+        std::error_code error {};
+        for (fs::directory_iterator it { path, error }, end; !error && it != end; it.increment(error)) {
+            auto file = it->path().lexically_normal();
+            if (!isWatchedFile(file, m_options.sniff))
+                continue;
+            auto directory = m_directories.find(path);
+            if (directory == m_directories.end() || !directory->second.samples.contains(file.filename().string()))
+                markChanged(file);
+        }
+    }
+    for (auto& [path, directory] : m_directories) {
+        for (auto& [name, sample] : directory.samples) {
+            if (!fs::exists(path / name))
+                markRemoved(path / name);
+        }
+    }
+}
+
+void Watcher::markChanged(const fs::path& path)
+{
+    m_removed.erase(path);
+    m_changed.insert(path);
+}
+
+bool Watcher::isTracked(const fs::path& path) const
+{
+    // Sniffed files can't be classified anymore once they are gone, but then they have a record or a pending change
+    if (m_changed.contains(path))
+        return true;
+    auto directory = m_directories.find(path.parent_path());
+    return directory != m_directories.end() && directory->second.samples.contains(path.filename().string());
+}
+
+void Watcher::markRemoved(const fs::path& path)
+{
+    m_changed.erase(path);
+    m_removed.insert(path);
+}
+
+void Watcher::applyChanges(OutputBuffer& out)
+{
+    for (auto& path : m_removed) {
+        auto directory = m_directories.find(path.parent_path());
+        if (directory != m_directories.end() && directory->second.samples.erase(path.filename().string()) != 0)
+            markDirty(directory->first, directory->second);
+    }
+
+    StageTimer timer { nullptr };
+    for (auto& path : m_changed) {
+        // Gone again before the batch settled
+        if (!fs::exists(path))
+            continue;
+        ExtractFailure failure {};
+        auto record = extractRecord(path, m_options, m_context, *m_raw, timer, failure);
+        auto parent = path.parent_path();
+        auto& entry = directory(parent);
+        if (!record.has_value()) {
+            reportFailure(m_context, failure, m_options);
+            // Whatever the file held before doesn't count anymore
+            if (entry.samples.erase(path.filename().string()) != 0)
+                markDirty(parent, entry);
+            continue;
+        }
+        if (auto* filter = m_context.filter; filter != nullptr) {
+            auto stat = filter->usesStat() ? filterStat(path) : std::nullopt;
+            // A file rewritten so it no longer matches drops out of the summary
+            if (filter->evaluate(FilterInput { path.native(), stat ? &*stat : nullptr, &*record }) != true) {
+                if (entry.samples.erase(path.filename().string()) != 0)
+                    markDirty(parent, entry);
+                continue;
+            }
+        }
+        auto sample = intern(*record);
+        auto [it, inserted] = entry.samples.insert_or_assign(path.filename().string(), sample);
+        if (!inserted) {
+            markDirty(parent, entry);
+        } else if (!entry.dirty) {
+            // Dirty directories pick it up when they are rebuilt
+            entry.data.add(sample, m_cameras, m_lenses);
+            if (entry.settled && !m_settledStale)
+                m_settled.add(sample, m_cameras, m_lenses);
+        }
+
+        if (!m_options.silent) {
+            printFileHeader(out, path);
+            printMetadata(out, *record, m_options);
+        }
+    }
+}
+
+void Watcher::printSummary(OutputBuffer& out, std::size_t changed, std::size_t removed)
+{
+    auto start = chrono::steady_clock::now();
+    if (m_settledStale) {
+        m_settled = emptyData();
+        for (auto& [path, directory] : m_directories) {
+            if (!directory.settled)
+                continue;
+            rebuild(directory);
+            m_settled.merge(directory.data);
+        }
+        m_settledStale = false;
+    }
+    // Only the directories that had files replaced or removed are merged per batch
+    auto total = m_settled;
+    for (auto& path : m_unsettled) {
+        auto& directory = m_directories.at(path);
+        rebuild(directory);
+        total.merge(directory.data);
+    }
+
+    out.print("\n");
+    out.print(fg(color::gray), "{} ", Formatted { TimeUtils::appendISO8601, TimeUtils::now() });
+    out.print("{} changed, {} removed\n", changed, removed);
+    // Only this batch's, a file that keeps failing is listed again whenever it changes
+    m_failures.print(out, m_options.fileTimeout);
+    m_failures.clear();
+    if (total.photoCount() == 0) {
+        out.print("No raw files left\n");
+        return;
+    }
+    ::printSummary(out, total, chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start));
+}
+
+bool Watcher::start(const std::vector<std::string>& directories)
+{
+    m_fd = inotify_init1(IN_CLOEXEC);
+    if (m_fd < 0) {
+        print(stderr, fg(color::red), "inotify_init1 failed: {}\n", std::strerror(errno));
+        return false;
+    }
+    for (auto& directory : directories)
+        watchTree(fs::path { directory }.lexically_normal(), false);
+    return true;
+}
+
+int Watcher::run()
+{
+    print(stderr, fg(color::gray), "Watching {} directories for changes\n", m_watches.size());
+
+    alignas(inotify_event) std::array<char, 64 * 1024> buffer {};
+    while (true) {
+        auto settled = false;
+        auto timeout = -1;
+        while (!settled) {
+            pollfd descriptor { .fd = m_fd, .events = POLLIN, .revents = 0 };
+            auto ready = poll(&descriptor, 1, timeout);
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready < 0) {
+                print(stderr, fg(color::red), "poll failed: {}\n", std::strerror(errno));
+                return 1;
+            }
+            if (ready == 0) {
+                settled = true;
+                continue;
+            }
+
+            auto length = read(m_fd, buffer.data(), buffer.size());
+            if (length < 0) {
+                if (errno == EINTR)
+                    continue;
+                print(stderr, fg(color::red), "Reading inotify events failed: {}\n", std::strerror(errno));
+                return 1;
+            }
+
+            for (auto* position = buffer.data(); position < buffer.data() + length;) {
+                auto* event = reinterpret_cast<const inotify_event*>(position);
+                position += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    print(stderr, fg(color::yellow), "inotify queue overflowed, rescanning watched directories\n");
+                    resync();
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    m_watches.erase(event->wd);
+                    continue;
+                }
+                auto watch = m_watches.find(event->wd);
+                if (watch == m_watches.end() || event->len == 0)
+                    continue;
+
+                auto path = (watch->second / event->name).lexically_normal();
+                if (event->mask & IN_ISDIR) {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                        watchTree(path, true);
+                    else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                        forgetTree(path);
+                    continue;
+                }
+                if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    if (isWatchedFile(path, m_options.sniff))
+                        markChanged(path);
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    if (isWatchedFile(path, false) || isTracked(path))
+                        markRemoved(path);
+                }
+            }
+            timeout = settleMilliseconds;
+        }
+
+        if (m_changed.empty() && m_removed.empty())
+            continue;
+
+        TimeUtils::captureNow();
+        OutputBuffer out { m_options.color };
+        auto changed = m_changed.size();
+        auto removed = m_removed.size();
+        applyChanges(out);
+        m_changed.clear();
+        m_removed.clear();
+        printSummary(out, changed, removed);
+        out.writeTo(stdout);
+        std::fflush(stdout);
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <filesystem>
+#include <libraw/libraw.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CommandlineOptions.h"
+#include "Data.h"
+#include "Extractor.h"
+#include "Output.h"
+#include "PhotoRecord.h"
+
+/// @brief --watch: keeps the summary current after the initial scan by following inotify events on the
+/// scanned directory trees. A PhotoSample of every file is kept per directory; new files are added to their
+/// directory's statistics directly, while modified or deleted ones only rebuild that directory from memory, so no
+/// update re-reads files that did not change. The statistics of all directories that never had a file replaced or
+/// removed are kept merged, a summary only merges the others into them. Files that can't be
+/// read never stop the watcher, whether or not --keep-going is given; they are listed with the batch's summary.
+class Watcher final {
+public:
+    Watcher(const CommandlineOptions&, const ScanContext&);
+    ~Watcher();
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    /// @brief Takes a record of the initial scan, thread-safe
+    void add(const std::filesystem::path&, const PhotoRecord&);
+
+    /// @brief Starts watching `directories` recursively. Called before the initial scan, so changes made while it
+    /// runs are queued by inotify instead of being missed; files the scan also read are simply read again. Prints
+    /// the error and returns false if inotify isn't available.
+    bool start(const std::vector<std::string>& directories);
+
+    /// @brief Prints the changed files and the summary after every batch of changes since start(). Only returns if
+    /// inotify fails, with the exit code.
+    int run();
+
+private:
+    struct Directory {
+        std::map<std::string, PhotoSample> samples {};
+        Data data;
+        // Set when a sample was replaced or removed, statistics can't be subtracted from
+        bool dirty { false };
+        // Part of m_settled
+        bool settled { true };
+    };
+
+    [[nodiscard]] Data emptyData() const;
+    Directory& directory(const std::filesystem::path&);
+    [[nodiscard]] PhotoSample intern(const PhotoRecord&);
+    /// @brief After a sample of the directory at `path` was replaced or removed
+    void markDirty(const std::filesystem::path& path, Directory&);
+    void rebuild(Directory&);
+    void watchTree(const std::filesystem::path&, bool scanFiles);
+    void forgetTree(const std::filesystem::path&);
+    void resync();
+    void markChanged(const std::filesystem::path&);
+    [[nodiscard]] bool isTracked(const std::filesystem::path&) const;
+    void markRemoved(const std::filesystem::path&);
+    void applyChanges(OutputBuffer&);
+    void printSummary(OutputBuffer&, std::size_t changed, std::size_t removed);
+
+    const CommandlineOptions& m_options;
+    // The caller's context, but collecting failures into m_failures
+    ScanContext m_context;
+    FailureReport m_failures {};
+    int m_fd { -1 };
+    std::mutex m_mutex {};
+    std::unordered_map<int, std::filesystem::path> m_watches {};
+    std::map<std::filesystem::path, Directory> m_directories {};
+    // Camera and lens keys of all samples
+    InternTable m_cameras {};
+    InternTable m_lenses {};
+    // Merged statistics of the settled directories, rebuilt only when one of them becomes dirty and leaves them
+    Data m_settled;
+    bool m_settledStale { true };
+    std::set<std::filesystem::path> m_unsettled {};
+    // Pending changes of the current batch, by normalized path
+    std::set<std::filesystem::path> m_changed {};
+    std::set<std::filesystem::path> m_removed {};
+    std::unique_ptr<LibRaw> m_raw { std::make_unique<LibRaw>() };
+};
@@ -1,233 +1,53 @@
 #include <cxxopts.hpp>
 #ifdef __unix__
 #include <sys/ioctl.h>
+#include <unistd.h>
 #endif
 #include <filesystem>
-#include <libraw/libraw.h>
-#include <numeric>
 
+#include "Aggregator.h"
+#include "CommandlineOptions.h"
 #include "Data.h"
-#include "FormatUtils.h"
+#include "Extractor.h"
+#include "Filter.h"
+#include "MetadataCache.h"
+#include "Output.h"
+#include "PartialSummary.h"
+#include "PreviewExtractor.h"
+#include "RecordWriter.h"
+#include "Scanner.h"
+#include "Summary.h"
+#include "ThreadPool.h"
 #include "TimeUtils.h"
+#include "Watcher.h"
 
 // Used as a backup for non-Unix platforms, otherwise current terminal columns
 #define TERM_WIDTH 80
 
-struct CommandlineOptions {
-    bool silent { false };
-    bool showCamera { true };
-    bool showLens { true };
-    bool showSize { true };
-    bool showTimestamp { true };
-    bool showSoftware { true };
-    bool showCameraType { true };
-    bool showQuality { true };
-};
-
 namespace fs = std::filesystem;
 namespace chrono = std::chrono;
 
 using fmt::print, fmt::fg, fmt::bg, fmt::color;
 using Clock = chrono::system_clock;
 
-constexpr bool stringEmpty(const char* str)
-{
-    return str == nullptr || str[0] == '\0';
-}
-
-void printMetadata(const LibRaw& rawData, const CommandlineOptions& options)
-{
-    auto imgdata = rawData.imgdata;
-    auto sizes = imgdata.sizes;
-    auto meta = imgdata.idata;
-    // why is this called 'other'? iso, shutter, aperture etc. seem like important metadata, don't they?
-    auto other = imgdata.other;
-    auto lensInfo = imgdata.lens;
-    auto lens = FormatUtils::formatLens(lensInfo);
-    auto shooting = imgdata.shootinginfo;
-
-    if (options.showCamera) {
-        print(fg(color::cyan), "\tCamera: ");
-        print("{} {} ", meta.make, meta.model);
-        print(fg(color::gray), "@");
-        print(" ISO {} {}\n", other.iso_speed, FormatUtils::formatShutterSpeed(other.shutter));
-
-        if (!stringEmpty(shooting.BodySerial)) {
-            print(fg(color::cyan), "\t\tBody serial: ");
-            print("{}\n", shooting.BodySerial);
-        }
-    }
-
-    if (options.showLens) {
-        print(fg(color::cyan), "\tLens: ");
-        print("{} (id={}) ", lens, lensInfo.makernotes.LensID);
-        print(fg(color::gray), "@");
-        print(" {}mm {}\n", other.focal_len, FormatUtils::formatAperture(other.aperture));
-
-        if (!stringEmpty(lensInfo.LensSerial)) {
-            print(fg(color::cyan), "\t\tLens serial: ");
-            print("{}\n", lensInfo.LensSerial);
-        }
-    }
-
-    if (options.showSize) {
-        print(fg(color::cyan), "\tSize: ");
-        print("{} {}x{} ", FormatUtils::formatResolution(sizes.width * sizes.height), sizes.width, sizes.height);
-        print(fg(color::gray), "(raw: {}x{})\n", sizes.raw_width, sizes.raw_height);
-    }
-
-    if (options.showTimestamp) {
-        print(fg(color::cyan), "\tTimestamp: ");
-        print("{}", TimeUtils::formatISO8601(other.timestamp));
-        print(fg(color::gray), " ({})\n", TimeUtils::formatTimeSince(other.timestamp));
-    }
-
-    if (options.showSoftware && !stringEmpty(meta.software)) {
-        print(fg(color::cyan), "\tSoftware: ");
-        print("{}\n", meta.software);
-    }
-
-    switch (meta.maker_index) {
-    case LIBRAW_CAMERAMAKER_Sony: {
-        auto sony = imgdata.makernotes.sony;
-
-        if (options.showCameraType) {
-            print(fg(color::cyan), "\tCamera type: ");
-            switch (sony.CameraType) {
-            case LIBRAW_SONY_DSC:
-                print("Sony DSC point-and-shoot\n");
-                break;
-            case LIBRAW_SONY_DSLR:
-                print("Sony DSLR\n");
-                break;
-            case LIBRAW_SONY_NEX:
-                print("Sony NEX mirrorless\n");
-                break;
-            case LIBRAW_SONY_SLT:
-                print("Sony SLT DSLT\n");
-                break;
-            case LIBRAW_SONY_ILCE:
-                print("Sony ILCE E-mount mirrorless\n");
-                break;
-            case LIBRAW_SONY_ILCA:
-                print("Sony ILCA A-mount DSLT\n");
-                break;
-            default:
-                print("Unknown type ({})\n", sony.CameraType);
-                break;
-            }
-        }
-
-        if (options.showQuality) {
-            print(fg(color::cyan), "\tQuality: ");
-            switch (sony.Quality) {
-            case 0:
-            case 6:
-                print("(Uncompressed) RAW\n");
-                break;
-            case 7:
-            case 8:
-                print("Compressed RAW\n");
-                break;
-            default:
-                print("Unknown quality ({})\n", sony.Quality);
-                break;
-            }
-        }
-
-        break;
-    }
-    case LIBRAW_CAMERAMAKER_Canon: {
-        auto canon = imgdata.makernotes.canon;
-
-        if (options.showQuality) {
-            print(fg(color::cyan), "\tQuality: ");
-            switch (canon.Quality) {
-            case 1:
-                print("Economy\n");
-                break;
-            case 2:
-                print("Normal\n");
-                break;
-            case 3:
-                print("Fine\n");
-                break;
-            case 4:
-                print("RAW\n");
-                break;
-            case 5:
-                print("Superfine\n");
-                break;
-            case 7:
-                print("CRAW\n");
-                break;
-            case 130:
-                print("Normal Movie\n");
-                break;
-            case 131:
-                print("CRM StandardRaw\n");
-                break;
-            default:
-                print("Unknown quality ({})\n", canon.Quality);
-                break;
-            }
-        }
-
-        break;
-    }
-    default: {
-        UNREACHABLE();
-    }
-    }
-}
-
-void populateArrays(Data* data, const fs::path& path, const CommandlineOptions& options)
+/// @brief Expands a leading '~' to $HOME, for paths passed as --option=~/...
+fs::path expandHome(const std::string& path)
 {
-    ASSERT_MSG(exists(path), "File does not exist");
-    LibRaw raw {};
-    ASSERT_MSG(raw.open_file(path.c_str()) == LIBRAW_SUCCESS, path.c_str());
-
-    auto imgdata = raw.imgdata;
-    auto sizes = imgdata.sizes;
-    auto meta = imgdata.idata;
-    auto other = imgdata.other;
-    auto lensInfo = imgdata.lens;
-    auto lens = FormatUtils::formatLens(lensInfo);
-
-    data->timestamps.push_back(other.timestamp);
-    data->iso_speeds.push_back(other.iso_speed);
-    data->shutter_speeds.push_back(other.shutter);
-    data->focal_lengths.push_back(other.focal_len);
-    data->aperture_values.push_back(other.aperture);
-    data->resolutions.push_back(static_cast<float>(sizes.width * sizes.height));
-    data->lenses[lens]++;
-    data->cameras[fmt::format("{} {}", meta.make, meta.model)]++;
-
-    if (!options.silent)
-        printMetadata(raw, options);
+    if (!path.starts_with('~'))
+        return path;
+    auto* home = std::getenv("HOME");
+    if (home == nullptr)
+        return path;
+    return fs::path { home } / path.substr(path.starts_with("~/") ? 2 : 1);
 }
 
-std::vector<fs::path> findRawFiles(Data* data, const std::vector<std::string>& directories)
+bool stdoutIsTerminal()
 {
-    std::vector<fs::path> files {};
-    std::size_t count { 0 };
-    for (auto& directory : directories) {
-        for (auto& entry : fs::recursive_directory_iterator(directory)) {
-            if (!entry.is_regular_file())
-                continue;
-
-            const auto& path = entry.path();
-            if (path.filename().string().at(0) == '.')
-                continue;
-            if (auto extension = path.extension(); extension == ".ARW" || extension == ".CR2" || extension == ".CR3") {
-                files.push_back(path);
-                ++count;
-            }
-        }
-    }
-    data->reserveCapacity(count);
-
-    return files;
+#ifdef __unix__
+    return isatty(STDOUT_FILENO);
+#else
+    return true;
+#endif
 }
 
 int getTerminalWidth()
@@ -241,6 +61,44 @@ int getTerminalWidth()
 #endif
 }
 
+/// @brief --merge: prints the summary of the partial summaries written by --emit-partial on other machines
+int mergePartials(const std::vector<std::string>& paths, bool color)
+{
+    if (paths.empty()) {
+        print(fg(color::red), "--merge needs at least one partial summary file\n");
+        return 1;
+    }
+
+    std::optional<Data> data {};
+    chrono::milliseconds time {};
+    for (auto& path : paths) {
+        auto partial = PartialSummary::read(path);
+        if (!partial.has_value())
+            return 1;
+        if (data.has_value()
+            && (partial->data.iso_speeds.exact() != data->iso_speeds.exact() || partial->data.groups.groupBy() != data->groups.groupBy()
+                || partial->data.timeline.bucket() != data->timeline.bucket() || partial->data.timeline.sessionGap() != data->timeline.sessionGap())) {
+            print(fg(color::red), "{} was written with different --exact-stats, --group-by or --timeline settings than {}\n", path, paths.front());
+            return 1;
+        }
+        // Shards are scanned concurrently, so the slowest one is how long the whole scan took
+        time = std::max(time, partial->time);
+        if (data.has_value())
+            data->merge(partial->data);
+        else
+            data = std::move(partial->data);
+    }
+
+    if (data->photoCount() == 0) {
+        print(fg(color::red), "The partial summaries contain no photos\n");
+        return 1;
+    }
+    OutputBuffer out { color };
+    printSummary(out, *data, time);
+    out.writeTo(stdout);
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     auto options = cxxopts::Options {
@@ -258,10 +116,36 @@ int main(int argc, char** argv)
         ("showSoftware", "Show camera software version", cxxopts::value<bool>()->default_value("true"))
         ("showCameraType", "Show camera type", cxxopts::value<bool>()->default_value("true"))
         ("showQuality", "Show image quality setting", cxxopts::value<bool>()->default_value("true"))
+        ("cache", "Persistent metadata cache file, e.g. ~/.cache/rawinfo.db", cxxopts::value<std::string>())
+        ("io", "How files are read: libraw, mmap or pread", cxxopts::value<std::string>()->default_value("libraw"))
+        ("sniff", "Also find raw files with unknown extensions by reading their first bytes")
+        ("archives", "Also read raw files inside .tar and .zip archives, without extracting them")
+        ("fastpath", "Read ARW and CR2 metadata with the built-in TIFF parser, falling back to libraw")
+        ("verify-fastpath", "Run both the TIFF fast path and libraw on ARW and CR2 files and report differences")
+        ("exact-stats", "Keep every sample for exact medians and percentiles instead of sketching them")
+        ("where", "Only report files matching this expression, e.g. \"iso > 3200 and camera ~ ILCE-7M4\"", cxxopts::value<std::string>())
+        ("sample", "Only read this fraction of the files, e.g. 0.01, and estimate the summary with confidence intervals", cxxopts::value<double>())
+        ("sample-count", "Only read this many randomly chosen files, see --sample", cxxopts::value<std::size_t>())
+        ("keep-going", "Report files that can't be read at the end instead of aborting on the first one")
+        ("file-timeout", "Give up on any file that takes longer than this many milliseconds to read, cache and fast path included (0 = no limit)", cxxopts::value<std::size_t>()->default_value("0"))
+        ("output", "Output format: text, jsonl, csv or bin (columnar)", cxxopts::value<std::string>()->default_value("text"))
+        ("timeline", "Also report photos, cameras, lenses and the median ISO per hour, day or month, and the shooting sessions", cxxopts::value<std::string>()->default_value("none"))
+        ("session-gap", "Minutes without a photo that end a --timeline shooting session", cxxopts::value<std::size_t>()->default_value("60"))
+        ("group-by", "Also report the summary statistics per camera, lens or camera,lens", cxxopts::value<std::string>()->default_value("none"))
+        ("no-color", "Disable colored output (default when stdout is not a terminal)")
+        ("emit-partial", "Write the aggregation state to this file instead of printing the summary, see --merge", cxxopts::value<std::string>())
+        ("extract-previews", "Write the JPEG preview embedded in every raw file to this directory instead of printing metadata", cxxopts::value<std::string>())
+        ("merge", "Print the combined summary of the partial summary files given as arguments")
+        ("partials", "Partial summary files for --merge", cxxopts::value<std::vector<std::string>>())
+        ("prefetch", "Read the headers of up to N upcoming files ahead of the workers (0 = off)", cxxopts::value<std::size_t>()->default_value("0"))
+        ("watch", "After the scan, keep following changes in the directories and update the summary")
+        ("profile", "Time every stage of every file, print latency percentiles and the N slowest files", cxxopts::value<std::size_t>()->implicit_value("10"))
+        ("j,jobs", "Number of worker threads (0 = one per hardware thread)", cxxopts::value<std::size_t>()->default_value("1"))
         ("d,directories", "Directories to search for raw files", cxxopts::value<std::vector<std::string>>()->default_value("."))
         ("f,files", "Raw files to process", cxxopts::value<std::vector<std::string>>()->default_value(""));
 
     // clang-format on
+    options.parse_positional({ "partials" });
     options.custom_help("[-s] [-f <files>] [-d <directories>] [OPTION...]\n\nNOTE: Use --show(...)=false to disable boolean options with a default value of true.");
     options.set_width(getTerminalWidth());
 
@@ -278,6 +162,43 @@ int main(int argc, char** argv)
         return 0;
     }
 
+    if (result.count("merge")) {
+        auto partials = result.count("partials") ? result["partials"].as<std::vector<std::string>>() : std::vector<std::string> {};
+        return mergePartials(partials, result.count("no-color") == 0 && stdoutIsTerminal());
+    }
+    if (result.count("partials")) {
+        print(fg(color::red), "Unexpected argument '{}', did you mean --merge?\n", result["partials"].as<std::vector<std::string>>().front());
+        return 1;
+    }
+
+    auto ioMode = parseIoMode(result["io"].as<std::string>());
+    if (!ioMode.has_value()) {
+        print(fg(color::red), "Unknown I/O mode '{}', expected libraw, mmap or pread\n", result["io"].as<std::string>());
+        return 1;
+    }
+
+    auto outputFormat = parseOutputFormat(result["output"].as<std::string>());
+    if (!outputFormat.has_value()) {
+        print(fg(color::red), "Unknown output format '{}', expected text, jsonl, csv or bin\n", result["output"].as<std::string>());
+        return 1;
+    }
+
+    auto groupBy = parseGroupBy(result["group-by"].as<std::string>());
+    if (!groupBy.has_value()) {
+        print(fg(color::red), "Unknown grouping '{}', expected camera, lens or camera,lens\n", result["group-by"].as<std::string>());
+        return 1;
+    }
+
+    auto timeline = parseTimelineBucket(result["timeline"].as<std::string>());
+    if (!timeline.has_value()) {
+        print(fg(color::red), "Unknown timeline bucket '{}', expected hour, day or month\n", result["timeline"].as<std::string>());
+        return 1;
+    }
+    if (result["session-gap"].as<std::size_t>() == 0) {
+        print(fg(color::red), "--session-gap must be at least 1 minute\n");
+        return 1;
+    }
+
     auto commandLineOptions = CommandlineOptions {
         .silent = result.count("silent") != 0,
         .showCamera = result["showCamera"].as<bool>(),
@@ -287,89 +208,227 @@ int main(int argc, char** argv)
         .showSoftware = result["showSoftware"].as<bool>(),
         .showCameraType = result["showCameraType"].as<bool>(),
         .showQuality = result["showQuality"].as<bool>(),
+        .jobs = ThreadPool::resolveWorkerCount(result["jobs"].as<std::size_t>()),
+        .ioMode = *ioMode,
+        .sniff = result.count("sniff") != 0,
+        .archives = result.count("archives") != 0,
+        .fastPath = result.count("fastpath") != 0,
+        .verifyFastPath = result.count("verify-fastpath") != 0,
+        .exactStats = result.count("exact-stats") != 0,
+        .keepGoing = result.count("keep-going") != 0,
+        .fileTimeout = chrono::milliseconds { result["file-timeout"].as<std::size_t>() },
+        .color = result.count("no-color") == 0 && stdoutIsTerminal(),
+        .outputFormat = *outputFormat,
+        .groupBy = *groupBy,
+        .timeline = *timeline,
+        .sessionGap = chrono::minutes { result["session-gap"].as<std::size_t>() },
     };
-    auto data = std::make_unique<Data>();
-    auto files = findRawFiles(data.get(), result["directories"].as<std::vector<std::string>>());
+    auto watch = result.count("watch") != 0;
+    if (watch && commandLineOptions.outputFormat != OutputFormat::Text) {
+        print(fg(color::red), "--watch only supports text output\n");
+        return 1;
+    }
+    if (watch && commandLineOptions.archives) {
+        print(fg(color::red), "--watch and --archives can't be combined\n");
+        return 1;
+    }
+    auto emitPartial = result.count("emit-partial") != 0;
+    if (watch && emitPartial) {
+        print(fg(color::red), "--watch and --emit-partial can't be combined\n");
+        return 1;
+    }
 
-    for (auto& file : result["files"].as<std::vector<std::string>>()) {
-        files.emplace_back(file);
+    auto extractPreviews = result.count("extract-previews") != 0;
+    if (extractPreviews && (watch || emitPartial || commandLineOptions.outputFormat != OutputFormat::Text)) {
+        print(fg(color::red), "--extract-previews can't be combined with --watch, --emit-partial or --output\n");
+        return 1;
     }
-    ASSERT_MSG(!files.empty(), "No raw files found");
 
-    auto start = Clock::now();
+    std::optional<Filter> filter {};
+    if (result.count("where")) {
+        filter = Filter::compile(result["where"].as<std::string>());
+        if (!filter.has_value())
+            return 1;
+    }
 
-    for (auto& file : files) {
-        if (file.empty())
-            continue;
+    auto scanOptions = ScanOptions {
+        .directories = result["directories"].as<std::vector<std::string>>(),
+        .files = result["files"].as<std::vector<std::string>>(),
+        .prefetch = result["prefetch"].as<std::size_t>(),
+    };
+    if (result.count("profile"))
+        scanOptions.profile = result["profile"].as<std::size_t>();
 
-        if (!commandLineOptions.silent) {
-            print(bg(color::dark_slate_gray) | fg(color::white), "Metadata for image ");
-            print(bg(color::dark_slate_gray) | fg(color::light_green), "{}", file.filename().string());
-            print(bg(color::dark_slate_gray) | fg(color::white), ":");
-            print("\n");
+    // Sampled files are picked per directory, from everything discovery finds
+    if (result.count("sample") && result.count("sample-count")) {
+        print(fg(color::red), "--sample and --sample-count can't be combined\n");
+        return 1;
+    }
+    if (result.count("sample")) {
+        auto fraction = result["sample"].as<double>();
+        if (!(fraction > 0.0 && fraction <= 1.0)) {
+            print(fg(color::red), "--sample must be a fraction between 0 and 1, e.g. 0.01\n");
+            return 1;
         }
-        populateArrays(data.get(), file, commandLineOptions);
+        scanOptions.sampleFraction = fraction;
+    }
+    if (result.count("sample-count")) {
+        auto count = result["sample-count"].as<std::size_t>();
+        if (count == 0) {
+            print(fg(color::red), "--sample-count must be at least 1\n");
+            return 1;
+        }
+        scanOptions.sampleCount = count;
+    }
+    // The estimates only hold for the files present at the start, and partials carry no sample sizes to merge
+    auto sampling = scanOptions.sampleFraction != 0.0 || scanOptions.sampleCount != 0;
+    if (sampling && (watch || emitPartial)) {
+        print(fg(color::red), "Sampling can't be combined with --watch or --emit-partial\n");
+        return 1;
+    }
+    // Leaving files out would split sessions at every gap it opens up
+    if (sampling && commandLineOptions.timeline != TimelineBucket::None) {
+        print(fg(color::red), "Sampling can't be combined with --timeline\n");
+        return 1;
     }
 
-    // Do not print summary if we're processing a single file.
-    if (files.size() == 1)
-        return 0;
+    // Per-file blocks are written whole, line buffering would only split them up again
+    if (!commandLineOptions.color)
+        std::setvbuf(stdout, nullptr, _IOFBF, 1 << 16);
+    std::unique_ptr<MetadataCache> cache {};
+    if (result.count("cache")) {
+        cache = MetadataCache::open(expandHome(result["cache"].as<std::string>()));
+        if (cache == nullptr)
+            return 1;
+    }
 
-    if (!commandLineOptions.silent)
-        print("\n");
+    auto start = Clock::now();
+    // "n minutes ago" is relative to the start of the scan, not re-read for every file
+    TimeUtils::captureNow();
+
+    // Workers render each file's block on their own, blocks are written in discovery order
+    OrderedOutput output { stdout };
+    ColumnarWriter columns {};
+    FastPathStats fastPathStats {};
+    FailureReport failures {};
+    auto context = ScanContext {
+        .cache = cache.get(),
+        .output = &output,
+        .columns = &columns,
+        .fastPath = &fastPathStats,
+        .failures = commandLineOptions.keepGoing ? &failures : nullptr,
+        .filter = filter.has_value() ? &*filter : nullptr,
+    };
+    std::unique_ptr<PreviewExtractor> previews {};
+    if (extractPreviews) {
+        previews = std::make_unique<PreviewExtractor>(expandHome(result["extract-previews"].as<std::string>()), commandLineOptions);
+        // Previews don't need any metadata unless --where asks for it, and files that already have one aren't read
+        scanOptions.readRecords = filter.has_value() && filter->usesRecord();
+        scanOptions.skip = [&](const RawFile& file) { return previews->exists(file); };
+    }
+    std::unique_ptr<Watcher> watcher {};
+    if (watch) {
+        watcher = std::make_unique<Watcher>(commandLineOptions, context);
+        if (!watcher->start(result["directories"].as<std::vector<std::string>>()))
+            return 1;
+    }
+    if (commandLineOptions.outputFormat == OutputFormat::Csv) {
+        OutputBuffer header { false };
+        RecordWriter::writeCsvHeader(header);
+        header.writeTo(stdout);
+    }
+
+    // Every worker fills its own shard, so the hot loop never contends on Data
+    Aggregator aggregator { commandLineOptions.jobs, Data { commandLineOptions.exactStats, commandLineOptions.groupBy, commandLineOptions.timeline, commandLineOptions.sessionGap } };
+    Scanner scanner { std::move(scanOptions), commandLineOptions, context };
+    scanner.run([&](const ScannedFile& scanned) {
+        if (scanned.record != nullptr) {
+            aggregator.add(scanned.worker, *scanned.record);
+            if (watcher != nullptr)
+                watcher->add(scanned.file.path, *scanned.record);
+            scanned.timer.lap(Stage::Aggregate);
+        }
+        // Previews replace the per-file output, --where still decides which files get one
+        if (previews != nullptr) {
+            if (scanned.matched)
+                previews->extract(scanned.file, scanned.worker, scanned.timer);
+            return;
+        }
+        emitRecord(scanned.file, scanned.record, commandLineOptions, context, scanned.timer);
+    });
+
+    auto data = std::make_unique<Data>(aggregator.merge());
+    auto photoCount = data->photoCount();
+    auto sample = scanner.sample();
+    if (sample.has_value() && sample->population != 0 && sample->sampled == 0) {
+        print(fg(color::red), "The sample is empty, none of the {} files were picked; try a larger --sample\n", sample->population);
+        return 1;
+    }
+    // Previews are written without reading any metadata, so there may be files but no photos
+    auto found = previews != nullptr ? previews->files() : photoCount;
+    // Watching an empty tree is fine, files may still arrive
+    ASSERT_MSG(found != 0 || watch || failures.size() != 0 || filter.has_value(), "No raw files found");
+    if (found == 0 && filter.has_value() && !watch)
+        print(stderr, fg(color::yellow), "No files matched --where\n");
+    // Unreadable files are listed on stderr once the scan is done, and reflected in the exit status
+    auto status = failures.size() != 0 ? 2 : 0;
+    if (failures.size() != 0) {
+        std::fflush(stdout);
+        OutputBuffer report { commandLineOptions.color };
+        failures.print(report, commandLineOptions.fileTimeout);
+        report.writeTo(stderr);
+    }
 
-    auto time = chrono::duration_cast<chrono::milliseconds>(Clock::now() - start);
-    auto printVector = [](std::vector<float>& vec, std::string_view name, const std::function<std::string(float)>& format) {
-        print(fg(color::cyan), "{}: ", name);
+    if (previews != nullptr) {
+        OutputBuffer out { commandLineOptions.color };
+        previews->print(out, scanner.scanTime());
+        if (result.count("profile")) {
+            out.print("\n");
+            scanner.profiler().print(out, scanner.scanTime(), scanner.discoveryTime());
+        }
+        out.writeTo(stdout);
+        return previews->failed() != 0 ? 2 : status;
+    }
 
-        std::sort(ITERATORS(vec));
+    if (emitPartial && !PartialSummary::write(expandHome(result["emit-partial"].as<std::string>()), *data, chrono::duration_cast<chrono::milliseconds>(Clock::now() - start)))
+        return 1;
 
-        auto min = *std::min_element(ITERATORS(vec));
-        auto max = *std::max_element(ITERATORS(vec));
-        auto avg = std::accumulate(ITERATORS(vec), 0.0) / vec.size();
-        auto median = vec[vec.size() / 2];
+    auto profile = result.count("profile") != 0;
+    auto profiler = scanner.profiler();
+    if (commandLineOptions.outputFormat != OutputFormat::Text) {
+        if (commandLineOptions.outputFormat == OutputFormat::Binary)
+            columns.write(stdout);
+        if (commandLineOptions.verifyFastPath)
+            print(stderr, "Fast path verified on {} files, {} mismatched, {} declined\n", fastPathStats.verified.load(), fastPathStats.mismatches.load(), fastPathStats.declined.load());
+        // Machine-readable formats keep stdout clean, the report goes to stderr there
+        if (profile) {
+            OutputBuffer report { false };
+            profiler.print(report, scanner.scanTime(), scanner.discoveryTime());
+            report.writeTo(stderr);
+        }
+        return status;
+    }
 
-        print(fg(color::gray), "min: ");
-        print("{} ", format(min));
-        print(fg(color::gray), "max: ");
-        print("{} ", format(max));
-        print(fg(color::gray), "avg: ");
-        print("{} ", format(static_cast<float>(avg)));
-        print(fg(color::gray), "median: ");
-        print("{}\n", format(median));
-    };
+    OutputBuffer out { commandLineOptions.color };
+    if (commandLineOptions.verifyFastPath)
+        out.print(fastPathStats.mismatches == 0 ? fg(color::green) : fg(color::yellow), "Fast path verified on {} files, {} mismatched, {} declined\n", fastPathStats.verified.load(), fastPathStats.mismatches.load(), fastPathStats.declined.load());
 
-    data->assertNotEmpty();
-    data->assertEqualSizes();
-
-    std::sort(ITERATORS(data->timestamps));
-    print("Analyzed {} photos in {}ms ({:.02f}ms/photo)\n", data->iso_speeds.size(), time.count(), time.count() / static_cast<float>(data->iso_speeds.size()));
-    print(fg(color::cyan), "Time frame: ");
-    print("{} ", TimeUtils::formatISO8601(data->timestamps.front()));
-    print(fg(color::gray), "-");
-    print(" {} ", TimeUtils::formatISO8601(data->timestamps.back()));
-    print(fg(color::gray), "({})\n", TimeUtils::formatTimeSpan(data->timestamps.front(), data->timestamps.back()));
-    printVector(data->iso_speeds, "ISO speeds", FormatUtils::formatISO);
-    printVector(data->shutter_speeds, "Shutter speeds", FormatUtils::formatShutterSpeed);
-    printVector(data->focal_lengths, "Focal lengths", FormatUtils::formatFocalLength);
-    printVector(data->aperture_values, "Aperture", FormatUtils::formatAperture);
-    printVector(data->resolutions, "Resolutions", FormatUtils::formatResolution);
-
-    for (auto& [lens, count] : data->lenses) {
-        print(fg(color::cyan), "Lens '{}': ", lens);
-        if (count == 1)
-            print("1 photo\n");
-        else
-            print("{} photos\n", count);
+    // Do not print summary if we're processing a single file.
+    if (photoCount > 1 && !emitPartial) {
+        if (!commandLineOptions.silent)
+            out.print("\n");
+        printSummary(out, *data, chrono::duration_cast<chrono::milliseconds>(Clock::now() - start), sample.has_value() ? &*sample : nullptr);
+    }
+    if (profile) {
+        out.print("\n");
+        profiler.print(out, scanner.scanTime(), scanner.discoveryTime());
     }
+    out.writeTo(stdout);
 
-    for (auto& [camera, count] : data->cameras) {
-        print(fg(color::cyan), "Camera '{}': ", camera);
-        if (count == 1)
-            print("1 photo\n");
-        else
-            print("{} photos\n", count);
+    if (watcher != nullptr) {
+        std::fflush(stdout);
+        return watcher->run();
     }
 
-    return 0;
-}
+    return status;
+}
\ No newline at end of file